@@ -0,0 +1,69 @@
+-- Run with --script-benchmark <iterations>. Each benchmark gets the iteration
+-- count and a detached transform, and returns false if it can't run here.
+-- Sticks to Lua 5.1 syntax so the same file runs on every backend.
+
+benchmarks = {
+    {"arithmetic", function(n)
+        local x = 0
+        for i = 1, n do
+            x = x + (i % 7) * 0.5 - x * 0.001
+        end
+        return x
+    end},
+
+    {"function_calls", function(n)
+        local function step(a, b) return a + b * 0.5 end
+        local x = 0
+        for i = 1, n do
+            x = step(x, i)
+        end
+        return x
+    end},
+
+    {"table_churn", function(n)
+        local sum = 0
+        for i = 1, n do
+            local t = {x = i, y = i * 2, z = i * 3}
+            sum = sum + t.x + t.y + t.z
+        end
+        return sum
+    end},
+
+    {"vec3_methods", function(n)
+        local a = vec3(1, 2, 3)
+        local b = vec3(0.1, 0.2, 0.3)
+        for i = 1, n do
+            a:add(b)
+            a:scale(0.999)
+        end
+        return a:length()
+    end},
+
+    {"transform_property", function(n, transform)
+        for i = 1, n do
+            local p = transform.position
+            p.x = p.x + 0.001
+            transform.position = p
+        end
+    end},
+
+    {"transform_getter", function(n, transform)
+        local p = vec3()
+        for i = 1, n do
+            transform:get_position(p)
+            p.x = p.x + 0.001
+            transform.position = p
+        end
+    end},
+
+    {"transform_ffi", function(n, transform)
+        if not transform_view then
+            return false
+        end
+        local t = transform_view(transform)
+        for i = 1, n do
+            t.position.x = t.position.x + 0.001
+        end
+        t.dirty = 1
+    end},
+}
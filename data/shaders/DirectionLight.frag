@@ -1,7 +1,14 @@
 #version 330
 in vec2 uv;
 
-uniform vec3 eye_position; // TODO: Bind this
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec4 camera_position;
+    vec4 viewport;
+};
+
 uniform vec4 color = vec4(1.0, 1.0, 1.0, 1.0);
 uniform vec3 direction;
 uniform sampler2D colortex;
@@ -18,7 +25,7 @@ void main() {
     vec3 reverse_direction = direction * -1;
     float diffuse_power = max(dot(normalize(texNormal).xyz, reverse_direction), 0);
 
-    vec4 eye_diff = vec4(eye_position, 1) - texPosition;
+    vec4 eye_diff = vec4(camera_position.xyz, 1) - texPosition;
     vec3 to_eye = normalize(eye_diff).xyz;
     vec3 reflected = normalize(reflect(reverse_direction, normalize(texNormal).xyz));
     float specular_power = max(dot(to_eye, reflected), 0);
@@ -0,0 +1,372 @@
+#include "AABBTree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/trigonometric.hpp>
+#include <random>
+
+static AABB combine(const AABB& a, const AABB& b)
+{
+    return { glm::vec3(std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)),
+        glm::vec3(std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)) };
+}
+
+static float area(const AABB& box)
+{
+    glm::vec3 size = box.max - box.min;
+    return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static bool contains(const AABB& outer, const AABB& inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+        outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+}
+
+static AABB grow(const AABB& box, float margin)
+{
+    return { box.min - glm::vec3(margin), box.max + glm::vec3(margin) };
+}
+
+int AABBTree::insert(const AABB& box, void* data)
+{
+    int leaf = allocate();
+    m_nodes[leaf].box = grow(box, m_margin);
+    m_nodes[leaf].data = data;
+    insertLeaf(leaf);
+    ++m_count;
+    return leaf;
+}
+
+void AABBTree::remove(int proxy)
+{
+    removeLeaf(proxy);
+    release(proxy);
+    --m_count;
+}
+
+bool AABBTree::move(int proxy, const AABB& box)
+{
+    // Leaves are also refitted if they've shrunk well inside their fat box.
+    const AABB& fat = m_nodes[proxy].box;
+    if(contains(fat, box) && contains(grow(box, m_margin * 4), fat))
+        return false;
+    removeLeaf(proxy);
+    m_nodes[proxy].box = grow(box, m_margin);
+    insertLeaf(proxy);
+    return true;
+}
+
+int AABBTree::getHeight(void) const
+{
+    return m_root == -1 ? 0 : m_nodes[m_root].height;
+}
+
+int AABBTree::allocate(void)
+{
+    int index;
+    if(m_free == -1) {
+        index = m_nodes.size();
+        m_nodes.push_back(Node());
+    } else {
+        index = m_free;
+        m_free = m_nodes[index].parent;
+    }
+    Node& node = m_nodes[index];
+    node.data = nullptr;
+    node.parent = -1;
+    node.left = -1;
+    node.right = -1;
+    node.height = 0;
+    return index;
+}
+
+void AABBTree::release(int node)
+{
+    m_nodes[node].parent = m_free;
+    m_nodes[node].height = -1;
+    m_free = node;
+}
+
+void AABBTree::insertLeaf(int leaf)
+{
+    if(m_root == -1) {
+        m_root = leaf;
+        m_nodes[leaf].parent = -1;
+        return;
+    }
+
+    // Walk down to the cheapest sibling. Pairing with a node costs the area of
+    // the new parent, plus the area that's added to every ancestor above it.
+    AABB box = m_nodes[leaf].box;
+    int index = m_root;
+    while(!m_nodes[index].isLeaf()) {
+        const Node& node = m_nodes[index];
+        float combined = area(combine(node.box, box));
+        float cost = 2 * combined;
+        float inherited = 2 * (combined - area(node.box));
+
+        float child_cost[2];
+        int children[2] = { node.left, node.right };
+        for(int i = 0; i < 2; ++i) {
+            const Node& child = m_nodes[children[i]];
+            child_cost[i] = area(combine(child.box, box)) + inherited;
+            if(!child.isLeaf())
+                child_cost[i] -= area(child.box);
+        }
+        if(cost < child_cost[0] && cost < child_cost[1])
+            break;
+        index = child_cost[0] < child_cost[1] ? children[0] : children[1];
+    }
+
+    int sibling = index;
+    int old_parent = m_nodes[sibling].parent;
+    int new_parent = allocate();
+    m_nodes[new_parent].parent = old_parent;
+    m_nodes[new_parent].box = combine(box, m_nodes[sibling].box);
+    m_nodes[new_parent].height = m_nodes[sibling].height + 1;
+    m_nodes[new_parent].left = sibling;
+    m_nodes[new_parent].right = leaf;
+    m_nodes[sibling].parent = new_parent;
+    m_nodes[leaf].parent = new_parent;
+    if(old_parent == -1)
+        m_root = new_parent;
+    else if(m_nodes[old_parent].left == sibling)
+        m_nodes[old_parent].left = new_parent;
+    else
+        m_nodes[old_parent].right = new_parent;
+
+    refit(new_parent);
+}
+
+void AABBTree::removeLeaf(int leaf)
+{
+    if(leaf == m_root) {
+        m_root = -1;
+        return;
+    }
+
+    // The leaf's sibling takes its parent's place.
+    int parent = m_nodes[leaf].parent;
+    int grandparent = m_nodes[parent].parent;
+    int sibling = m_nodes[parent].left == leaf ? m_nodes[parent].right : m_nodes[parent].left;
+    m_nodes[sibling].parent = grandparent;
+    release(parent);
+    if(grandparent == -1) {
+        m_root = sibling;
+        return;
+    }
+    if(m_nodes[grandparent].left == parent)
+        m_nodes[grandparent].left = sibling;
+    else
+        m_nodes[grandparent].right = sibling;
+    refit(grandparent);
+}
+
+// Balances and recomputes node and each of its ancestors.
+void AABBTree::refit(int node)
+{
+    for(int index = node; index != -1; index = m_nodes[index].parent) {
+        index = balance(index);
+        Node& parent = m_nodes[index];
+        const Node& left = m_nodes[parent.left];
+        const Node& right = m_nodes[parent.right];
+        parent.height = 1 + std::max(left.height, right.height);
+        parent.box = combine(left.box, right.box);
+    }
+}
+
+int AABBTree::balance(int a)
+{
+    Node& node_a = m_nodes[a];
+    if(node_a.isLeaf() || node_a.height < 2)
+        return a;
+
+    int b = node_a.left;
+    int c = node_a.right;
+    Node& node_b = m_nodes[b];
+    Node& node_c = m_nodes[c];
+    int difference = node_c.height - node_b.height;
+    if(difference >= -1 && difference <= 1)
+        return a;
+
+    // Lift the taller child into a's place. a keeps the shorter child and the
+    // shorter of the lifted node's children, and becomes the lifted node's
+    // child in turn.
+    bool lift_right = difference > 1;
+    int up = lift_right ? c : b;
+    int stay = lift_right ? b : c;
+    Node& node_up = m_nodes[up];
+    Node& node_stay = m_nodes[stay];
+    int f = node_up.left;
+    int g = node_up.right;
+    if(m_nodes[f].height > m_nodes[g].height)
+        std::swap(f, g);
+    // g is now the taller of the two and stays with the lifted node.
+
+    node_up.left = a;
+    node_up.right = g;
+    node_up.parent = node_a.parent;
+    node_a.parent = up;
+    if(node_up.parent == -1)
+        m_root = up;
+    else if(m_nodes[node_up.parent].left == a)
+        m_nodes[node_up.parent].left = up;
+    else
+        m_nodes[node_up.parent].right = up;
+
+    if(lift_right)
+        node_a.right = f;
+    else
+        node_a.left = f;
+    m_nodes[f].parent = a;
+
+    node_a.box = combine(node_stay.box, m_nodes[f].box);
+    node_a.height = 1 + std::max(node_stay.height, m_nodes[f].height);
+    node_up.box = combine(node_a.box, m_nodes[g].box);
+    node_up.height = 1 + std::max(node_a.height, m_nodes[g].height);
+    return up;
+}
+
+void AABBTree::gather(int node) const
+{
+    const Node& n = m_nodes[node];
+    if(!n.isLeaf()) {
+        gather(n.left);
+        gather(n.right);
+        return;
+    }
+    glm::vec3 center = n.box.getCenter();
+    glm::vec3 extent = n.box.getExtent();
+    unsigned i = m_batch_count++;
+    m_batch[i] = node;
+    for(int j = 0; j < 3; ++j) {
+        m_batch_bounds[j][i] = center[j];
+        m_batch_bounds[j + 3][i] = extent[j];
+    }
+}
+
+void AABBTree::testBatch(const Frustum& frustum) const
+{
+    if(m_batch_count > 0)
+        frustum.intersects(m_batch_bounds[0].data(), m_batch_bounds[1].data(), m_batch_bounds[2].data(), m_batch_bounds[3].data(), m_batch_bounds[4].data(), m_batch_bounds[5].data(), m_batch_count, m_batch_visible.data());
+}
+
+void benchmarkAABBTree(unsigned count)
+{
+    typedef std::chrono::steady_clock clock;
+    auto elapsed = [](clock::time_point start) { return std::chrono::duration<float, std::milli>(clock::now() - start).count(); };
+
+    // Boxes between half a unit and two units across, spread through a cube
+    // sized to keep the density the same whatever the count.
+    std::mt19937 random(1);
+    float side = 10 * std::cbrt((float)count);
+    std::uniform_real_distribution<float> position(0, side);
+    std::uniform_real_distribution<float> size(0.25f, 1.0f);
+    std::uniform_real_distribution<float> speed(-5.0f, 5.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    std::vector<AABB> boxes(count);
+    std::vector<glm::vec3> velocities(count);
+    std::vector<int> proxies(count);
+    for(unsigned i = 0; i < count; ++i) {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 extent(size(random), size(random), size(random));
+        boxes[i] = { center - extent, center + extent };
+        velocities[i] = glm::vec3(speed(random), speed(random), speed(random));
+    }
+
+    const unsigned frames = 60, queries = 100;
+    const float step = 1.0f / 60;
+    printf("AABB tree, %u boxes\n", count);
+    printf("%-24s %12s %12s\n", "benchmark", "tree (ms)", "linear (ms)");
+
+    AABBTree tree;
+    clock::time_point start = clock::now();
+    for(unsigned i = 0; i < count; ++i)
+        proxies[i] = tree.insert(boxes[i], &boxes[i]);
+    printf("%-24s %12.3f %12s\n", "build", elapsed(start), "-");
+
+    unsigned reinserted = 0;
+    start = clock::now();
+    for(unsigned frame = 0; frame < frames; ++frame) {
+        for(unsigned i = 0; i < count; ++i) {
+            boxes[i].min += velocities[i] * step;
+            boxes[i].max += velocities[i] * step;
+            if(tree.move(proxies[i], boxes[i]))
+                ++reinserted;
+        }
+    }
+    printf("%-24s %12.3f %12s\n", "move (per frame)", elapsed(start) / frames, "-");
+
+    // The linear scans use the same SoA layout and batched test that the tree
+    // uses for its small subtrees.
+    std::vector<float> bounds[6];
+    for(auto& i : bounds)
+        i.resize(count);
+    for(unsigned i = 0; i < count; ++i) {
+        glm::vec3 center = boxes[i].getCenter();
+        glm::vec3 extent = boxes[i].getExtent();
+        for(int j = 0; j < 3; ++j) {
+            bounds[j][i] = center[j];
+            bounds[j + 3][i] = extent[j];
+        }
+    }
+    std::vector<unsigned char> visible(count);
+
+    std::vector<Frustum> frustums;
+    std::vector<glm::vec3> origins, directions;
+    glm::vec3 middle(side / 2);
+    for(unsigned i = 0; i < queries; ++i) {
+        glm::vec3 direction = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0, 0, 0.001f));
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, side / 2);
+        frustums.push_back(Frustum(projection * glm::lookAt(middle, middle + direction, glm::vec3(0, 1, 0))));
+        origins.push_back(glm::vec3(position(random), position(random), position(random)));
+        directions.push_back(direction);
+    }
+
+    unsigned tree_hits = 0, linear_hits = 0;
+    start = clock::now();
+    for(auto& frustum : frustums)
+        tree.query(frustum, [&tree_hits](void*) { ++tree_hits; });
+    float tree_time = elapsed(start);
+    start = clock::now();
+    for(auto& frustum : frustums) {
+        frustum.intersects(bounds[0].data(), bounds[1].data(), bounds[2].data(), bounds[3].data(), bounds[4].data(), bounds[5].data(), count, visible.data());
+        for(auto i : visible)
+            linear_hits += i;
+    }
+    printf("%-24s %12.3f %12.3f\n", "frustum (per query)", tree_time / queries, elapsed(start) / queries);
+
+    start = clock::now();
+    for(unsigned i = 0; i < queries; ++i)
+        tree.raycast(origins[i], directions[i], side, [&tree_hits](void*, float) { ++tree_hits; });
+    tree_time = elapsed(start);
+    start = clock::now();
+    for(unsigned i = 0; i < queries; ++i) {
+        glm::vec3 inverse(1.0f / directions[i].x, 1.0f / directions[i].y, 1.0f / directions[i].z);
+        float distance;
+        for(auto& box : boxes)
+            linear_hits += intersectRay(box, origins[i], inverse, side, distance);
+    }
+    printf("%-24s %12.3f %12.3f\n", "ray (per query)", tree_time / queries, elapsed(start) / queries);
+
+    start = clock::now();
+    for(unsigned i = 0; i < queries; ++i)
+        tree.query(AABB{ origins[i] - glm::vec3(5), origins[i] + glm::vec3(5) }, [&tree_hits](void*) { ++tree_hits; });
+    tree_time = elapsed(start);
+    start = clock::now();
+    for(unsigned i = 0; i < queries; ++i) {
+        AABB query = { origins[i] - glm::vec3(5), origins[i] + glm::vec3(5) };
+        for(auto& box : boxes)
+            linear_hits += overlaps(box, query);
+    }
+    printf("%-24s %12.3f %12.3f\n", "box (per query)", tree_time / queries, elapsed(start) / queries);
+
+    // The tree reports a few more hits since it tests the fat boxes.
+    printf("height %d, %u reinserted over %u frames, %u tree hits, %u linear hits\n", tree.getHeight(), reinserted, frames, tree_hits, linear_hits);
+}
@@ -0,0 +1,206 @@
+#ifndef AABB_TREE_H
+#define AABB_TREE_H
+#include "Frustum.h"
+#include <glm/vec3.hpp>
+#include <vector>
+
+// A dynamic bounding volume hierarchy. Leaves store a box padded by a margin,
+// so an object that moves a little stays in its leaf and only objects that
+// leave their padded box are reinserted. Insertion picks the sibling that
+// adds the least surface area and rotations keep the tree balanced, so moving
+// an object costs O(log n) at worst.
+//
+// Objects are referred to by proxies, which stay valid until they're removed.
+class AABBTree
+{
+public:
+    AABBTree(float margin = 0.1f) : m_margin(margin) {}
+    int insert(const AABB& box, void* data);
+    void remove(int proxy);
+    // Returns true if the object had to be reinserted.
+    bool move(int proxy, const AABB& box);
+    inline void* getData(int proxy) const { return m_nodes[proxy].data; }
+    inline const AABB& getFatBox(int proxy) const { return m_nodes[proxy].box; }
+    inline unsigned getCount(void) const { return m_count; }
+    int getHeight(void) const;
+
+    // The callbacks are called with each leaf's data.
+    template<typename F> void query(const AABB& box, F callback) const;
+    // Subtrees entirely inside the frustum are reported without testing their
+    // leaves. Small subtrees that straddle it aren't walked; their leaves are
+    // gathered and tested four at a time once the walk is done.
+    template<typename F> void query(const Frustum& frustum, F callback) const;
+    // Also passes the distance along the ray to where it enters the leaf's box.
+    // direction should be normalised.
+    template<typename F> void raycast(const glm::vec3& origin, const glm::vec3& direction, float max_distance, F callback) const;
+private:
+    struct Node
+    {
+        AABB box;
+        void* data;
+        // Doubles as the next link while the node is on the free list.
+        int parent;
+        int left;
+        int right;
+        // Leaves are 0, free nodes -1.
+        int height;
+
+        inline bool isLeaf(void) const { return left == -1; }
+    };
+
+    int allocate(void);
+    void release(int node);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    // Rotates the subtree at a up a level if it's unbalanced and returns the
+    // index of the subtree's new root.
+    int balance(int a);
+    void refit(int node);
+    template<typename F> void report(int node, F& callback) const;
+    // Adds the leaves below node to the batch for the frustum query.
+    void gather(int node) const;
+    // Fills m_batch_visible for the gathered leaves.
+    void testBatch(const Frustum& frustum) const;
+
+    // Subtrees this tall or shorter hold few enough leaves that testing them
+    // all in one batch beats classifying every node on the way down.
+    static const int BATCH_HEIGHT = 2;
+
+    std::vector<Node> m_nodes;
+    int m_root = -1;
+    int m_free = -1;
+    unsigned m_count = 0;
+    float m_margin;
+    mutable std::vector<int> m_stack;
+    // Leaf indices and their fat boxes' centres and extents, as flat arrays
+    // sized for every leaf so gathering doesn't have to grow them.
+    mutable std::vector<int> m_batch;
+    mutable std::vector<float> m_batch_bounds[6];
+    mutable std::vector<unsigned char> m_batch_visible;
+    mutable unsigned m_batch_count = 0;
+};
+
+inline bool overlaps(const AABB& a, const AABB& b)
+{
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+        a.min.y <= b.max.y && a.max.y >= b.min.y &&
+        a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+// Slab test. inverse is 1 / direction, which handles axis aligned rays as long
+// as infinities are IEEE.
+inline bool intersectRay(const AABB& box, const glm::vec3& origin, const glm::vec3& inverse, float max_distance, float& distance)
+{
+    float first = 0, last = max_distance;
+    for(int i = 0; i < 3; ++i) {
+        float t0 = (box.min[i] - origin[i]) * inverse[i];
+        float t1 = (box.max[i] - origin[i]) * inverse[i];
+        if(t0 > t1) {
+            float t = t0;
+            t0 = t1;
+            t1 = t;
+        }
+        first = t0 > first ? t0 : first;
+        last = t1 < last ? t1 : last;
+        if(first > last)
+            return false;
+    }
+    distance = first;
+    return true;
+}
+
+template<typename F> void AABBTree::query(const AABB& box, F callback) const
+{
+    if(m_root == -1)
+        return;
+    m_stack.clear();
+    m_stack.push_back(m_root);
+    while(!m_stack.empty()) {
+        const Node& node = m_nodes[m_stack.back()];
+        m_stack.pop_back();
+        if(!overlaps(node.box, box))
+            continue;
+        if(node.isLeaf()) {
+            callback(node.data);
+        } else {
+            m_stack.push_back(node.left);
+            m_stack.push_back(node.right);
+        }
+    }
+}
+
+template<typename F> void AABBTree::query(const Frustum& frustum, F callback) const
+{
+    if(m_root == -1)
+        return;
+    m_batch_count = 0;
+    if(m_batch.size() < m_count) {
+        m_batch.resize(m_count);
+        for(auto& i : m_batch_bounds)
+            i.resize(m_count);
+        m_batch_visible.resize(m_count);
+    }
+    m_stack.clear();
+    m_stack.push_back(m_root);
+    while(!m_stack.empty()) {
+        int index = m_stack.back();
+        const Node& node = m_nodes[index];
+        m_stack.pop_back();
+        Frustum::Containment containment = frustum.classify(node.box);
+        if(containment == Frustum::OUTSIDE)
+            continue;
+        if(containment == Frustum::INSIDE) {
+            report(index, callback);
+        } else if(node.height <= BATCH_HEIGHT) {
+            gather(index);
+        } else {
+            m_stack.push_back(node.left);
+            m_stack.push_back(node.right);
+        }
+    }
+
+    testBatch(frustum);
+    for(unsigned i = 0; i < m_batch_count; ++i)
+        if(m_batch_visible[i])
+            callback(m_nodes[m_batch[i]].data);
+}
+
+template<typename F> void AABBTree::raycast(const glm::vec3& origin, const glm::vec3& direction, float max_distance, F callback) const
+{
+    if(m_root == -1)
+        return;
+    glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    m_stack.clear();
+    m_stack.push_back(m_root);
+    while(!m_stack.empty()) {
+        const Node& node = m_nodes[m_stack.back()];
+        m_stack.pop_back();
+        float distance;
+        if(!intersectRay(node.box, origin, inverse, max_distance, distance))
+            continue;
+        if(node.isLeaf()) {
+            callback(node.data, distance);
+        } else {
+            m_stack.push_back(node.left);
+            m_stack.push_back(node.right);
+        }
+    }
+}
+
+// Reports every leaf below node. Recursive since the caller's stack is still
+// in use, which is fine while the tree stays balanced.
+template<typename F> void AABBTree::report(int node, F& callback) const
+{
+    if(m_nodes[node].isLeaf()) {
+        callback(m_nodes[node].data);
+        return;
+    }
+    report(m_nodes[node].left, callback);
+    report(m_nodes[node].right, callback);
+}
+
+// Times building, refitting and querying a tree of count randomly placed
+// boxes against linear scans over the same boxes, and prints the results.
+void benchmarkAABBTree(unsigned count);
+
+#endif
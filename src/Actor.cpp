@@ -7,6 +7,8 @@
 #include "EventSystem.h"
 #include "Game.h"
 #include "ResourceManager.h"
+#include "ScriptMath.h"
+#include "ScriptSystem.h"
 #include "TweenSystem.h"
 #include "Util.h"
 #include <glm/gtc/matrix_transform.hpp>
@@ -163,19 +165,41 @@ void Actor::update(float delta_time)
     for(auto i : m_updating_components)
         i->update(delta_time);
 
+    if(m_collisions.empty())
+        return;
+
+    bool batched = false;
+    for(auto j : m_scripts)
+        batched |= j->hasHook(HOOK_COLLISIONS);
+    std::vector<CollisionRecord> records;
+
     for(auto i = m_collisions.begin(); i != m_collisions.end();) {
+        ActorCollision& collision = i->second;
         for(auto j : m_scripts) {
-            j->processCollision(i->second, i->first);
-            if(i->second == 1)
-                j->processCollision(2, i->first);
+            if(j->hasHook(HOOK_COLLISIONS))
+                continue;
+            j->processCollision(collision.phase, i->first);
+            if(collision.phase == COLLISION_ENTER)
+                j->processCollision(COLLISION_STAY, i->first);
         }
-        if(i->second == 1 || i->second == 2) {
-            i->second = 3;
+        if(batched) {
+            Actor* other = g_game->actors()->getActor(i->first);
+            if(other && other->getAlive())
+                records.push_back({other, collision.phase, collision.point, collision.impulse});
+        }
+        if(collision.phase == COLLISION_ENTER || collision.phase == COLLISION_STAY) {
+            collision.phase = COLLISION_LEAVE;
+            collision.impulse = 0;
             ++i;
         } else {
             i = m_collisions.erase(i);
         }
     }
+
+    if(!records.empty())
+        for(auto j : m_scripts)
+            if(j->hasHook(HOOK_COLLISIONS))
+                j->processCollisions(records);
 }
 
 bool Actor::getAlive(void) const
@@ -206,15 +230,21 @@ unsigned long Actor::getID(void) const
     return m_id;
 }
 
-void Actor::addCollision(unsigned long other_id)
+void Actor::addCollision(unsigned long other_id, const glm::vec3& point, float impulse)
 {
     if(m_static)
         return;
     auto a = m_collisions.find(other_id);
     if(a == m_collisions.end()) {
-        m_collisions[other_id] = 1;
+        m_collisions[other_id] = {COLLISION_ENTER, point, impulse};
     } else {
-        a->second = 2;
+        // Enter sticks until the next update, even if later substeps touch again.
+        if(a->second.phase != COLLISION_ENTER)
+            a->second.phase = COLLISION_STAY;
+        if(impulse >= a->second.impulse) {
+            a->second.point = point;
+            a->second.impulse = impulse;
+        }
     }
 }
 
@@ -230,9 +260,12 @@ void Actor::_destroy(void)
 
     ActorDestroyedEvent destroyed_ev(m_id);
     g_game->events()->callEvent(destroyed_ev);
+    g_game->scripts()->releaseProxy(this);
+    g_game->scripts()->releaseProxy(m_transform);
     auto it = m_components.begin();
     while(it != m_components.end()) {
         IComponent* c = *it;
+        g_game->scripts()->releaseProxy(c);
         c->destroy();
         delete c;
         it = m_components.erase(it);
@@ -266,22 +299,93 @@ void Actor::initTransform(lua_State* state)
     updateTransform();
 }
 
+static int actor_sync_transform(lua_State* state)
+{
+    static_cast<Actor*>(lua_touserdata(state, 1))->updateTransform();
+    return 0;
+}
+
+static int actor_add_force(lua_State* state)
+{
+    Actor* actor = static_cast<Actor*>(lua_touserdata(state, 1));
+    actor->addForce(btVector3(lua_tonumber(state, 2), lua_tonumber(state, 3), lua_tonumber(state, 4)), btVector3(lua_tonumber(state, 5), lua_tonumber(state, 6), lua_tonumber(state, 7)));
+    return 0;
+}
+
+// The relative flag comes last in each of these.
+static int actor_deferred_translate(lua_State* state)
+{
+    Actor* actor = static_cast<Actor*>(lua_touserdata(state, 1));
+    actor->getTransform()->translate(glm::vec3(lua_tonumber(state, 2), lua_tonumber(state, 3), lua_tonumber(state, 4)), lua_tonumber(state, 5) != 0);
+    actor->updateTransform();
+    return 0;
+}
+
+static int actor_deferred_rotate(lua_State* state)
+{
+    Actor* actor = static_cast<Actor*>(lua_touserdata(state, 1));
+    actor->getTransform()->rotate(glm::vec3(lua_tonumber(state, 2), lua_tonumber(state, 3), lua_tonumber(state, 4)), lua_tonumber(state, 5) != 0);
+    actor->updateTransform();
+    return 0;
+}
+
+static int actor_deferred_orient(lua_State* state)
+{
+    Actor* actor = static_cast<Actor*>(lua_touserdata(state, 1));
+    actor->getTransform()->rotate(glm::quat(lua_tonumber(state, 2), lua_tonumber(state, 3), lua_tonumber(state, 4), lua_tonumber(state, 5)), lua_tonumber(state, 6) != 0);
+    actor->updateTransform();
+    return 0;
+}
+
+static int actor_deferred_scale(lua_State* state)
+{
+    Actor* actor = static_cast<Actor*>(lua_touserdata(state, 1));
+    actor->getTransform()->scale(glm::vec3(lua_tonumber(state, 2), lua_tonumber(state, 3), lua_tonumber(state, 4)), lua_tonumber(state, 5) != 0);
+    actor->updateTransform();
+    return 0;
+}
+
+static int actor_deferred_destroy(lua_State* state)
+{
+    static_cast<Actor*>(lua_touserdata(state, 1))->destroy();
+    return 0;
+}
+
+// Syncing a rigid body updates the shared physics world, so isolated scripts
+// only change the transform and leave the sync to the main thread.
+static void syncTransform(lua_State* state, Actor* actor)
+{
+    if(!g_game->scripts()->deferObjectCall(state, actor_sync_transform, actor))
+        actor->updateTransform();
+}
+
+// Whether the actor belongs to a different isolated script than the caller.
+// Another worker may be updating it, so every change to it is deferred.
+static bool isForeign(lua_State* state, Actor* actor)
+{
+    void* owner = g_game->scripts()->getIsolatedOwner(state);
+    return owner && owner != actor;
+}
+
 int actor_translate(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to translate, but the Actor is missing its instance!");
 
     Actor* actor = *static_cast<Actor**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
 
-    glm::vec3 translation(lua_tonumber(state, 2), lua_tonumber(state, 3), lua_tonumber(state, 4));
-    bool relative = false;
-    if(lua_gettop(state) >= 5)
-        relative = lua_toboolean(state, 5);
+    glm::vec3 translation;
+    int next = readVec3Args(state, 2, translation);
+    bool relative = lua_toboolean(state, next);
 
+    if(isForeign(state, actor)) {
+        g_game->scripts()->deferObjectCall(state, actor_deferred_translate, actor, { translation.x, translation.y, translation.z, (lua_Number)relative });
+        return 0;
+    }
     actor->getTransform()->translate(translation, relative);
-    actor->updateTransform();
+    syncTransform(state, actor);
 
     return 0;
 }
@@ -289,19 +393,30 @@ int actor_translate(lua_State* state)
 int actor_rotate(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to rotate, but the Actor is missing its instance!");
 
     Actor* actor = *static_cast<Actor**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
 
-    glm::vec3 rotation(lua_tonumber(state, 2), lua_tonumber(state, 3), lua_tonumber(state, 4));
-    bool relative = false;
-    if(lua_gettop(state) >= 5)
-        relative = lua_toboolean(state, 5);
-
-    actor->getTransform()->rotate(rotation, relative);
-    actor->updateTransform();
+    bool foreign = isForeign(state, actor);
+    if(glm::quat* rotation = testQuat(state, 2)) {
+        bool relative = lua_toboolean(state, 3);
+        if(foreign)
+            g_game->scripts()->deferObjectCall(state, actor_deferred_orient, actor, { rotation->w, rotation->x, rotation->y, rotation->z, (lua_Number)relative });
+        else
+            actor->getTransform()->rotate(*rotation, relative);
+    } else {
+        glm::vec3 rotation;
+        int next = readVec3Args(state, 2, rotation);
+        bool relative = lua_toboolean(state, next);
+        if(foreign)
+            g_game->scripts()->deferObjectCall(state, actor_deferred_rotate, actor, { rotation.x, rotation.y, rotation.z, (lua_Number)relative });
+        else
+            actor->getTransform()->rotate(rotation, relative);
+    }
+    if(!foreign)
+        syncTransform(state, actor);
 
     return 0;
 }
@@ -309,18 +424,21 @@ int actor_rotate(lua_State* state)
 int actor_scale(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to scale, but the Actor is missing its instance!");
 
     Actor* actor = *static_cast<Actor**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
-    glm::vec3 scale(lua_tonumber(state, 2), lua_tonumber(state, 3), lua_tonumber(state, 4));
-    bool relative = false;
-    if(lua_gettop(state) >= 5)
-        relative = lua_toboolean(state, 5);
+    glm::vec3 scale;
+    int next = readVec3Args(state, 2, scale);
+    bool relative = lua_toboolean(state, next);
 
+    if(isForeign(state, actor)) {
+        g_game->scripts()->deferObjectCall(state, actor_deferred_scale, actor, { scale.x, scale.y, scale.z, (lua_Number)relative });
+        return 0;
+    }
     actor->getTransform()->scale(scale, relative);
-    actor->updateTransform();
+    syncTransform(state, actor);
 
     return 0;
 }
@@ -328,11 +446,14 @@ int actor_scale(lua_State* state)
 int actor_destroy(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to destroy, but the Actor is missing its instance!");
 
     Actor* actor = *static_cast<Actor**>(lua_touserdata(state, -1));
-    actor->destroy();
+    if(isForeign(state, actor))
+        g_game->scripts()->deferObjectCall(state, actor_deferred_destroy, actor);
+    else
+        actor->destroy();
 
     lua_pop(state, 1);
 
@@ -342,16 +463,19 @@ int actor_destroy(lua_State* state)
 int actor_apply_force(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to apply a force, but the Actor is missing its instance!");
     Actor* actor = *static_cast<Actor**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
 
-    btVector3 rel(0, 0, 0);
-    if(lua_gettop(state) >= 7)
-        rel = btVector3(lua_tonumber(state, 5), lua_tonumber(state, 6), lua_tonumber(state, 7));
+    glm::vec3 force;
+    glm::vec3 rel(0.0f);
+    int next = readVec3Args(state, 2, force);
+    if(lua_gettop(state) >= next)
+        readVec3Args(state, next, rel);
 
-    actor->addForce(btVector3(lua_tonumber(state, 2), lua_tonumber(state, 3), lua_tonumber(state, 4)), rel);
+    if(!g_game->scripts()->deferObjectCall(state, actor_add_force, actor, { force.x, force.y, force.z, rel.x, rel.y, rel.z }))
+        actor->addForce(btVector3(force.x, force.y, force.z), btVector3(rel.x, rel.y, rel.z));
 
     return 0;
 }
@@ -359,7 +483,7 @@ int actor_apply_force(lua_State* state)
 int actor_get_component(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to get a component, but the Actor is missing its instance!");
     Actor* actor = *static_cast<Actor**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -371,60 +495,7 @@ int actor_get_component(lua_State* state)
         return 0;
     }
 
-    lua_newtable(state);
-    luaL_setfuncs(state, it->second->getFuncs(), 0);
-    IComponent** cmpdat = static_cast<IComponent**>(lua_newuserdata(state, sizeof(IComponent*)));
-    *cmpdat = it->second;
-    lua_setfield(state, -2, "instance");
-    lua_newtable(state);
-    luaL_setfuncs(state, it->second->getMetaFuncs(), 0);
-    lua_setmetatable(state, -2);
-
-    return 1;
-}
-
-int actor_transform(lua_State* state)
-{
-    lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
-        return luaL_error(state, "Trying to get a component, but the Actor is missing its instance!");
-    Actor* actor = *static_cast<Actor**>(lua_touserdata(state, -1));
-    lua_pop(state, 1);
-
-    // TODO: Get transform here
-    Transform* transform = actor->getTransform();
-    glm::vec3 position = transform->getPosition();
-    glm::vec3 rotation = transform->getERotation();
-    glm::vec3 scale = transform->getScaling();
-    
-    lua_newtable(state);
-
-    lua_newtable(state);
-    lua_pushnumber(state, position.x);
-    lua_setfield(state, -2, "x");
-    lua_pushnumber(state, position.y);
-    lua_setfield(state, -2, "y");
-    lua_pushnumber(state, position.z);
-    lua_setfield(state, -2, "z");
-    lua_setfield(state, -2, "position");
-
-    lua_newtable(state);
-    lua_pushnumber(state, rotation.x);
-    lua_setfield(state, -2, "x");
-    lua_pushnumber(state, rotation.y);
-    lua_setfield(state, -2, "y");
-    lua_pushnumber(state, rotation.z);
-    lua_setfield(state, -2, "z");
-    lua_setfield(state, -2, "rotation");
-
-    lua_newtable(state);
-    lua_pushnumber(state, scale.x);
-    lua_setfield(state, -2, "x");
-    lua_pushnumber(state, scale.y);
-    lua_setfield(state, -2, "y");
-    lua_pushnumber(state, scale.z);
-    lua_setfield(state, -2, "z");
-    lua_setfield(state, -2, "scale");
+    pushProxy(state, it->second, it->second->getFuncs(), it->second->getMetaFuncs(), it->second->getProperties());
 
     return 1;
 }
@@ -432,7 +503,7 @@ int actor_transform(lua_State* state)
 int actor_register_tween(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to register a tween, but the Actor is missing its instance!");
     Actor* actor = *static_cast<Actor**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -533,13 +604,7 @@ int actor_register_tween(lua_State* state)
     tween->transitions[tween->transitions.size() - 1].end_value = tween->end_value;
     tween->transitions[tween->transitions.size() - 1].end = 1;
 
-    lua_newtable(state);
-    Tween** dat = static_cast<Tween**>(lua_newuserdata(state, sizeof(Tween*)));
-    *dat = tween;
-    lua_setfield(state, -2, "instance");
-    lua_newtable(state);
-    luaL_setfuncs(state, tweenMeta, 0);
-    lua_setmetatable(state, -2);
+    pushTween(state, tween);
 
     g_game->tweens()->tween_map[actor_id].push_back(tween);
     g_game->tweens()->tweens.insert(tween);
@@ -551,38 +616,34 @@ int actor_get_tween(lua_State* state)
     return 1;
 }
 
-int actor_index(lua_State* state)
+int actor_transform(lua_State* state)
 {
-    lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
-        return luaL_error(state, "Trying to access data, but the Actor is missing its instance!");
-    Actor* actor = *static_cast<Actor**>(lua_touserdata(state, -1));
-    lua_pop(state, 1);
-
-    if(!strcmp(lua_tostring(state, 2), "transform")) {
-        lua_newtable(state);
-        Transform** t = static_cast<Transform**>(lua_newuserdata(state, sizeof(Transform*)));
-        *t = actor->getTransform();
-        lua_setfield(state, -2, "instance");
-        lua_newtable(state);
-        luaL_setfuncs(state, transform_meta, 0);
-        lua_setmetatable(state, -2);
-    } else
-        return 0;
+    Actor* actor = toInstance<Actor>(state, 1);
+    pushProxy(state, actor->getTransform(), transform_funcs, transform_meta, transform_props);
     return 1;
 }
 
-int actor_newindex(lua_State* state)
+int actor_set_transform(lua_State* state)
 {
-    lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
-        return luaL_error(state, "Trying to access data, but the Actor is missing its instance!");
-    Actor* actor = *static_cast<Actor**>(lua_touserdata(state, -1));
-    lua_pop(state, 1);
+    Actor* actor = toInstance<Actor>(state, 1);
+    actor->m_transform->setWorldTransform(state);
+    return 0;
+}
 
-    if(!strcmp(lua_tostring(state, 2), "transform")) {
-        lua_settop(state, 3);
-        actor->m_transform->setWorldTransform(state);
-    }
+int actor_newindex(lua_State* state)
+{
+    lua_rawset(state, 1);
     return 0;
 }
+
+// Isolated scripts can't get at other actors' transforms, since another
+// worker may be moving them.
+void pushActorProxy(lua_State* state, Actor* actor)
+{
+    if(state == g_game->scripts()->getState())
+        pushProxy(state, actor, actor_funcs, actor_meta, actor_props);
+    else if(g_game->scripts()->getIsolatedOwner(state) == actor)
+        pushProxy(state, actor, isolated_actor_funcs, actor_meta, actor_props);
+    else
+        pushProxy(state, actor, isolated_actor_funcs, actor_meta);
+}
@@ -3,14 +3,9 @@
 
 #include "ActorSystem.h"
 #include "Component.h"
+#include "LuaCompat.h"
 #include "Transform.h"
 #include "XmlSerializable.h"
-
-extern "C"
-{
-#include <lua.h>
-#include <lauxlib.h>
-}
 #include <rapidxml.hpp>
 #include <set>
 #include <unordered_map>
@@ -20,6 +15,22 @@ class ActorConstructionData;
 class IComponent;
 class CScript;
 
+enum CollisionPhase
+{
+    COLLISION_ENTER = 1,
+    COLLISION_STAY,
+    COLLISION_LEAVE,
+};
+
+// Phase is COLLISION_ENTER, COLLISION_STAY or COLLISION_LEAVE. The point and
+// impulse are from the strongest contact seen since the last update.
+struct ActorCollision
+{
+    char phase;
+    glm::vec3 point;
+    float impulse;
+};
+
 class Actor
 {
 public:
@@ -36,7 +47,7 @@ public:
     void updateTransform(void);
     unsigned long getID(void) const;
     inline void destroy(void) { m_alive = false; }
-    void addCollision(unsigned long other_id);
+    void addCollision(unsigned long other_id, const glm::vec3& point, float impulse);
     void addForce(btVector3 force, btVector3 vec);
     void initTransform(lua_State* state);
     bool isStatic(void) const { return m_static; }
@@ -46,7 +57,7 @@ public:
 
     friend class ActorSystem;
     friend int actor_get_component(lua_State* state);
-    friend int actor_newindex(lua_State* state);
+    friend int actor_set_transform(lua_State* state);
 protected:
     std::string m_type;
     std::set<IComponent*> m_components;
@@ -54,7 +65,7 @@ protected:
     std::set<CScript*> m_scripts;
     std::unordered_map<std::string, IComponent*> m_named_components;
     //std::map<ComponentID, IComponent*> m_components;
-    std::unordered_map<unsigned long, char> m_collisions;
+    std::unordered_map<unsigned long, ActorCollision> m_collisions;
     unsigned long m_id;
     bool m_alive;
     bool m_static = false;
@@ -108,11 +119,11 @@ int actor_scale(lua_State* state);
 int actor_destroy(lua_State* state);
 int actor_apply_force(lua_State* state); // TODO: Move this to CRigidbody
 int actor_get_component(lua_State* state);
-int actor_transform(lua_State* state);
 int actor_register_tween(lua_State* state);
 int actor_get_tween_value(lua_State* state);
 int actor_get_tween(lua_State* state);
-int actor_index(lua_State* state);
+int actor_transform(lua_State* state);
+int actor_set_transform(lua_State* state);
 int actor_newindex(lua_State* state);
 
 const luaL_Reg actor_funcs[] =
@@ -122,17 +133,38 @@ const luaL_Reg actor_funcs[] =
     {"scale", actor_scale},
     {"apply_force", actor_apply_force},
     {"get_component", actor_get_component},
-    {"transform", actor_transform},
     {"destroy", actor_destroy},
     {"register_tween", actor_register_tween},
     {0, 0}
 };
 
+// The subset of actor_funcs for isolated scripts on worker threads. Changes to
+// the script's own actor apply right away, but syncing them with the physics
+// world and applying forces are deferred to the main thread. Every change to
+// another actor is deferred.
+const luaL_Reg isolated_actor_funcs[] =
+{
+    {"translate", actor_translate},
+    {"rotate", actor_rotate},
+    {"scale", actor_scale},
+    {"apply_force", actor_apply_force},
+    {"destroy", actor_destroy},
+    {0, 0}
+};
+
+const ScriptProperty actor_props[] =
+{
+    {"transform", actor_transform, actor_set_transform},
+    {0, 0, 0}
+};
+
+// Keys that aren't properties are stored on the proxy itself.
 const luaL_Reg actor_meta[] =
 {
-    {"__index", actor_index},
     {"__newindex", actor_newindex},
     {0, 0}
 };
 
+void pushActorProxy(lua_State* state, Actor* actor);
+
 #endif
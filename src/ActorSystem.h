@@ -1,10 +1,7 @@
 #ifndef ACTOR_SYSTEM_H
 #define ACTOR_SYSTEM_H
+#include "LuaCompat.h"
 #include "System.h"
-extern "C" {
-#include <lua.h>
-#include <lauxlib.h>
-}
 #include <map>
 #include <set>
 #include <vector>
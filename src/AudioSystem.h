@@ -1,15 +1,11 @@
 #ifndef AUDIO_SYSTEM_H
 #define AUDIO_SYSTEM_H
 
+#include "LuaCompat.h"
 #include "System.h"
 
 #include <AL/al.h>
 #include <AL/alc.h>
-extern "C"
-{
-#include <lua.h>
-#include <lauxlib.h>
-}
 
 class Level;
 
@@ -5,6 +5,7 @@
 #include "Game.h"
 #include "Model.h"
 #include "SceneNode.h"
+#include "ScriptSystem.h"
 #include "Shader.h"
 #include "Util.h"
 
@@ -90,6 +91,7 @@ void CGraphics::init(void)
 
 void CGraphics::destroy(void)
 {
+    g_game->scripts()->releaseProxy(m_node->getLocalTransform());
     delete m_node;
 }
 
@@ -147,7 +149,7 @@ unsigned long CGraphicsCreatedEvent::getId(void) const
 int ccamera_lookat(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to set lookat target, but the Camera Component is missing its instance!");
     CCamera* cam = *static_cast<CCamera**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -158,90 +160,3 @@ int ccamera_lookat(lua_State* state)
         return 0; // TODO: Error here
     return 0;
 }
-
-int cgraphics_Index(lua_State* state)
-{
-    lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
-        return luaL_error(state, "The Graphics Component is missing its instance!");
-    CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
-    lua_pop(state, 1);
-
-    if(!strcmp(lua_tostring(state, 2), "transform")) {
-        lua_newtable(state);
-        Transform** t = static_cast<Transform**>(lua_newuserdata(state, sizeof(Transform*)));
-        *t = gfx->getNode()->getLocalTransform();
-        lua_setfield(state, -2, "instance");
-        lua_newtable(state);
-        luaL_setfuncs(state, transform_meta, 0);
-        lua_setmetatable(state, -2);
-        return 1;
-    } else {
-        const luaL_Reg* funcs = gfx->getAttrFuncs();
-        for(unsigned i = 0; funcs[i].name != 0; ++i) {
-            if(!strcmp(lua_tostring(state, 2), funcs[i].name)) {
-                lua_settop(state, 1);
-                return funcs[i].func(state);
-            }
-        }
-    }
-
-    return 0;
-}
-
-int cgraphics_NewIndex(lua_State* state)
-{
-    lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
-        return luaL_error(state, "The Graphics Component is missing its instance!");
-    CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
-    lua_pop(state, 1);
-
-    const luaL_Reg* funcs = gfx->getAttrFuncs();
-    for(unsigned i = 0; funcs[i].name != 0; ++i) {
-        if(!strcmp(lua_tostring(state, 2), funcs[i].name)) {
-            lua_replace(state, 2);
-            return funcs[i].func(state);
-        }
-    }
-
-    return 0;
-}
-
-int ccamera_Index(lua_State* state)
-{
-    lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
-        return luaL_error(state, "The Graphics Component is missing its instance!");
-    CCamera* gfx = *static_cast<CCamera**>(lua_touserdata(state, -1));
-    lua_pop(state, 1);
-
-    const luaL_Reg* funcs = gfx->getAttrFuncs();
-    for(unsigned i = 0; funcs[i].name != 0; ++i) {
-        if(!strcmp(lua_tostring(state, 2), funcs[i].name)) {
-            lua_settop(state, 1);
-            return funcs[i].func(state);
-        }
-    }
-
-    return 0;
-}
-
-int ccamera_NewIndex(lua_State* state)
-{
-    lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
-        return luaL_error(state, "The Graphics Component is missing its instance!");
-    CCamera* gfx = *static_cast<CCamera**>(lua_touserdata(state, -1));
-    lua_pop(state, 1);
-
-    const luaL_Reg* funcs = gfx->getAttrFuncs();
-    for(unsigned i = 0; funcs[i].name != 0; ++i) {
-        if(!strcmp(lua_tostring(state, 2), funcs[i].name)) {
-            lua_replace(state, 2);
-            return funcs[i].func(state);
-        }
-    }
-
-    return 0;
-}
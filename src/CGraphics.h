@@ -15,10 +15,6 @@ IComponent* buildGraphics(rapidxml::xml_node<>* node, Actor* actor);
 IComponent* buildCamera(rapidxml::xml_node<>* node, Actor* actor);
 
 int ccamera_lookat(lua_State* state);
-int ccamera_Index(lua_State* state);
-int ccamera_NewIndex(lua_State* state);
-int cgraphics_Index(lua_State* state);
-int cgraphics_NewIndex(lua_State* state);
 
 const luaL_Reg ccamera_funcs[] =
 {
@@ -26,17 +22,15 @@ const luaL_Reg ccamera_funcs[] =
     {0, 0}
 };
 
+// Fields are dispatched through the scene node's attributes, see
+// getProperties.
 const luaL_Reg ccamera_meta[] =
 {
-    {"__index", ccamera_Index},
-    {"__newindex", ccamera_NewIndex},
     {0, 0}
 };
 
 const luaL_Reg cgraphics_meta[] =
 {
-    {"__index", cgraphics_Index},
-    {"__newindex", cgraphics_NewIndex},
     {0, 0}
 };
 
@@ -49,7 +43,7 @@ public:
     virtual ComponentID getID(void);
     virtual const luaL_Reg* getFuncs(void) const { return m_node->getFuncs(); }
     virtual const luaL_Reg* getMetaFuncs(void) const { return cgraphics_meta; }
-    virtual const luaL_Reg* getAttrFuncs(void) const { return m_node->getAttrFuncs(); }
+    virtual const ScriptProperty* getProperties(void) const { return m_node->getAttrFuncs(); }
     ISceneNode* getNode(void) { return m_node; }
     virtual bool get_has_update(void) const { return m_updates; }
 
@@ -68,7 +62,7 @@ public:
     virtual ComponentID getID(void);
     virtual const luaL_Reg* getFuncs(void) const { return ccamera_funcs; }
     virtual const luaL_Reg* getMetaFuncs(void) const { return ccamera_meta; }
-    virtual const luaL_Reg* getAttrFuncs(void) const { return m_node->getAttrFuncs(); }
+    virtual const ScriptProperty* getProperties(void) const { return m_node->getAttrFuncs(); }
     virtual bool get_has_update(void) const { return false; }
 
     friend IComponent* buildCamera(rapidxml::xml_node<>* node, Actor* actor);
@@ -5,6 +5,7 @@
 #include "PhysicsMaterial.h"
 #include "PhysicsSystem.h"
 #include "ResourceManager.h"
+#include "ScriptMath.h"
 #include "Util.h"
 
 #include <algorithm>
@@ -192,6 +193,11 @@ void CRigidBody::init(void)
 
 void CRigidBody::destroy(void)
 {
+    if(m_script_state) {
+        g_game->physics()->removeScriptBody(this);
+        delete m_script_state;
+        m_script_state = NULL;
+    }
     delete m_body->getCollisionShape();
     delete m_body;
 }
@@ -221,79 +227,86 @@ ComponentID CRigidBody::getID(void)
     return CRIGIDBODY_ID;
 }
 
-int crigidbody_Index(lua_State* state)
+glm::vec3 CRigidBody::getVelocity(void) const
+{
+    const btVector3& vec = m_body->getLinearVelocity();
+    return glm::vec3(vec.x(), vec.y(), vec.z());
+}
+
+void CRigidBody::setVelocity(glm::vec3 velocity)
+{
+    m_body->setLinearVelocity(btVector3(velocity.x, velocity.y, velocity.z));
+}
+
+glm::vec3 CRigidBody::getAngularVelocity(void) const
+{
+    const btVector3& vec = m_body->getAngularVelocity();
+    return glm::vec3(vec.x(), vec.y(), vec.z());
+}
+
+void CRigidBody::setAngularVelocity(glm::vec3 velocity)
 {
-    lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
-        return luaL_error(state, "Trying to access data, but the Rigid Body Component is missing its instance!");
-    CRigidBody* body = *static_cast<CRigidBody**>(lua_touserdata(state, -1));
-    lua_pop(state, 1);
-
-    if(!strcmp(lua_tostring(state, 2), "velocity")) {
-        btVector3 vec = body->m_body->getLinearVelocity();
-        lua_newtable(state);
-        lua_pushnumber(state, vec.x());
-        lua_setfield(state, -2, "x");
-        lua_pushnumber(state, vec.y());
-        lua_setfield(state, -2, "y");
-        lua_pushnumber(state, vec.z());
-        lua_setfield(state, -2, "z");
-    } else if(!strcmp(lua_tostring(state, 2), "angular_velocity")) {
-        btVector3 vec = body->m_body->getAngularVelocity();
-        lua_newtable(state);
-        lua_pushnumber(state, vec.x());
-        lua_setfield(state, -2, "x");
-        lua_pushnumber(state, vec.y());
-        lua_setfield(state, -2, "y");
-        lua_pushnumber(state, vec.z());
-        lua_setfield(state, -2, "z");
-    } else if(!strcmp(lua_tostring(state, 2), "collision_mask")) {
-        lua_pushinteger(state, body->m_body->getBroadphaseProxy()->m_collisionFilterMask);
-    } else if(!strcmp(lua_tostring(state, 2), "collision_group")) {
-        lua_pushinteger(state, body->m_body->getBroadphaseProxy()->m_collisionFilterGroup);
-    } else
-        return 0;
+    m_body->setAngularVelocity(btVector3(velocity.x, velocity.y, velocity.z));
+}
+
+int CRigidBody::getCollisionMask(void) const
+{
+    return m_body->getBroadphaseProxy()->m_collisionFilterMask;
+}
 
+void CRigidBody::setCollisionMask(int mask)
+{
+    m_body->getBroadphaseProxy()->m_collisionFilterMask = mask;
+}
+
+int CRigidBody::getCollisionGroup(void) const
+{
+    return m_body->getBroadphaseProxy()->m_collisionFilterGroup;
+}
+
+void CRigidBody::setCollisionGroup(int group)
+{
+    m_body->getBroadphaseProxy()->m_collisionFilterGroup = group;
+}
+
+RigidBodyState* CRigidBody::getScriptState(void)
+{
+    if(!m_script_state) {
+        m_script_state = new RigidBodyState();
+        pullScriptState();
+        g_game->physics()->addScriptBody(this);
+    }
+    return m_script_state;
+}
+
+void CRigidBody::pushScriptState(void)
+{
+    if(!m_script_state->dirty)
+        return;
+    setVelocity(m_script_state->velocity);
+    setAngularVelocity(m_script_state->angular_velocity);
+    m_body->activate();
+    m_script_state->dirty = 0;
+}
+
+void CRigidBody::pullScriptState(void)
+{
+    m_script_state->velocity = getVelocity();
+    m_script_state->angular_velocity = getAngularVelocity();
+}
+
+// Like the velocity fields, but fill in the vec3 passed to them if there is
+// one.
+int crigidbody_get_velocity(lua_State* state)
+{
+    CRigidBody* body = toInstance<CRigidBody>(state, 1);
+    returnVec3(state, 2, body->getVelocity());
     return 1;
 }
 
-int crigidbody_NewIndex(lua_State* state)
+int crigidbody_get_angular_velocity(lua_State* state)
 {
-    lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
-        return luaL_error(state, "Trying to access velocity, but the Rigid Body Component is missing its instance!");
-    CRigidBody* body = *static_cast<CRigidBody**>(lua_touserdata(state, -1));
-    lua_pop(state, 1);
-
-    if(!strcmp(lua_tostring(state, 2), "velocity")) {
-        btVector3 vec;
-        lua_getfield(state, 3, "x");
-        vec.setX(lua_tonumber(state, -1));
-        lua_pop(state, 1);
-        lua_getfield(state, 3, "y");
-        vec.setY(lua_tonumber(state, -1));
-        lua_pop(state, 1);
-        lua_getfield(state, 3, "z");
-        vec.setZ(lua_tonumber(state, -1));
-        lua_pop(state, 1);
-        body->m_body->setLinearVelocity(vec);
-    } else if(!strcmp(lua_tostring(state, 2), "angular_velocity")) {
-        btVector3 vec;
-        lua_getfield(state, 3, "x");
-        vec.setX(lua_tonumber(state, -1));
-        lua_pop(state, 1);
-        lua_getfield(state, 3, "y");
-        vec.setY(lua_tonumber(state, -1));
-        lua_pop(state, 1);
-        lua_getfield(state, 3, "z");
-        vec.setZ(lua_tonumber(state, -1));
-        lua_pop(state, 1);
-        body->m_body->setAngularVelocity(vec);
-    } else if(!strcmp(lua_tostring(state, 2), "collision_mask")) {
-        body->m_body->getBroadphaseProxy()->m_collisionFilterMask = lua_tointeger(state, 3);
-    } else if(!strcmp(lua_tostring(state, 2), "collision_group")) {
-        body->m_body->getBroadphaseProxy()->m_collisionFilterGroup = lua_tointeger(state, 3);
-    } else
-        warn("Trying to set a Rigidbody field that doesn't exist");
-    return 0;
+    CRigidBody* body = toInstance<CRigidBody>(state, 1);
+    returnVec3(state, 2, body->getAngularVelocity());
+    return 1;
 }
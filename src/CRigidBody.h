@@ -11,21 +11,31 @@ class Actor;
 
 IComponent* buildRigidBody(rapidxml::xml_node<>* node, Actor* actor);
 
-int crigidbody_Index(lua_State* state);
-int crigidbody_NewIndex(lua_State* state);
+int crigidbody_get_velocity(lua_State* state);
+int crigidbody_get_angular_velocity(lua_State* state);
 
 const luaL_Reg crigidbody_funcs[] =
 {
+    {"get_velocity", crigidbody_get_velocity},
+    {"get_angular_velocity", crigidbody_get_angular_velocity},
     {0, 0}
 };
 
 const luaL_Reg crigidbody_meta[] =
 {
-    {"__index", crigidbody_Index},
-    {"__newindex", crigidbody_NewIndex},
     {0, 0}
 };
 
+// Velocities mirrored for LuaJIT scripts, laid out to match df_rigidbody in
+// the script FFI definitions. The physics system refreshes it after every step
+// and applies it before the next one if dirty is set.
+struct RigidBodyState
+{
+    glm::vec3 velocity;
+    glm::vec3 angular_velocity;
+    int dirty = 0;
+};
+
 class CRigidBody : public IComponent
 {
 public:
@@ -38,18 +48,43 @@ public:
     virtual ComponentID getID(void);
     virtual const luaL_Reg* getFuncs(void) const { return crigidbody_funcs; }
     virtual const luaL_Reg* getMetaFuncs(void) const { return crigidbody_meta; }
+    virtual const ScriptProperty* getProperties(void) const;
     virtual bool get_has_update(void) const { return false; }
 
+    glm::vec3 getVelocity(void) const;
+    void setVelocity(glm::vec3 velocity);
+    glm::vec3 getAngularVelocity(void) const;
+    void setAngularVelocity(glm::vec3 velocity);
+    int getCollisionMask(void) const;
+    void setCollisionMask(int mask);
+    int getCollisionGroup(void) const;
+    void setCollisionGroup(int group);
+
+    // Creates the script state on first use and registers it for syncing.
+    RigidBodyState* getScriptState(void);
+    void pushScriptState(void);
+    void pullScriptState(void);
+
     friend IComponent* buildRigidBody(rapidxml::xml_node<>* node, Actor* actor);
-    friend int crigidbody_Index(lua_State* state);
-    friend int crigidbody_NewIndex(lua_State* state);
 protected:
     btRigidBody* m_body;
     btVector3 m_last_scale;
     int m_mask = -1;
     int m_group = -1;
+    RigidBodyState* m_script_state = NULL;
 };
 
+const ScriptProperty crigidbody_props[] =
+{
+    {"velocity", propertyGet<CRigidBody, glm::vec3, &CRigidBody::getVelocity>, propertySet<CRigidBody, glm::vec3, &CRigidBody::getVelocity, &CRigidBody::setVelocity>},
+    {"angular_velocity", propertyGet<CRigidBody, glm::vec3, &CRigidBody::getAngularVelocity>, propertySet<CRigidBody, glm::vec3, &CRigidBody::getAngularVelocity, &CRigidBody::setAngularVelocity>},
+    {"collision_mask", propertyGet<CRigidBody, int, &CRigidBody::getCollisionMask>, propertySet<CRigidBody, int, &CRigidBody::getCollisionMask, &CRigidBody::setCollisionMask>},
+    {"collision_group", propertyGet<CRigidBody, int, &CRigidBody::getCollisionGroup>, propertySet<CRigidBody, int, &CRigidBody::getCollisionGroup, &CRigidBody::setCollisionGroup>},
+    {0, 0, 0}
+};
+
+inline const ScriptProperty* CRigidBody::getProperties(void) const { return crigidbody_props; }
+
 class CRigidBodyCreatedEvent : public IEvent
 {
     public:
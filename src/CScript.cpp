@@ -1,134 +1,143 @@
 #include "Actor.h"
-#include "AudioSystem.h"
 #include "CScript.h"
 #include "Game.h"
-#include "InputSystem.h"
-#include "ResourceManager.h"
+#include "ScriptMath.h"
+#include "ScriptSystem.h"
 #include "Util.h"
 
 using namespace rapidxml;
 
-const char* collision_strs[] =
+const char* hook_names[HOOK_COUNT] =
 {
+    "init",
+    "update",
+    "update_batch",
+    "destroy",
     "collision_enter",
     "collision_tick",
     "collision_leave",
+    "on_collisions",
 };
 
 IComponent* buildScript(xml_node<>* node, Actor* actor)
 {
     CScript* component = new CScript();
-    component->m_state = luaL_newstate();
-    luaL_openlibs(component->m_state);
+    lua_State* state = g_game->scripts()->getState();
+    if(xml_attribute<>* attr = node->first_attribute("isolated", 8, false)) {
+        if(strcmp(attr->value(), "false")) {
+            xml_attribute<>* id = node->first_attribute("id");
+            if(lua_State* isolated_state = g_game->scripts()->newIsolatedState(actor, id ? id->value() : "")) {
+                state = isolated_state;
+                component->m_isolated = true;
+            }
+        }
+    }
+    component->u_state = state;
+    component->u_owner = actor;
+
+    g_game->scripts()->pushEnvironment(state);
     for(xml_node<>* in = node->first_node("int", 3, false); in; in = in->next_sibling("int", 3, 0))
         if(xml_attribute<>* na = in->first_attribute("name", 4, false))
             if(xml_attribute<>* va = in->first_attribute("value", 5, false)) {
-                lua_pushinteger(component->m_state, atoi(va->value()));
-                lua_setglobal(component->m_state, na->value());
+                lua_pushinteger(state, atoi(va->value()));
+                lua_setfield(state, -2, na->value());
             }
     for(xml_node<>* in = node->first_node("number", 6, false); in; in = in->next_sibling("number", 6, 0))
         if(xml_attribute<>* na = in->first_attribute("name", 4, false))
             if(xml_attribute<>* va = in->first_attribute("value", 5, false)) {
-                lua_pushnumber(component->m_state, atof(va->value()));
-                lua_setglobal(component->m_state, na->value());
+                lua_pushnumber(state, atof(va->value()));
+                lua_setfield(state, -2, na->value());
             }
     for(xml_node<>* in = node->first_node("string", 6, false); in; in = in->next_sibling("string", 6, 0))
         if(xml_attribute<>* na = in->first_attribute("name", 4, false))
             if(xml_attribute<>* va = in->first_attribute("value", 5, false)) {
-                lua_pushstring(component->m_state, va->value());
-                lua_setglobal(component->m_state, na->value());
+                lua_pushstring(state, va->value());
+                lua_setfield(state, -2, na->value());
             }
     for(xml_node<>* in = node->first_node("bool", 4, false); in; in = in->next_sibling("bool", 4, 0))
         if(xml_attribute<>* na = in->first_attribute("name", 4, false))
             if(xml_attribute<>* va = in->first_attribute("value", 5, false)) {
-                lua_pushboolean(component->m_state, strcmp(va->value(), "false"));
-                lua_setglobal(component->m_state, na->value());
+                lua_pushboolean(state, strcmp(va->value(), "false"));
+                lua_setfield(state, -2, na->value());
             }
 
-    lua_newtable(component->m_state);
-    luaL_setfuncs(component->m_state, actor_funcs, 0);
-    Actor** actordat = static_cast<Actor**>(lua_newuserdata(component->m_state, sizeof(Actor*)));
-    *actordat = actor;
-    lua_setfield(component->m_state, 1, "instance");
-    lua_setglobal(component->m_state, "this");
-
-    lua_newtable(component->m_state);
-    luaL_setfuncs(component->m_state, actor_funcs, 0);
-    component->m_other_actor = static_cast<Actor**>(lua_newuserdata(component->m_state, sizeof(Actor*)));
-    lua_setfield(component->m_state, 1, "instance");
-    lua_setglobal(component->m_state, "other");
-
-    lua_newtable(component->m_state);
-    luaL_setfuncs(component->m_state, game_funcs, 0);
-    lua_setglobal(component->m_state, "game");
-
-    lua_newtable(component->m_state);
-    luaL_setfuncs(component->m_state, input_funcs, 0);
-    lua_setglobal(component->m_state, "input");
-
-    lua_newtable(component->m_state);
-    luaL_setfuncs(component->m_state, audio_funcs, 0);
-    lua_setglobal(component->m_state, "audio");
-
-    lua_pushinteger(component->m_state, 3);
-    lua_setglobal(component->m_state, "KEY_UP");
-    lua_pushinteger(component->m_state, 2);
-    lua_setglobal(component->m_state, "KEY_DOWN");
-    lua_pushinteger(component->m_state, 0);
-    lua_setglobal(component->m_state, "KEY_RELEASED");
-    lua_pushinteger(component->m_state, 1);
-    lua_setglobal(component->m_state, "KEY_PRESSED");
+    pushActorProxy(state, actor);
+    lua_setfield(state, -2, "this");
 
     if(xml_attribute<>* attr = node->first_attribute("id")) {
-        luaL_loadstring(component->m_state, g_game->resources()->getScript(attr->value()));
-        if(lua_pcall(component->m_state, 0, 0, 0)) {
-            warn(lua_tostring(component->m_state, -1));
-        }
+        component->m_script = attr->value();
+        g_game->scripts()->beginCall(component, component->m_script);
+        g_game->scripts()->instantiate(state, attr->value());
+        g_game->scripts()->endCall();
     }
 
-    lua_getglobal(component->m_state, "update");
-    if(lua_isfunction(component->m_state, -1))
-        component->m_has_update = true;
-    lua_pop(component->m_state, 1);
+    component->m_env = luaL_ref(state, LUA_REGISTRYINDEX);
+    component->resolveHooks();
 
     return component;
 }
 
 void CScript::init(void)
 {
-    lua_getglobal(m_state, "init");
-    if(!lua_isfunction(m_state, -1)) {
-        lua_pop(m_state, 1);
-    } else if(lua_pcall(m_state, 0, 0, 0)) {
-        warn(lua_tostring(m_state, -1));
+    if(hasHook(HOOK_INIT)) {
+        lua_rawgeti(u_state, LUA_REGISTRYINDEX, m_hooks[HOOK_INIT]);
+        callHook(0);
     }
+    // Isolated VMs are garbage collected from the worker pool, so they all
+    // join it, even without an update hook.
+    if(m_isolated)
+        g_game->scripts()->addIsolated(this);
+    if(u_owner->isStatic())
+        return;
+    if(!m_isolated && hasHook(HOOK_UPDATE_BATCH))
+        g_game->scripts()->addBatchMember(m_script, this, m_env, m_hooks[HOOK_UPDATE_BATCH]);
 }
 
 void CScript::callDestroy(void)
 {
-    lua_getglobal(m_state, "destroy");
-    if(!lua_isfunction(m_state, -1)) {
-        lua_pop(m_state, 1);
-    } else if(lua_pcall(m_state, 0, 0, 0)) {
-        warn(lua_tostring(m_state, -1));
+    if(hasHook(HOOK_DESTROY)) {
+        lua_rawgeti(u_state, LUA_REGISTRYINDEX, m_hooks[HOOK_DESTROY]);
+        callHook(0);
     }
 }
 
 void CScript::destroy(void)
 {
-    lua_close(m_state);
+    g_game->scripts()->getScheduler()->cancel(this);
+    g_game->scripts()->getScriptEvents()->cancel(this);
+    if(m_isolated)
+        g_game->scripts()->removeIsolated(this);
+    else if(hasHook(HOOK_UPDATE_BATCH))
+        g_game->scripts()->removeBatchMember(m_script, this);
+    for(int i = 0; i < HOOK_COUNT; ++i)
+        if(hasHook(static_cast<ScriptHook>(i)))
+            luaL_unref(u_state, LUA_REGISTRYINDEX, m_hooks[i]);
+    m_hook_mask = 0;
+    luaL_unref(u_state, LUA_REGISTRYINDEX, m_collision_list);
+    luaL_unref(u_state, LUA_REGISTRYINDEX, m_collision_pool);
+    luaL_unref(u_state, LUA_REGISTRYINDEX, m_env);
+    if(m_isolated)
+        g_game->scripts()->closeIsolatedState(u_state);
 }
 
 void CScript::update(float delta_time)
 {
-    lua_getglobal(m_state, "update");
-    if(!lua_isfunction(m_state, -1))
-        lua_pop(m_state, 1);
-    else {
-        lua_pushnumber(m_state, delta_time);
-        if(lua_pcall(m_state, 1, 0, 0)) {
-            warn(lua_tostring(m_state, -1));
-        }
+    if(hasHook(HOOK_UPDATE)) {
+        lua_rawgeti(u_state, LUA_REGISTRYINDEX, m_hooks[HOOK_UPDATE]);
+        lua_pushnumber(u_state, delta_time);
+        callHook(1);
+    }
+}
+
+void CScript::updateIsolated(float delta_time)
+{
+    if(!hasHook(HOOK_UPDATE) || u_owner->isStatic())
+        return;
+    lua_rawgeti(u_state, LUA_REGISTRYINDEX, m_hooks[HOOK_UPDATE]);
+    lua_pushnumber(u_state, delta_time);
+    if(lua_pcall(u_state, 1, 0, 0)) {
+        warn(lua_tostring(u_state, -1));
+        lua_pop(u_state, 1);
     }
 }
 
@@ -139,47 +148,113 @@ ComponentID CScript::getID(void)
 
 void CScript::processCollision(char collision_type, unsigned long other_id)
 {
-    *m_other_actor = g_game->actors()->getActor(other_id);
-    if(!*m_other_actor || !(*m_other_actor)->getAlive())
+    ScriptHook hook = static_cast<ScriptHook>(HOOK_COLLISION_ENTER + collision_type - 1);
+    if(!hasHook(hook))
         return;
-    lua_getglobal(m_state, collision_strs[collision_type - 1]);
-    if(!lua_isfunction(m_state, -1))
-        lua_pop(m_state, 1);
-    else {
-        lua_pushinteger(m_state, other_id);
-        if(lua_pcall(m_state, 1, 0, 0)) {
-            warn(lua_tostring(m_state, -1));
+    Actor* other = g_game->actors()->getActor(other_id);
+    if(!other || !other->getAlive())
+        return;
+    lua_rawgeti(u_state, LUA_REGISTRYINDEX, m_env);
+    pushActorProxy(u_state, other);
+    lua_setfield(u_state, -2, "other");
+    lua_pop(u_state, 1);
+    lua_rawgeti(u_state, LUA_REGISTRYINDEX, m_hooks[hook]);
+    lua_pushinteger(u_state, other_id);
+    callHook(1);
+}
+
+// The list and its records are reused every frame, so scripts shouldn't keep
+// references to them past the call. Each record has other, phase, point and
+// impulse fields, and the record count is passed as the second argument.
+void CScript::processCollisions(const std::vector<CollisionRecord>& records)
+{
+    if(m_collision_list == LUA_NOREF) {
+        lua_createtable(u_state, records.size(), 0);
+        m_collision_list = luaL_ref(u_state, LUA_REGISTRYINDEX);
+        lua_createtable(u_state, records.size(), 0);
+        m_collision_pool = luaL_ref(u_state, LUA_REGISTRYINDEX);
+    }
+    lua_rawgeti(u_state, LUA_REGISTRYINDEX, m_collision_list);
+    lua_rawgeti(u_state, LUA_REGISTRYINDEX, m_collision_pool);
+    int list = lua_absindex(u_state, -2);
+    int pool = lua_absindex(u_state, -1);
+
+    int count = 0;
+    for(auto& i : records) {
+        ++count;
+        lua_rawgeti(u_state, pool, count);
+        if(!lua_istable(u_state, -1)) {
+            lua_pop(u_state, 1);
+            lua_createtable(u_state, 0, 4);
+            lua_pushvalue(u_state, -1);
+            lua_rawseti(u_state, pool, count);
         }
+        pushActorProxy(u_state, i.other);
+        lua_setfield(u_state, -2, "other");
+        lua_pushinteger(u_state, i.phase);
+        lua_setfield(u_state, -2, "phase");
+        lua_getfield(u_state, -1, "point");
+        returnVec3(u_state, lua_gettop(u_state), i.point);
+        lua_setfield(u_state, -3, "point");
+        lua_pop(u_state, 1);
+        lua_pushnumber(u_state, i.impulse);
+        lua_setfield(u_state, -2, "impulse");
+        lua_rawseti(u_state, list, count);
     }
+    for(int i = count + 1; i <= m_collision_count; ++i) {
+        lua_pushnil(u_state);
+        lua_rawseti(u_state, list, i);
+    }
+    m_collision_count = count;
+    lua_pop(u_state, 1);
+
+    lua_rawgeti(u_state, LUA_REGISTRYINDEX, m_hooks[HOOK_COLLISIONS]);
+    lua_insert(u_state, -2);
+    lua_pushinteger(u_state, count);
+    callHook(2);
+}
+
+// Hooks are looked up once, after the script's chunk has run, and kept as
+// registry references so dispatch never has to hash the hook's name.
+void CScript::resolveHooks(void)
+{
+    lua_rawgeti(u_state, LUA_REGISTRYINDEX, m_env);
+    for(int i = 0; i < HOOK_COUNT; ++i) {
+        lua_getfield(u_state, -1, hook_names[i]);
+        if(lua_isfunction(u_state, -1)) {
+            m_hooks[i] = luaL_ref(u_state, LUA_REGISTRYINDEX);
+            m_hook_mask |= 1 << i;
+        } else {
+            m_hooks[i] = LUA_NOREF;
+            lua_pop(u_state, 1);
+        }
+    }
+    lua_pop(u_state, 1);
+}
+
+void CScript::callHook(int arg_count)
+{
+    g_game->scripts()->beginCall(this, m_script);
+    if(lua_pcall(u_state, arg_count, 0, 0)) {
+        warn(lua_tostring(u_state, -1));
+        lua_pop(u_state, 1);
+    }
+    g_game->scripts()->endCall();
 }
 
 int cscriptIndex(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
-        return luaL_error(state, "Trying to access angular velocity, but the Rigid Body Component is missing its instance!");
+    if(!isLiveInstance(state, -1))
+        return luaL_error(state, "Trying to access data, but the Script Component is missing its instance!");
     CScript* script = *static_cast<CScript**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
+    if(script->u_state != state)
+        return luaL_error(state, "Trying to access data, but the Script Component runs in another VM!");
 
-    lua_getglobal(script->m_state, lua_tostring(state, 2));
-    switch(lua_type(script->m_state, -1)) {
-        case LUA_TNUMBER:
-            lua_pushnumber(state, lua_tonumber(script->m_state, -1));
-            break;
-        case LUA_TBOOLEAN:
-            lua_pushboolean(state, lua_toboolean(script->m_state, -1));
-            break;
-        case LUA_TSTRING:
-            lua_pushstring(state, lua_tostring(script->m_state, -1));
-            break;
-        case LUA_TFUNCTION:
-            lua_pushcfunction(state, lua_tocfunction(script->m_state, -1));
-            break;
-        default:
-            lua_pop(script->m_state, 1);
-            return 0;
-    }
-    lua_pop(script->m_state, 1);
+    lua_rawgeti(state, LUA_REGISTRYINDEX, script->m_env);
+    lua_pushvalue(state, 2);
+    lua_rawget(state, -2);
 
     return 1;
 }
@@ -187,28 +262,17 @@ int cscriptIndex(lua_State* state)
 int cscriptNewIndex(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
-        return luaL_error(state, "Trying to access angular velocity, but the Rigid Body Component is missing its instance!");
+    if(!isLiveInstance(state, -1))
+        return luaL_error(state, "Trying to access data, but the Script Component is missing its instance!");
     CScript* script = *static_cast<CScript**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
+    if(script->u_state != state)
+        return luaL_error(state, "Trying to access data, but the Script Component runs in another VM!");
 
-    switch(lua_type(state, 3)) {
-        case LUA_TNUMBER:
-            lua_pushnumber(script->m_state, lua_tonumber(state, 3));
-            break;
-        case LUA_TBOOLEAN:
-            lua_pushboolean(script->m_state, lua_toboolean(state, -1));
-            break;
-        case LUA_TSTRING:
-            lua_pushstring(script->m_state, lua_tostring(state, -1));
-            break;
-        case LUA_TFUNCTION:
-            lua_pushcfunction(script->m_state, lua_tocfunction(state, -1));
-            break;
-        default:
-            return 0;
-    }
-    lua_setglobal(script->m_state, lua_tostring(state, 2));
+    lua_rawgeti(state, LUA_REGISTRYINDEX, script->m_env);
+    lua_pushvalue(state, 2);
+    lua_pushvalue(state, 3);
+    lua_rawset(state, -3);
 
     return 0;
 }
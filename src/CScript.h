@@ -1,13 +1,11 @@
 #ifndef COMPONENT_SCRIPT_H
 #define COMPONENT_SCRIPT_H
 #include "Component.h"
-
-extern "C" {
-#include <lua.h>
-#include <lualib.h>
-#include <lauxlib.h>
-}
+#include "LuaCompat.h"
+#include <glm/vec3.hpp>
 #include <rapidxml.hpp>
+#include <string>
+#include <vector>
 
 class Actor;
 #define CSCRIPT_ID 3
@@ -28,6 +26,27 @@ const luaL_Reg cscript_meta[] =
     {0, 0}
 };
 
+enum ScriptHook
+{
+    HOOK_INIT = 0,
+    HOOK_UPDATE,
+    HOOK_UPDATE_BATCH,
+    HOOK_DESTROY,
+    HOOK_COLLISION_ENTER,
+    HOOK_COLLISION_TICK,
+    HOOK_COLLISION_LEAVE,
+    HOOK_COLLISIONS,
+    HOOK_COUNT,
+};
+
+struct CollisionRecord
+{
+    Actor* other;
+    char phase;
+    glm::vec3 point;
+    float impulse;
+};
+
 class CScript : public IComponent
 {
 public:
@@ -37,17 +56,37 @@ public:
     virtual void update(float delta_time);
     virtual ComponentID getID(void);
     virtual void processCollision(char collision_type, unsigned long other_id);
+    // Hands a frame's collisions to on_collisions in one call. Scripts that
+    // define it don't get the per-collision hooks.
+    void processCollisions(const std::vector<CollisionRecord>& records);
     virtual const luaL_Reg* getFuncs(void) const { return cscript_funcs; }
     virtual const luaL_Reg* getMetaFuncs(void) const { return cscript_meta; }
-    virtual bool get_has_update(void) const { return m_has_update; }
+    // update_batch takes over from update, and isolated scripts are updated
+    // by the ScriptSystem, so neither is updated per actor.
+    virtual bool get_has_update(void) const { return hasHook(HOOK_UPDATE) && !hasHook(HOOK_UPDATE_BATCH) && !m_isolated; }
+    inline bool hasHook(ScriptHook hook) const { return m_hook_mask & (1 << hook); }
+    inline lua_State* getState(void) const { return u_state; }
+    inline bool isIsolated(void) const { return m_isolated; }
+    // Runs the update hook without touching any shared engine state, so it's
+    // safe to call from a worker thread.
+    void updateIsolated(float delta_time);
 
     friend IComponent* buildScript(rapidxml::xml_node<>* node, Actor* actor);
     friend int cscriptIndex(lua_State* state);
     friend int cscriptNewIndex(lua_State* state);
 protected:
-    lua_State* m_state;
-    Actor** m_other_actor;
-    bool m_has_update;
+    void resolveHooks(void);
+    void callHook(int arg_count);
+
+    lua_State* u_state;
+    std::string m_script;
+    bool m_isolated = false;
+    int m_env = LUA_NOREF;
+    int m_hooks[HOOK_COUNT];
+    unsigned m_hook_mask = 0;
+    int m_collision_list = LUA_NOREF;
+    int m_collision_pool = LUA_NOREF;
+    int m_collision_count = 0;
 };
 
 #endif
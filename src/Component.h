@@ -1,11 +1,7 @@
 #ifndef COMPONENT_H
 #define COMPONENT_H
-
-extern "C" {
-#include <lua.h>
-#include <lualib.h>
-#include <lauxlib.h>
-}
+#include "LuaCompat.h"
+#include "ScriptBinding.h"
 #include <btBulletDynamicsCommon.h>
 #include <string>
 
@@ -25,6 +21,8 @@ public:
     inline void setName(const char* name) { m_name = name; }
     virtual const luaL_Reg* getFuncs(void) const = 0;
     virtual const luaL_Reg* getMetaFuncs(void) const = 0;
+    // Fields exposed on the component's proxy, or NULL if it has none.
+    virtual const ScriptProperty* getProperties(void) const { return NULL; }
     virtual bool get_has_update(void) const = 0;
 protected:
     Actor* u_owner;
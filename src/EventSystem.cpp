@@ -18,8 +18,10 @@ bool EventSystem::initialize(void)
 void EventSystem::update(float dt)
 {
     while(!m_event_queue.empty()) {
-        callEvent(*m_event_queue.front());
+        IEvent* event = m_event_queue.front();
         m_event_queue.pop_front();
+        callEvent(*event);
+        delete event;
     }
 }
 
@@ -29,20 +31,20 @@ void EventSystem::cleanup(void)
 
 bool EventSystem::addSubscription(const Callback& subscription_callback, const EventType& type)
 {
-    std::list<Callback> list = m_subscriptions[type];
+    std::list<Callback>& list = m_subscriptions[type];
     for(auto i = list.begin(); i != list.end(); ++i) {
         if(subscription_callback.first == (*i).first) {
             warn("Trying to add existing subscription again.");
             return false;
         }
     }
-    m_subscriptions[type].push_back(subscription_callback);
+    list.push_back(subscription_callback);
     return true;
 }
 
 bool EventSystem::rmSubscription(void* subscriber, const EventType& type)
 {
-    std::list<Callback> list = m_subscriptions[type];
+    std::list<Callback>& list = m_subscriptions[type];
     for(auto i = list.begin(); i != list.end(); ++i) {
         if(subscriber == (*i).first) {
             list.erase(i);
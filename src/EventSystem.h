@@ -33,6 +33,7 @@ public:
     virtual bool addSubscription(const Callback& subscription_callback, const EventType& type);
     virtual bool rmSubscription (void* subscriber, const EventType& type);
     virtual bool callEvent (const IEvent& event) const;
+    // Takes ownership of event, which is sent and deleted on the next update.
     virtual bool queueEvent(IEvent* event);
     virtual bool clearEvent(const EventType& type, bool next_only = true);
 private:
@@ -19,7 +19,8 @@ Font::Font(const char* filename, FT_Library lib)
     if(FT_New_Face(lib, filename, 0, &m_font_face))
         return; // TODO: Print errors
     m_vertex_position = glGetAttribLocation(TEXT_PROGRAM, "vertex_pos");
-    m_transform_uniform = glGetUniformLocation(TEXT_PROGRAM, "model_view_projection");
+    m_transform_uniform = glGetUniformLocation(TEXT_PROGRAM, "world");
+    m_screen_space_uniform = glGetUniformLocation(TEXT_PROGRAM, "screen_space");
     m_texture_uniform = glGetUniformLocation(TEXT_PROGRAM, "texture");
     m_color_uniform = glGetUniformLocation(TEXT_PROGRAM, "color");
     checkGLError();
@@ -35,7 +36,8 @@ void Font::cleanup(void)
 void Font::draw(IScene* scene, const char* text, glm::mat4 transform, float font_size, glm::vec3 color)
 {
 	FT_Set_Pixel_Sizes(m_font_face, font_size, font_size);
-    glUseProgram(TEXT_PROGRAM);
+    g_gl_state.useProgram(TEXT_PROGRAM);
+    glUniform1i(m_screen_space_uniform, 0);
     checkGLError();
 
     glm::vec3 pen(0, 0, 0);
@@ -66,26 +68,25 @@ void Font::draw(IScene* scene, const char* text, glm::mat4 transform, float font
         glUniform3f(m_color_uniform, color.x, color.y, color.z);
         glm::vec3 offset(glyph.bearing.x, -glyph.bearing.y, 0.0f);
 
-        glm::mat4 mvp = scene->getActiveProjectionMatrix() *
-                        scene->getActiveViewMatrix() *
-                        transform *
-                        glm::translate(glm::mat4(1), -(pen + offset) * scene->getDPU()) *
-                        glm::scale(glm::mat4(1), glm::vec3(glyph.dimensions.x * scene->getDPU(), glyph.dimensions.y * scene->getDPU(), 1.0f));
+        glm::mat4 world = transform *
+                          glm::translate(glm::mat4(1), -(pen + offset) * scene->getDPU()) *
+                          glm::scale(glm::mat4(1), glm::vec3(glyph.dimensions.x * scene->getDPU(), glyph.dimensions.y * scene->getDPU(), 1.0f));
         //fprintf(stderr, "Result: %f, %f, %f, %f\n", glyph.dimensions.x, glyph.dimensions.y, glyph.dimensions.x * scene->getDPU(), glyph.dimensions.y * scene->getDPU());
-        glUniformMatrix4fv(m_transform_uniform, 1, GL_FALSE, &mvp[0][0]);
-        glEnableVertexAttribArray(m_vertex_position);
-        glBindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
+        glUniformMatrix4fv(m_transform_uniform, 1, GL_FALSE, &world[0][0]);
+        g_gl_state.bindVertexArray(STREAM_VERTEX_ARRAY);
+        g_gl_state.enableAttrib(m_vertex_position);
+        g_gl_state.bindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
         glVertexAttribPointer(m_vertex_position, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, glyph.texture);
+        g_gl_state.activeTexture(GL_TEXTURE0);
+        g_gl_state.bindTexture(GL_TEXTURE_2D, glyph.texture);
         glUniform1i(m_texture_uniform, 0);
         checkGLError();
 
         glDrawArrays(GL_TRIANGLES, 0, 6);
         checkGLError();
 
-        glDisableVertexAttribArray(m_vertex_position);
+        g_gl_state.disableAttrib(m_vertex_position);
         pen.x += glyph.advance;
         //fprintf(stderr, "(%d)\n", (int)glyph.advance);
         prev = index;
@@ -96,7 +97,9 @@ void Font::draw2D(IScene* scene, const char* text, glm::mat4 transform, float fo
 {
 	FT_Set_Pixel_Sizes(m_font_face, 0, font_size);
 
-    glUseProgram(TEXT_PROGRAM);
+    g_gl_state.useProgram(TEXT_PROGRAM);
+    // The ortho projection is folded into world, so the camera isn't applied.
+    glUniform1i(m_screen_space_uniform, 1);
 
     glm::vec3 pen(font_size, font_size, 0);
     glm::vec2 view = scene->getViewportSize();
@@ -126,19 +129,20 @@ void Font::draw2D(IScene* scene, const char* text, glm::mat4 transform, float fo
                         glm::translate(glm::mat4(1), -(pen + offset)) *
                         glm::scale(glm::mat4(1), glm::vec3(glyph.dimensions.x * scene->getDPU(), glyph.dimensions.y * scene->getDPU(), 1.0f));
         glUniformMatrix4fv(m_transform_uniform, 1, GL_FALSE, &mvp[0][0]);
-        glEnableVertexAttribArray(m_vertex_position);
-        glBindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
+        g_gl_state.bindVertexArray(STREAM_VERTEX_ARRAY);
+        g_gl_state.enableAttrib(m_vertex_position);
+        g_gl_state.bindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
         glVertexAttribPointer(m_vertex_position, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, glyph.texture);
+        g_gl_state.activeTexture(GL_TEXTURE0);
+        g_gl_state.bindTexture(GL_TEXTURE_2D, glyph.texture);
         glUniform1i(m_texture_uniform, 0);
         checkGLError();
 
         glDrawArrays(GL_TRIANGLES, 0, 6);
         checkGLError();
 
-        glDisableVertexAttribArray(m_vertex_position);
+        g_gl_state.disableAttrib(m_vertex_position);
         pen.x += glyph.advance;
     }
 }
@@ -161,7 +165,7 @@ Glyph Font::renderGlyph(char glyph, float font_size)
     new_glyph.advance   = m_font_face->glyph->metrics.horiAdvance / 64;
 
     glGenTextures(1, &new_glyph.texture);
-    glBindTexture(GL_TEXTURE_2D, new_glyph.texture);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, new_glyph.texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     checkGLError();
@@ -49,6 +49,7 @@ protected:
     GLuint m_color_uniform;
     GLuint m_vertex_position;
     GLuint m_transform_uniform;
+    GLuint m_screen_space_uniform;
     bool m_failed_load = true;
     std::map<float, Glyph> m_rendered_symbols[256];
 };
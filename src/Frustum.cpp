@@ -0,0 +1,93 @@
+#include "Frustum.h"
+
+#include <cmath>
+#include <glm/geometric.hpp>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+AABB AABB::transformed(const glm::mat4& matrix) const
+{
+    glm::vec3 center(matrix * glm::vec4(getCenter(), 1.0f));
+    glm::vec3 extent = getExtent();
+    glm::vec3 world_extent;
+    for(int i = 0; i < 3; ++i)
+        world_extent[i] = std::abs(matrix[0][i]) * extent.x + std::abs(matrix[1][i]) * extent.y + std::abs(matrix[2][i]) * extent.z;
+    return { center - world_extent, center + world_extent };
+}
+
+Frustum::Frustum(const glm::mat4& m)
+{
+    glm::vec4 rows[4];
+    for(int i = 0; i < 4; ++i)
+        rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    m_planes[0] = rows[3] + rows[0];
+    m_planes[1] = rows[3] - rows[0];
+    m_planes[2] = rows[3] + rows[1];
+    m_planes[3] = rows[3] - rows[1];
+    m_planes[4] = rows[3] + rows[2];
+    m_planes[5] = rows[3] - rows[2];
+    for(auto& plane : m_planes)
+        plane /= glm::length(glm::vec3(plane));
+}
+
+// A box is outside if it's entirely behind any one plane.
+bool Frustum::intersects(const AABB& box) const
+{
+    glm::vec3 center = box.getCenter();
+    glm::vec3 extent = box.getExtent();
+    for(auto& plane : m_planes) {
+        float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+        float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+        if(distance + radius < 0)
+            return false;
+    }
+    return true;
+}
+
+// Inside if it's entirely in front of every plane.
+Frustum::Containment Frustum::classify(const AABB& box) const
+{
+    glm::vec3 center = box.getCenter();
+    glm::vec3 extent = box.getExtent();
+    Containment result = INSIDE;
+    for(auto& plane : m_planes) {
+        float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+        float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+        if(distance + radius < 0)
+            return OUTSIDE;
+        if(distance - radius < 0)
+            result = INTERSECTS;
+    }
+    return result;
+}
+
+void Frustum::intersects(const float* cx, const float* cy, const float* cz, const float* ex, const float* ey, const float* ez, unsigned count, unsigned char* visible) const
+{
+    unsigned i = 0;
+#if defined(__SSE__) || defined(_M_X64)
+    __m128 zero = _mm_setzero_ps();
+    for(; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(cx + i);
+        __m128 y = _mm_loadu_ps(cy + i);
+        __m128 z = _mm_loadu_ps(cz + i);
+        __m128 w = _mm_loadu_ps(ex + i);
+        __m128 h = _mm_loadu_ps(ey + i);
+        __m128 d = _mm_loadu_ps(ez + i);
+        __m128 outside = zero;
+        for(auto& plane : m_planes) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))), _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w, _mm_set1_ps(std::abs(plane.x))), _mm_mul_ps(h, _mm_set1_ps(std::abs(plane.y)))), _mm_mul_ps(d, _mm_set1_ps(std::abs(plane.z))));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for(int j = 0; j < 4; ++j)
+            visible[i + j] = !(mask & (1 << j));
+    }
+#endif
+    for(; i < count; ++i) {
+        AABB box = { glm::vec3(cx[i] - ex[i], cy[i] - ey[i], cz[i] - ez[i]), glm::vec3(cx[i] + ex[i], cy[i] + ey[i], cz[i] + ez[i]) };
+        visible[i] = intersects(box);
+    }
+}
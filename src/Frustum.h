@@ -0,0 +1,36 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+struct AABB
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    inline glm::vec3 getCenter(void) const { return (min + max) * 0.5f; }
+    inline glm::vec3 getExtent(void) const { return (max - min) * 0.5f; }
+    // Bounds of this box after transforming it by matrix.
+    AABB transformed(const glm::mat4& matrix) const;
+};
+
+class Frustum
+{
+public:
+    enum Containment { OUTSIDE, INTERSECTS, INSIDE };
+
+    Frustum(void) {}
+    // Takes the planes from a projection * view matrix.
+    Frustum(const glm::mat4& view_projection);
+    bool intersects(const AABB& box) const;
+    Containment classify(const AABB& box) const;
+    // Tests count boxes given as separate center and extent arrays, four at a
+    // time where SIMD is available, writing 1 to visible for each box that
+    // may be inside the frustum and 0 for each that isn't.
+    void intersects(const float* cx, const float* cy, const float* cz, const float* ex, const float* ey, const float* ez, unsigned count, unsigned char* visible) const;
+private:
+    glm::vec4 m_planes[6];
+};
+
+#endif
@@ -15,6 +15,7 @@
 #include "ResourceDefines.h"
 #include "RenderUtil.h"
 #include "Scene.h"
+#include "ScriptSystem.h"
 #include "Sound.h"
 #include "TweenSystem.h"
 #include "Game.h"
@@ -38,7 +39,7 @@ bool Game::initialize(void)
     m_graphics = new GraphicsSystem();
     m_physics = new PhysicsSystem();
     m_tweens = new TweenSystem();
-    m_resources = new DFBaseResourceManager();
+    m_scripts = new ScriptSystem(m_script_memory_limit);
     m_resources = new DFBaseResourceManager();
     m_components = new ComponentFactory();
 
@@ -49,6 +50,7 @@ bool Game::initialize(void)
         delete m_physics;
         delete m_graphics;
         delete m_events;
+        delete m_scripts;
         glfwTerminate();
         error("Failed to initialize the EventSystem.");
         return false;
@@ -63,6 +65,7 @@ bool Game::initialize(void)
         delete m_graphics;
         m_events->cleanup();
         delete m_events;
+        delete m_scripts;
         glfwTerminate();
         error("Failed to initialize the GraphicsSystem.");
         return false;
@@ -78,6 +81,7 @@ bool Game::initialize(void)
         delete m_graphics;
         m_events->cleanup();
         delete m_events;
+        delete m_scripts;
         glfwTerminate();
         error("Failed to initialize the PhysicsSystem.");
         return false;
@@ -94,6 +98,7 @@ bool Game::initialize(void)
         delete m_graphics;
         m_events->cleanup();
         delete m_events;
+        delete m_scripts;
         glfwTerminate();
         error("Failed to initialize the ActorSystem.");
         return false;
@@ -110,6 +115,7 @@ bool Game::initialize(void)
         delete m_graphics;
         m_events->cleanup();
         delete m_events;
+        delete m_scripts;
         glfwTerminate();
         error("Failed to initialize the TweenSystem.");
         return false;
@@ -128,6 +134,7 @@ bool Game::initialize(void)
         delete m_graphics;
         m_events->cleanup();
         delete m_events;
+        delete m_scripts;
         glfwTerminate();
         error("Failed to initialize the ResourceManager.");
         return false;
@@ -149,11 +156,33 @@ bool Game::initialize(void)
         delete m_graphics;
         m_events->cleanup();
         delete m_events;
+        delete m_scripts;
         glfwTerminate();
         error("Failed to initialize the AudioSystem.");
         return false;
     }
 
+    if(!m_scripts->initialize()) {
+        delete m_scripts;
+        m_audio->cleanup();
+        delete m_audio;
+        m_resources->cleanup();
+        delete m_resources;
+        m_tweens->cleanup();
+        delete m_tweens;
+        m_actors->cleanup();
+        delete m_actors;
+        m_physics->cleanup();
+        delete m_physics;
+        m_graphics->cleanup();
+        delete m_graphics;
+        m_events->cleanup();
+        delete m_events;
+        glfwTerminate();
+        error("Failed to initialize the ScriptSystem.");
+        return false;
+    }
+
     m_components->registerComponentBuilder(buildRigidBody, "rigidbody");
     m_components->registerComponentBuilder(buildGraphics, "graphics");
     m_components->registerComponentBuilder(buildCamera, "camera");
@@ -176,7 +205,10 @@ void Game::mainLoop(void)
         m_events->update(m_delta_time);
         m_tweens->update(m_delta_time);
         m_actors->update(m_delta_time);
+        m_scripts->updateBatches(m_delta_time);
+        m_scripts->updateIsolated(m_delta_time);
         m_graphics->render();
+        m_scripts->update(m_delta_time);
     } while(!m_quit);
 }
 
@@ -193,6 +225,9 @@ void Game::cleanup(void)
     m_actors->cleanup();
     delete m_actors;
 
+    m_scripts->cleanup();
+    delete m_scripts;
+
     m_tweens->cleanup();
     delete m_tweens;
 
@@ -280,11 +315,7 @@ int game_create_actor(lua_State* state)
         return 0;
     }
 
-    lua_newtable(state);
-    luaL_setfuncs(state, actor_funcs, 0);
-    Actor** actordat = static_cast<Actor**>(lua_newuserdata(state, sizeof(Actor*)));
-    *actordat = actor;
-    lua_setfield(state, -2, "instance");
+    pushActorProxy(state, actor);
 
     return 1;
 }
@@ -300,11 +331,7 @@ int game_get_actor(lua_State* state)
         return 0;
     }
 
-    lua_newtable(state);
-    luaL_setfuncs(state, actor_funcs, 0);
-    Actor** actordat = static_cast<Actor**>(lua_newuserdata(state, sizeof(Actor*)));
-    *actordat = actor;
-    lua_setfield(state, -2, "instance");
+    pushActorProxy(state, actor);
 
     return 1;
 }
@@ -320,11 +347,7 @@ int game_get_actors(lua_State* state)
     lua_createtable(state, actors.size(), 0);
     for(unsigned long i = 0; i < actors.size(); ++i) {
         lua_pushinteger(state, i);
-        lua_newtable(state);
-        luaL_setfuncs(state, actor_funcs, 0);
-        Actor** actordat = static_cast<Actor**>(lua_newuserdata(state, sizeof(Actor*)));
-        *actordat = actors[i];
-        lua_setfield(state, -2, "instance");
+        pushActorProxy(state, actors[i]);
         lua_settable(state, -3);
     }
 
@@ -367,3 +390,62 @@ int game_get_data_path(lua_State* state)
     lua_pushstring(state, (getPath() + "/" + DATA_PATH).c_str());
     return 1;
 }
+
+int game_gc_stats(lua_State* state)
+{
+    lua_pushnumber(state, g_game->scripts()->getGCTime());
+    lua_pushnumber(state, g_game->scripts()->getHeapSize());
+    return 2;
+}
+
+int game_memory_stats(lua_State* state)
+{
+    ScriptAllocator* allocator = g_game->scripts()->getAllocator();
+    lua_pushnumber(state, allocator->getUsage() / 1024.0);
+    lua_pushnumber(state, allocator->getPeak() / 1024.0);
+    lua_pushnumber(state, allocator->getLimit() / 1024.0);
+    return 3;
+}
+
+int game_profile(lua_State* state)
+{
+    // A count hook of 0 instructions never fires, so profiling would stop.
+    if(lua_gettop(state) >= 2) {
+        lua_Integer interval = luaL_checkinteger(state, 2);
+        luaL_argcheck(state, interval >= 1, 2, "sample interval must be at least 1");
+        g_game->scripts()->getProfiler()->setSampleInterval(interval);
+    }
+    g_game->scripts()->setProfiling(lua_toboolean(state, 1));
+    return 0;
+}
+
+int game_profile_dump(lua_State* state)
+{
+    std::string name = luaL_optstring(state, 1, "profile");
+    lua_pushboolean(state, g_game->scripts()->dumpProfile(name));
+    return 1;
+}
+
+// Returns how many nodes were frustum tested, how many of those were culled,
+// how many were drawn, how many instanced draw calls there were and how many
+// nodes those drew in the last frame.
+int game_render_stats(lua_State* state)
+{
+    const CullStats& stats = g_game->graphics()->getActiveScene()->getCullStats();
+    lua_pushinteger(state, stats.tested);
+    lua_pushinteger(state, stats.culled);
+    lua_pushinteger(state, stats.drawn);
+    lua_pushinteger(state, stats.batches);
+    lua_pushinteger(state, stats.instanced);
+    return 5;
+}
+
+// Returns how many GL state changes were issued and how many were skipped as
+// redundant in the last frame.
+int game_gl_stats(lua_State* state)
+{
+    const GLStateStats& stats = g_gl_state.getStats();
+    lua_pushinteger(state, stats.issued);
+    lua_pushinteger(state, stats.skipped);
+    return 2;
+}
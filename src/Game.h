@@ -2,13 +2,9 @@
 #define GAME_H
 
 #include "Event.h"
+#include "LuaCompat.h"
 #include "System.h"
 #include <functional>
-extern "C"
-{
-#include <lua.h>
-#include <lauxlib.h>
-}
 
 typedef std::pair<void*, std::function<void(const IEvent&)>> Callback;
 class ActorSystem;
@@ -19,6 +15,7 @@ class GraphicsSystem;
 class InputSystem;
 class PhysicsSystem;
 class ResourceManager;
+class ScriptSystem;
 class TweenSystem;
 
 class Game
@@ -31,6 +28,8 @@ public:
     virtual bool buildLevel(std::string level, bool keep_actors = false);
     void quit(void);
     bool isQuitting(void) { return m_quit; }
+    // Has to be set before initialize, so startup scripts are limited too.
+    inline void setScriptMemoryLimit(size_t limit) { m_script_memory_limit = limit; }
 
     inline ResourceManager* resources(void) const { return m_resources; }
     inline IComponentFactory* components(void) const { return m_components; }
@@ -40,6 +39,7 @@ public:
     inline ActorSystem* actors(void) const { return m_actors; }
     inline GraphicsSystem* graphics(void) const { return m_graphics; }
     inline TweenSystem* tweens(void) const { return m_tweens; }
+    inline ScriptSystem* scripts(void) const { return m_scripts; }
 protected:
     EventSystem* m_events;
     ActorSystem* m_actors;
@@ -49,8 +49,10 @@ protected:
     PhysicsSystem* m_physics;
     ResourceManager* m_resources;
     TweenSystem* m_tweens;
+    ScriptSystem* m_scripts;
     IComponentFactory* m_components;
     float m_delta_time;
+    size_t m_script_memory_limit = 0;
 private:
     bool m_quit = false;
 };
@@ -71,6 +73,12 @@ int game_get_actor(lua_State* state);
 int game_get_actors(lua_State* state);
 int game_load_level(lua_State* state);
 int game_get_data_path(lua_State* state);
+int game_gc_stats(lua_State* state);
+int game_memory_stats(lua_State* state);
+int game_profile(lua_State* state);
+int game_profile_dump(lua_State* state);
+int game_render_stats(lua_State* state);
+int game_gl_stats(lua_State* state);
 
 const luaL_Reg game_funcs[] =
 {
@@ -80,6 +88,12 @@ const luaL_Reg game_funcs[] =
     {"debug_render", game_debug_render},
     {"load_level", game_load_level},
     {"get_data_path", game_get_data_path},
+    {"gc_stats", game_gc_stats},
+    {"memory_stats", game_memory_stats},
+    {"profile", game_profile},
+    {"profile_dump", game_profile_dump},
+    {"render_stats", game_render_stats},
+    {"gl_stats", game_gl_stats},
     {"exit", game_exit},
     {0, 0}
 };
@@ -28,6 +28,9 @@ bool GraphicsSystem::initialize()
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef GL_DEBUG
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
 
     m_main_window = glfwCreateWindow(800, 600, "Test Window", NULL, NULL);
     if(!m_main_window) {
@@ -49,9 +52,10 @@ bool GraphicsSystem::initialize()
         return false;
     }
     glGetError(); // Because GLEW is silly. <http://stackoverflow.com/questions/20034615/why-does-glewinit-result-in-gl-invalid-enum-after-making-some-calls-to-glfwwin>
-    GLuint VAO; // FIXME: Stupid Hack. <http://stackoverflow.com/questions/13403807/glvertexattribpointer-raising-gl-invalid-operation>
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+#ifdef GL_DEBUG
+    if(!enableGLDebugOutput())
+        warn("KHR_debug is unavailable, falling back to glGetError.");
+#endif
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
@@ -89,12 +93,13 @@ void GraphicsSystem::render(void) const
     glm::vec2 size = m_active_scene->getViewportSize();
     glDisable(GL_DEPTH_TEST);
     if(bar.x != 0) {
-        glUseProgram(LETTERBOX_PROGRAM);
+        g_gl_state.useProgram(LETTERBOX_PROGRAM);
         glm::vec3 pos1(-1 + (bar.x / 2) / size.x, 0.0f, 0.0f);
         glm::vec3 pos2(1 - ((bar.x / 2) / size.x), 0.0f, 0.0f);
         glm::vec3 scale(bar.x / size.x, 2.0f, 1.0f);
-        glEnableVertexAttribArray(m_letterbox_translation_uniform);
-        glBindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
+        g_gl_state.bindVertexArray(STREAM_VERTEX_ARRAY);
+        g_gl_state.enableAttrib(m_letterbox_vertex_attrib);
+        g_gl_state.bindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
         glVertexAttribPointer(m_letterbox_vertex_attrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
         glUniform3fv(m_letterbox_translation_uniform, 1, &pos1[0]);
         glUniform3fv(m_letterbox_scale_uniform, 1, &scale[0]);
@@ -106,13 +111,14 @@ void GraphicsSystem::render(void) const
         glDrawArrays(GL_TRIANGLES, 0, 6);
         checkGLError();
     } else if(bar.y != 0) {
-        glUseProgram(LETTERBOX_PROGRAM);
+        g_gl_state.useProgram(LETTERBOX_PROGRAM);
         checkGLError();
         glm::vec3 pos1(0.0f, -1 + (bar.y / 2) / size.y, 0.0f);
         glm::vec3 pos2(0.0f, 1 - ((bar.y / 2) / size.y), 0.0f);
         glm::vec3 scale(2.0f, bar.y / size.y, 1.0f);
-        glEnableVertexAttribArray(m_letterbox_translation_uniform);
-        glBindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
+        g_gl_state.bindVertexArray(STREAM_VERTEX_ARRAY);
+        g_gl_state.enableAttrib(m_letterbox_vertex_attrib);
+        g_gl_state.bindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
         glVertexAttribPointer(m_letterbox_vertex_attrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
         glUniform3fv(m_letterbox_translation_uniform, 1, &pos1[0]);
         glUniform3fv(m_letterbox_scale_uniform, 1, &scale[0]);
@@ -128,6 +134,7 @@ void GraphicsSystem::render(void) const
 
     glfwSwapBuffers(m_main_window);
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+    g_gl_state.endFrame();
 }
 
 void GraphicsSystem::cleanup(void)
@@ -2,8 +2,22 @@
 #include "Game.h"
 #include "GraphicsSystem.h"
 #include "InputSystem.h"
+#include "ScriptMath.h"
 #include "Util.h"
 
+const EventType KeyEvent::m_type(4);
+
+KeyEvent::KeyEvent(int key, int action)
+{
+    m_key = key;
+    m_action = action;
+}
+
+const EventType& KeyEvent::getEventType(void) const
+{
+    return m_type;
+}
+
 InputSystem::InputSystem()
 {
 }
@@ -74,8 +88,12 @@ void keyCodeCallback(GLFWwindow* window, int key_code, int scancode, int action,
 {
     InputSystem* input = static_cast<WindowData*>(glfwGetWindowUserPointer(window))->input_data;
     // TODO: Add modifier support, press/release callbacks vs down
-    if(action == GLFW_PRESS || action == GLFW_RELEASE)
+    if(key_code < 0 || key_code >= GLFW_KEY_LAST)
+        return;
+    if(action == GLFW_PRESS || action == GLFW_RELEASE) {
         input->m_keys[key_code] = action;
+        input->u_events->queueEvent(new KeyEvent(key_code, action));
+    }
 }
 
 void cursorEnterCallback(GLFWwindow* window, int entered)
@@ -143,6 +161,10 @@ int input_mousestate(lua_State* state)
 int input_mouseposition(lua_State* state)
 {
     glm::vec2 position = (g_game->input()->getMousePosition() - (g_game->graphics()->getViewportOffset() * 0.5f)) / (g_game->graphics()->getViewportSize() - g_game->graphics()->getViewportOffset());
+    if(testVec2(state, 1)) {
+        returnVec2(state, 1, position);
+        return 1;
+    }
     lua_pushnumber(state, position.x);
     lua_pushnumber(state, position.y);
     return 2;
@@ -151,6 +173,10 @@ int input_mouseposition(lua_State* state)
 int input_mousescroll(lua_State* state)
 {
     glm::vec2 scroll = g_game->input()->getMouseScroll();
+    if(testVec2(state, 1)) {
+        returnVec2(state, 1, scroll);
+        return 1;
+    }
     lua_pushnumber(state, scroll.x);
     lua_pushnumber(state, scroll.y);
     return 2;
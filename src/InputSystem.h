@@ -1,18 +1,31 @@
 #ifndef INPUT_SYSTEM_H
 #define INPUT_SYSTEM_H
+#include "Event.h"
+#include "LuaCompat.h"
 #include "System.h"
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/vec2.hpp>
-extern "C"
-{
-#include <lua.h>
-#include <lauxlib.h>
-}
 
 class IEventManager;
 class GraphicsSystem;
 
+// Queued when a key is pressed or released. The action is GLFW_PRESS or
+// GLFW_RELEASE, which match KEY_PRESSED and KEY_RELEASED in scripts.
+class KeyEvent : public IEvent
+{
+    public:
+        KeyEvent(int key, int action);
+        virtual const EventType& getEventType (void) const;
+        int getKey(void) const { return m_key; }
+        int getAction(void) const { return m_action; }
+
+        static const EventType m_type;
+    private:
+        int m_key;
+        int m_action;
+};
+
 class InputSystem : public ISystem
 {
 public:
@@ -0,0 +1,83 @@
+#ifndef LUA_COMPAT_H
+#define LUA_COMPAT_H
+extern "C"
+{
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+}
+
+// The engine is written against the Lua 5.3 API. When built against LuaJIT
+// (make LUA=luajit), the few 5.2 and 5.3 functions it uses are provided here
+// on top of the 5.1 API, and SCRIPT_LUAJIT and SCRIPT_FFI are defined.
+// LuaJIT only runs count hooks in the interpreter, so enabling the profiler
+// or the instruction budgets there mostly keeps scripts from being compiled.
+#if LUA_VERSION_NUM < 502
+extern "C"
+{
+#include <luajit.h>
+}
+
+#define SCRIPT_LUAJIT
+#define SCRIPT_FFI
+
+#ifndef LUA_OK
+#define LUA_OK 0
+#endif
+
+inline int compat_absindex(lua_State* state, int index)
+{
+    return (index > 0 || index <= LUA_REGISTRYINDEX) ? index : lua_gettop(state) + index + 1;
+}
+
+inline int compat_rawget(lua_State* state, int index)
+{
+    lua_rawget(state, index);
+    return lua_type(state, -1);
+}
+
+inline int compat_rawgetp(lua_State* state, int index, const void* p)
+{
+    index = compat_absindex(state, index);
+    lua_pushlightuserdata(state, const_cast<void*>(p));
+    lua_rawget(state, index);
+    return lua_type(state, -1);
+}
+
+inline void compat_rawsetp(lua_State* state, int index, const void* p)
+{
+    index = compat_absindex(state, index);
+    lua_pushlightuserdata(state, const_cast<void*>(p));
+    lua_insert(state, -2);
+    lua_rawset(state, index);
+}
+
+inline int compat_isinteger(lua_State* state, int index)
+{
+    if(lua_type(state, index) != LUA_TNUMBER)
+        return 0;
+    lua_Number n = lua_tonumber(state, index);
+    return n == static_cast<lua_Number>(static_cast<lua_Integer>(n));
+}
+
+inline int compat_resume(lua_State* state, lua_State* from, int arg_count)
+{
+    return lua_resume(state, arg_count);
+}
+
+inline int compat_dump(lua_State* state, lua_Writer writer, void* data, int strip)
+{
+    return lua_dump(state, writer, data);
+}
+
+#define lua_absindex(L, i) compat_absindex(L, i)
+#define lua_rawget(L, i) compat_rawget(L, i)
+#define lua_rawgetp(L, i, p) compat_rawgetp(L, i, p)
+#define lua_rawsetp(L, i, p) compat_rawsetp(L, i, p)
+#define lua_isinteger(L, i) compat_isinteger(L, i)
+#define lua_resume(L, from, n) compat_resume(L, from, n)
+#define lua_dump(L, w, d, s) compat_dump(L, w, d, s)
+#define lua_pushglobaltable(L) lua_pushvalue(L, LUA_GLOBALSINDEX)
+#endif
+
+#endif
@@ -1,10 +1,25 @@
 #include "Model.h"
+#include "RenderUtil.h"
 #include "Util.h"
 
+#include <cstddef>
 #include <cstdio>
 #include <cstring>
+#include <glm/common.hpp>
 #include <glm/vec2.hpp>
 
+static AABB computeBounds(const glm::vec3* vertices, unsigned count)
+{
+    if(count == 0)
+        return { glm::vec3(0), glm::vec3(0) };
+    AABB bounds = { vertices[0], vertices[0] };
+    for(unsigned i = 1; i < count; ++i) {
+        bounds.min = glm::min(bounds.min, vertices[i]);
+        bounds.max = glm::max(bounds.max, vertices[i]);
+    }
+    return bounds;
+}
+
 Model::Model(char* model_data, std::string name)
 {
     m_name = name;
@@ -137,121 +152,80 @@ Model::Model(char* model_data, std::string name)
         position = strchr(position + 1, '\n');
     }
 
-    if(m_has_uvs) {
-        m_vertex_data = new glm::vec3[temp_uv_index_data.size()];
-        m_index_data = new unsigned int[temp_uv_index_data.size()];
-        m_normal_data = new glm::vec3[temp_uv_index_data.size()];
-        m_uv_data = new glm::vec2[temp_uv_data.size()];
-        m_index_count = temp_uv_index_data.size();
+    m_bounds = computeBounds(temp_vertex_data.data(), temp_vertex_data.size());
 
-        std::copy(temp_uv_data.begin(), temp_uv_data.end(), m_uv_data);
+    // With uvs, each uv index gets its own vertex, since a position can have
+    // different uvs on different faces.
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    if(m_has_uvs) {
+        vertices.resize(temp_uv_data.size());
+        indices = temp_uv_index_data;
         for(unsigned int i = 0; i < temp_uv_index_data.size(); ++i) {
-            m_vertex_data[temp_uv_index_data[i]] = temp_vertex_data[temp_index_data[i]];
-            m_index_data[i] = temp_uv_index_data[i];
+            Vertex& vertex = vertices[temp_uv_index_data[i]];
+            vertex.position = temp_vertex_data[temp_index_data[i]];
+            vertex.uv = temp_uv_data[temp_uv_index_data[i]];
             if(m_has_normals)
-                m_normal_data[temp_uv_index_data[i]] = temp_normal_data[temp_normal_index_data[i]];
+                vertex.normal = temp_normal_data[temp_normal_index_data[i]];
         }
     } else {
-        m_vertex_data = new glm::vec3[temp_vertex_data.size()];
-        m_index_data = new unsigned int[temp_index_data.size()];
+        vertices.resize(temp_vertex_data.size());
+        indices = temp_index_data;
+        for(unsigned int i = 0; i < temp_vertex_data.size(); ++i)
+            vertices[i].position = temp_vertex_data[i];
         if(m_has_normals)
-            m_normal_data = new glm::vec3[temp_index_data.size()];
-        m_index_count = temp_index_data.size();
-
-        std::copy(temp_vertex_data.begin(), temp_vertex_data.end(), m_vertex_data);
-        for(unsigned int i = 0; i < temp_index_data.size(); ++i) {
-            m_index_data[i] = temp_index_data[i];
-            if(m_has_normals)
-                m_normal_data[m_index_data[i]] = temp_normal_data[temp_normal_index_data[i]];
-        }
-    }
-
-    glGenBuffers(1, &m_vertices);
-    glGenBuffers(1, &m_indices);
-    glGenBuffers(1, &m_normals);
-    glGenBuffers(1, &m_uvs);
-
-	glBindBuffer(GL_ARRAY_BUFFER, m_vertices);
-	glBufferData(GL_ARRAY_BUFFER, m_index_count * sizeof(glm::vec3), m_vertex_data, GL_STATIC_DRAW);
-
-	glBindBuffer(GL_ARRAY_BUFFER, m_indices);
-	glBufferData(GL_ARRAY_BUFFER, m_index_count * sizeof(GLuint), m_index_data, GL_STATIC_DRAW);
-
-    if(m_has_normals) {
-        glBindBuffer(GL_ARRAY_BUFFER, m_normals);
-        glBufferData(GL_ARRAY_BUFFER, m_index_count * sizeof(glm::vec3), m_normal_data, GL_STATIC_DRAW);
-    }
-
-    if(m_has_uvs && m_uv_data) {
-        glBindBuffer(GL_ARRAY_BUFFER, m_uvs);
-        glBufferData(GL_ARRAY_BUFFER, temp_uv_index_data.size() * sizeof(glm::vec2), m_uv_data, GL_STATIC_DRAW);
+            for(unsigned int i = 0; i < temp_index_data.size(); ++i)
+                vertices[temp_index_data[i]].normal = temp_normal_data[temp_normal_index_data[i]];
     }
+    upload(vertices, indices);
 }
 
 Model::Model(void)
 {
-    m_vertex_data = new glm::vec3[4] {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}};
-    m_index_data = new GLuint[6] {0, 1, 2, 0, 2, 3};
-    m_normal_data = new glm::vec3[4] {{0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 0, 1}};
+    std::vector<Vertex> vertices = {
+        {{0, 0, 0}, {0, 0}, {0, 0, 1}},
+        {{1, 0, 0}, {1, 0}, {0, 0, 1}},
+        {{1, 1, 0}, {1, 1}, {0, 0, 1}},
+        {{0, 1, 0}, {0, 1}, {0, 0, 1}}
+    };
+    std::vector<GLuint> indices = {0, 1, 2, 0, 2, 3};
     m_has_normals = true;
-    m_index_count = 6;
-
-    glGenBuffers(1, &m_vertices);
-    glGenBuffers(1, &m_indices);
-    glGenBuffers(1, &m_normals);
-
-	glBindBuffer(GL_ARRAY_BUFFER, m_vertices);
-	glBufferData(GL_ARRAY_BUFFER, 4 * sizeof(glm::vec3), m_vertex_data, GL_STATIC_DRAW);
-
-	glBindBuffer(GL_ARRAY_BUFFER, m_indices);
-	glBufferData(GL_ARRAY_BUFFER, m_index_count * sizeof(GLuint), m_index_data, GL_STATIC_DRAW);
-
-	glBindBuffer(GL_ARRAY_BUFFER, m_normals);
-	glBufferData(GL_ARRAY_BUFFER, 4 * sizeof(glm::vec3), m_normal_data, GL_STATIC_DRAW);
+    m_bounds = { glm::vec3(0, 0, 0), glm::vec3(1, 1, 0) };
+    upload(vertices, indices);
 }
 
 Model::~Model(void)
 {
 }
 
-void Model::cleanup(void) const
+void Model::upload(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
 {
-    if(m_has_uvs && m_uv_data)
-        delete[] m_uv_data;
-    if(m_has_normals && m_normal_data)
-        delete[] m_normal_data;
-    if(m_index_data)
-        delete[] m_index_data;
-    if(m_vertex_data)
-        delete[] m_vertex_data;
-
-    glDeleteBuffers(1, &m_vertices);
-    glDeleteBuffers(1, &m_indices);
-    glDeleteBuffers(1, &m_normals);
-    glDeleteBuffers(1, &m_uvs);
+    m_index_count = indices.size();
+
+    glGenVertexArrays(1, &m_vertex_array);
+    glGenBuffers(1, &m_vertex_buffer);
+    glGenBuffers(1, &m_index_buffer);
+    g_gl_state.bindVertexArray(m_vertex_array);
+
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    g_gl_state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+    g_gl_state.enableAttrib(ATTRIB_POSITION);
+    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    g_gl_state.enableAttrib(ATTRIB_UV);
+    glVertexAttribPointer(ATTRIB_UV, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+    g_gl_state.enableAttrib(ATTRIB_NORMAL);
+    glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+
+    g_gl_state.bindVertexArray(0);
+    checkGLError();
 }
 
-GLuint Model::getIndexCount(void) const
-{
-    return m_index_count;
-}
-
-GLuint Model::getVertices(void) const
-{
-    return m_vertices;
-}
-
-GLuint Model::getIndices(void) const
-{
-    return m_indices;
-}
-
-GLuint Model::getNormals(void) const
-{
-    return m_normals;
-}
-
-GLuint Model::getUVs(void) const
+void Model::cleanup(void) const
 {
-    return m_uvs;
+    g_gl_state.deleteVertexArrays(1, &m_vertex_array);
+    g_gl_state.deleteBuffers(1, &m_vertex_buffer);
+    g_gl_state.deleteBuffers(1, &m_index_buffer);
 }
@@ -1,12 +1,22 @@
 #ifndef MODEL_H
 #define MODEL_H
 #include <GL/glew.h>
+#include "Frustum.h"
 #include <GLFW/glfw3.h>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <string>
 #include <vector>
 
+// Models interleave their attributes in one buffer, in this layout.
+struct Vertex
+{
+    glm::vec3 position;
+    glm::vec2 uv;
+    glm::vec3 normal;
+};
+
 class IModel
 {
 public:
@@ -14,10 +24,11 @@ public:
 
     virtual void cleanup(void) const = 0;
     virtual GLuint getIndexCount(void) const = 0;
-    virtual GLuint getVertices(void) const = 0;
-    virtual GLuint getIndices(void) const = 0;
-    virtual GLuint getNormals(void) const = 0;
-    virtual GLuint getUVs(void) const = 0;
+    // Binds the model's buffers to the ATTRIB_ locations, with its indices as
+    // the element array, so drawing only needs this bound.
+    virtual GLuint getVertexArray(void) const = 0;
+    // Model space bounds of the vertices, computed when the model is loaded.
+    virtual const AABB& getBounds(void) const = 0;
     virtual std::string getName(void) const = 0;
 };
 inline IModel::~IModel(void) {}
@@ -30,24 +41,20 @@ public:
     ~Model(void);
 
     virtual void cleanup(void) const;
-    virtual GLuint getIndexCount(void) const;
-    virtual GLuint getVertices(void) const;
-    virtual GLuint getIndices(void) const;
-    virtual GLuint getNormals(void) const;
-    virtual GLuint getUVs(void) const;
+    virtual GLuint getIndexCount(void) const { return m_index_count; }
+    virtual GLuint getVertexArray(void) const { return m_vertex_array; }
+    virtual const AABB& getBounds(void) const { return m_bounds; }
     virtual std::string getName(void) const { return m_name; }
 protected:
-    unsigned int m_index_count;
-    GLuint m_vertices;
-    GLuint m_indices;
-    GLuint m_normals;
-    GLuint m_uvs;
-    glm::vec3* m_vertex_data = 0;
-    unsigned int* m_index_data = 0;
-    glm::vec3* m_normal_data = 0;
-    glm::vec2* m_uv_data = 0;
+    void upload(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+
+    unsigned int m_index_count = 0;
+    GLuint m_vertex_array = 0;
+    GLuint m_vertex_buffer = 0;
+    GLuint m_index_buffer = 0;
     bool m_has_uvs = false;
     bool m_has_normals = false;
+    AABB m_bounds;
     std::string m_name = "";
 };
 
@@ -12,13 +12,12 @@
 PhysicsRenderer::PhysicsRenderer()
 {
     glGenBuffers(1, &m_line_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
 	glBufferData(GL_ARRAY_BUFFER, 12 * sizeof(float) * DEBUG_LINE_MAX, NULL, GL_STREAM_DRAW);
 
     u_program = WIREFRAME_PROGRAM;
     u_vertex_position = glGetAttribLocation(u_program, "vertex_pos");
     u_vertex_color = glGetAttribLocation(u_program, "vertex_color");
-    u_view_projection = glGetUniformLocation(u_program, "view_projection");
     checkGLError();
 }
 
@@ -41,26 +40,25 @@ void PhysicsRenderer::drawLine(const btVector3& from, const btVector3& to, const
     line[9]  = color.x();
     line[10] = color.y();
     line[11] = color.z();
-    glUseProgram(u_program);
-    glBindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
+    g_gl_state.useProgram(u_program);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
     glBufferSubData(GL_ARRAY_BUFFER, 12 * sizeof(float) * m_line_count, 12 * sizeof(float), line);
     // Send to the shader and render
     checkGLError();
-    //glUniformMatrix4fv(u_view_projection, 1, GL_FALSE, &(u_scene->getActiveProjectionMatrix() * u_scene->getActiveViewMatrix())[0][0]);
-    //glEnableVertexAttribArray(u_vertex_position);
-    //glBindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
+    //g_gl_state.enableAttrib(u_vertex_position);
+    //g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
     //glVertexAttribPointer(u_vertex_position, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
     //checkGLError();
 
-    //glEnableVertexAttribArray(u_vertex_color);
-    //glBindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
+    //g_gl_state.enableAttrib(u_vertex_color);
+    //g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
     //glVertexAttribPointer(u_vertex_color, 3, GL_FLOAT, GL_FALSE, 0, (void*)(6 * sizeof(GL_FLOAT)));
     //checkGLError();
 
     //glDrawArrays(GL_LINES, 0, 2);
 
-    //glDisableVertexAttribArray(u_vertex_position);
-    //glDisableVertexAttribArray(u_vertex_color);
+    //g_gl_state.disableAttrib(u_vertex_position);
+    //g_gl_state.disableAttrib(u_vertex_color);
 
     m_line_count++;
 }
@@ -84,7 +82,7 @@ void PhysicsRenderer::drawLine(const btVector3& from, const btVector3& to, const
     line[9]  = toColor.x();
     line[10] = toColor.y();
     line[11] = toColor.z();
-    glBindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
     glBufferSubData(GL_ARRAY_BUFFER, 12 * sizeof(float) * m_line_count, 12 * sizeof(float), line);
 
     m_line_count++;
@@ -92,24 +90,24 @@ void PhysicsRenderer::drawLine(const btVector3& from, const btVector3& to, const
 
 void PhysicsRenderer::batchDrawLines(void)
 {
-    glUseProgram(u_program);
+    g_gl_state.useProgram(u_program);
     checkGLError();
 
-    glUniformMatrix4fv(u_view_projection, 1, GL_FALSE, &(u_scene->getActiveProjectionMatrix() * u_scene->getActiveViewMatrix())[0][0]);
-    glBindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
+    g_gl_state.bindVertexArray(STREAM_VERTEX_ARRAY);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_line_buffer);
 
-    glEnableVertexAttribArray(u_vertex_position);
+    g_gl_state.enableAttrib(u_vertex_position);
     glVertexAttribPointer(u_vertex_position, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GL_FLOAT), (void*)0);
     checkGLError();
 
-    glEnableVertexAttribArray(u_vertex_color);
+    g_gl_state.enableAttrib(u_vertex_color);
     glVertexAttribPointer(u_vertex_color, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GL_FLOAT), (void*)(3 * sizeof(GL_FLOAT)));
     checkGLError();
 
     glDrawArrays(GL_LINES, 0, 2 * m_line_count);
 
-    glDisableVertexAttribArray(u_vertex_position);
-    glDisableVertexAttribArray(u_vertex_color);
+    g_gl_state.disableAttrib(u_vertex_position);
+    g_gl_state.disableAttrib(u_vertex_color);
     m_line_count = 0;
 }
 
@@ -27,7 +27,6 @@ protected:
     GLuint u_program;
     GLuint u_vertex_position;
     GLuint u_vertex_color;
-    GLuint u_view_projection;
     IScene* u_scene;
     float m_line_count = 0;
 
@@ -7,6 +7,7 @@
 #include "Util.h"
 
 #include <BulletCollision/CollisionShapes/btShapeHull.h>
+#include <algorithm>
 #include <functional>
 
 using namespace std::placeholders;
@@ -21,8 +22,22 @@ static void physicsTickCallback(btDynamicsWorld* world, btScalar dt)
         Actor* a1 = (Actor*)o1->getUserPointer();
         Actor* a2 = (Actor*)o2->getUserPointer();
 
-        a1->addCollision(a2->getID());
-        a2->addCollision(a1->getID());
+        // Report the strongest contact of the manifold.
+        btVector3 point = o1->getWorldTransform().getOrigin().lerp(o2->getWorldTransform().getOrigin(), 0.5);
+        btScalar impulse = 0;
+        btScalar strongest = -1;
+        for(int j = 0; j < manifold->getNumContacts(); ++j) {
+            const btManifoldPoint& contact = manifold->getContactPoint(j);
+            impulse += contact.getAppliedImpulse();
+            if(contact.getAppliedImpulse() > strongest) {
+                strongest = contact.getAppliedImpulse();
+                point = contact.getPositionWorldOnA().lerp(contact.getPositionWorldOnB(), 0.5);
+            }
+        }
+        glm::vec3 gl_point(point.x(), point.y(), point.z());
+
+        a1->addCollision(a2->getID(), gl_point, impulse);
+        a2->addCollision(a1->getID(), gl_point, impulse);
     }
 }
 
@@ -54,10 +69,24 @@ bool PhysicsSystem::initialize()
 
 void PhysicsSystem::update(float delta_time)
 {
+    for(auto i : u_script_bodies)
+        i->pushScriptState();
     m_physics_world->stepSimulation(delta_time);
+    for(auto i : u_script_bodies)
+        i->pullScriptState();
     m_physics_world->debugDrawWorld();
 }
 
+void PhysicsSystem::addScriptBody(CRigidBody* body)
+{
+    u_script_bodies.push_back(body);
+}
+
+void PhysicsSystem::removeScriptBody(CRigidBody* body)
+{
+    u_script_bodies.erase(std::remove(u_script_bodies.begin(), u_script_bodies.end(), body), u_script_bodies.end());
+}
+
 void PhysicsSystem::cleanup(void)
 {
     delete m_physics_world;
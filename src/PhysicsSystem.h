@@ -7,8 +7,10 @@
 #include <BulletCollision/Gimpact/btGImpactCollisionAlgorithm.h>
 #include <glm/vec3.hpp>
 #include <map>
+#include <vector>
 
 class Actor;
+class CRigidBody;
 class IEvent;
 
 class IPhysics
@@ -32,6 +34,9 @@ public:
     inline void updateAABB(btRigidBody* body) { m_physics_world->updateSingleAabb(body); }
     inline float getWorldScale(void) const { return m_world_scale; }
     inline void setWorldScale(float world_scale) { m_world_scale = world_scale; }
+    // Bodies whose script state is synced around each step.
+    void addScriptBody(CRigidBody* body);
+    void removeScriptBody(CRigidBody* body);
 
 private:
     virtual void CRigidBodyCreatedCallback(const IEvent& event);
@@ -42,6 +47,7 @@ private:
     btSequentialImpulseConstraintSolver* m_solver;
     btDiscreteDynamicsWorld* m_physics_world;
     std::map<unsigned long, btRigidBody*> u_rigid_bodies;
+    std::vector<CRigidBody*> u_script_bodies;
     PhysicsRenderer* u_physics_debug;
     float m_world_scale = 1;
 };
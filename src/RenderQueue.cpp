@@ -0,0 +1,173 @@
+#include "RenderQueue.h"
+#include "SceneNode.h"
+
+#include <algorithm>
+#include <cstring>
+
+// The top 16 bits of a positive float sort the same way as the float, which
+// is plenty of precision for ordering draws.
+static uint64_t depthKey(float depth)
+{
+    if(!(depth > 0))
+        return 0;
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    return bits >> 16;
+}
+
+// A node is drawn only if it and all of its ancestors render.
+static bool isRendered(const ISceneNode* node)
+{
+    for(; node; node = node->getParent())
+        if(!node->getRenders())
+            return false;
+    return true;
+}
+
+RenderQueue::~RenderQueue(void)
+{
+    if(m_instance_buffer)
+        g_gl_state.deleteBuffers(1, &m_instance_buffer);
+}
+
+void RenderQueue::add(ISceneNode* node)
+{
+    RenderPass pass = node->getPass();
+    if(pass < FIRST_PASS || pass >= LAST_PASS)
+        return;
+    m_passes[pass].push_back({0, node, true, -1, ~0u});
+}
+
+void RenderQueue::remove(ISceneNode* node)
+{
+    RenderPass pass = node->getPass();
+    if(pass < FIRST_PASS || pass >= LAST_PASS)
+        return;
+    std::vector<DrawItem>& items = m_passes[pass];
+    for(auto i = items.begin(); i != items.end(); ++i) {
+        if(i->node == node) {
+            if(i->proxy != -1)
+                m_tree.remove(i->proxy);
+            items.erase(i);
+            return;
+        }
+    }
+}
+
+// Still nodes cost a version check, and nodes that move within their leaf's
+// padded box don't touch the tree.
+void RenderQueue::refit(void)
+{
+    for(int pass : { STATIC_PASS, DYNAMIC_PASS, TRANSPARENT_PASS }) {
+        for(auto& i : m_passes[pass]) {
+            unsigned version = i.node->getBoundsVersion();
+            if(version == i.version)
+                continue;
+            i.version = version;
+            AABB bounds;
+            if(i.node->getWorldBounds(bounds)) {
+                if(i.proxy == -1)
+                    i.proxy = m_tree.insert(bounds, i.node);
+                else
+                    m_tree.move(i.proxy, bounds);
+            } else if(i.proxy != -1) {
+                m_tree.remove(i.proxy);
+                i.proxy = -1;
+            }
+        }
+    }
+}
+
+void RenderQueue::cull(const Frustum* frustum)
+{
+    refit();
+    m_stats = {0, 0, 0, 0, 0};
+
+    // Nodes in the tree start hidden and the ones the frustum reaches are
+    // shown again.
+    for(auto& pass : m_passes)
+        for(auto& i : pass)
+            i.node->setVisible(!frustum || i.proxy == -1);
+    if(frustum)
+        m_tree.query(*frustum, [](void* data) { static_cast<ISceneNode*>(data)->setVisible(true); });
+
+    for(auto& pass : m_passes) {
+        for(auto& i : pass) {
+            i.visible = i.node->getVisible();
+            if(frustum && i.proxy != -1) {
+                ++m_stats.tested;
+                if(!i.visible)
+                    ++m_stats.culled;
+            }
+        }
+    }
+}
+
+void RenderQueue::sort(const glm::mat4& view)
+{
+    for(int pass : { STATIC_PASS, DYNAMIC_PASS, TRANSPARENT_PASS }) {
+        std::vector<DrawItem>& items = m_passes[pass];
+        for(auto& i : items) {
+            glm::vec4 position = view * i.node->getWorldMatrix()[3];
+            uint64_t depth = depthKey(-position.z);
+            uint64_t state = i.node->getStateKey();
+            if(pass == TRANSPARENT_PASS)
+                i.key = (0xffff - depth) << 48 | state >> 16;
+            else
+                i.key = state | depth;
+        }
+        std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+    }
+}
+
+void RenderQueue::submit(IScene* scene, RenderPass pass)
+{
+    std::vector<DrawItem>& items = m_passes[pass];
+    auto drawn = [](const DrawItem& item) { return item.visible && isRendered(item.node); };
+
+    // Sorting by state puts nodes that can be instanced next to each other,
+    // so batches are runs that can be instanced with their first node.
+    m_batches.clear();
+    m_instances.clear();
+    for(unsigned i = 0; i < items.size(); ) {
+        if(!drawn(items[i])) {
+            ++i;
+            continue;
+        }
+        Batch batch = { items[i].node, (unsigned)m_instances.size(), 0 };
+        unsigned j = i + 1;
+        for(; j < items.size(); ++j) {
+            if(!drawn(items[j]))
+                continue;
+            if(!batch.node->canInstanceWith(items[j].node))
+                break;
+            if(batch.count == 0) {
+                m_instances.push_back(batch.node->getWorldMatrix());
+                batch.count = 1;
+            }
+            m_instances.push_back(items[j].node->getWorldMatrix());
+            ++batch.count;
+        }
+        m_batches.push_back(batch);
+        i = j;
+    }
+
+    if(!m_instances.empty()) {
+        if(!m_instance_buffer)
+            glGenBuffers(1, &m_instance_buffer);
+        g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_instance_buffer);
+        glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(glm::mat4), m_instances.data(), GL_STREAM_DRAW);
+    }
+
+    for(auto& i : m_batches) {
+        if(i.count == 0) {
+            i.node->draw(scene, pass);
+            ++m_stats.drawn;
+        } else {
+            i.node->drawInstances(scene, pass, m_instance_buffer, i.first, i.count);
+            m_stats.drawn += i.count;
+            m_stats.instanced += i.count;
+            ++m_stats.batches;
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+#include "AABBTree.h"
+#include "Frustum.h"
+#include "RenderUtil.h"
+#include <glm/mat4x4.hpp>
+#include <cstdint>
+#include <vector>
+
+class IScene;
+class ISceneNode;
+
+struct DrawItem
+{
+    uint64_t key;
+    ISceneNode* node;
+    bool visible;
+    // The node's leaf in the bounds tree, or -1 if it has no bounds.
+    int proxy;
+    // The node's bounds version when the tree was last refit for it.
+    unsigned version;
+};
+
+struct CullStats
+{
+    unsigned tested;
+    unsigned culled;
+    unsigned drawn;
+    // Instanced draw calls and the nodes drawn by them, which are also
+    // counted in drawn.
+    unsigned batches;
+    unsigned instanced;
+};
+
+// Nodes are bucketed by pass when they join a scene, so drawing a pass is one
+// loop over the nodes that are actually in it. Once a frame, the opaque passes
+// are sorted by state and then front to back, and the transparent pass back
+// to front. The other passes keep the order nodes were added in.
+//
+// Runs of nodes that can share an instanced draw are drawn with one call. Their
+// world matrices go into an instance buffer that's refilled once per pass.
+//
+// Nodes in the world space passes that have bounds are also kept in a bounds
+// tree, which culling and the scene's spatial queries walk instead of testing
+// every node. Only nodes whose bounds version changed are refit.
+class RenderQueue
+{
+public:
+    ~RenderQueue(void);
+    void add(ISceneNode* node);
+    void remove(ISceneNode* node);
+    // Refits the bounds tree and culls the world space passes against the
+    // frustum. Without one, every node is visible.
+    void cull(const Frustum* frustum);
+    void sort(const glm::mat4& view);
+    void submit(IScene* scene, RenderPass pass);
+    inline unsigned getCount(RenderPass pass) const { return m_passes[pass].size(); }
+    // Counts for the last frame.
+    inline const CullStats& getCullStats(void) const { return m_stats; }
+    // Leaf data is the ISceneNode. Bounds are as of the last cull.
+    inline const AABBTree& getBoundsTree(void) const { return m_tree; }
+private:
+    void refit(void);
+
+    std::vector<DrawItem> m_passes[LAST_PASS];
+    CullStats m_stats = {0, 0, 0, 0, 0};
+    AABBTree m_tree;
+
+    // count is 0 for nodes drawn on their own.
+    struct Batch
+    {
+        ISceneNode* node;
+        unsigned first;
+        unsigned count;
+    };
+    std::vector<Batch> m_batches;
+    std::vector<glm::mat4> m_instances;
+    GLuint m_instance_buffer = 0;
+};
+
+// Packs a node's GL state into the top 48 bits of a sort key.
+inline uint64_t makeStateKey(GLuint program, GLuint texture, GLuint model)
+{
+    return (uint64_t)(program & 0xffff) << 48 | (uint64_t)(texture & 0xffff) << 32 | (uint64_t)(model & 0xffff) << 16;
+}
+
+#endif
@@ -4,6 +4,52 @@
 #include <GLFW/glfw3.h>
 #include <string>
 
+GLStateCache g_gl_state;
+
+#ifdef GL_DEBUG
+static bool debug_output = false;
+
+static void GLAPIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* user)
+{
+    if(severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+        return;
+    std::string text = std::to_string(id) + ": " + message;
+    if(type == GL_DEBUG_TYPE_ERROR)
+        warn("OpenGL error " + text);
+    else if(severity == GL_DEBUG_SEVERITY_LOW)
+        info("OpenGL debug message " + text);
+    else
+        warn("OpenGL debug message " + text);
+}
+#endif
+
+void bindFrameUniforms(GLuint program)
+{
+    GLuint index = glGetUniformBlockIndex(program, "Frame");
+    if(index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, index, FRAME_UNIFORM_BINDING);
+}
+
+bool enableGLDebugOutput(void)
+{
+#ifdef GL_DEBUG
+    if(!GLEW_KHR_debug)
+        return false;
+    // Synchronous so the messages come from inside the offending call, which
+    // puts it on the stack in a debugger.
+    glEnable(GL_DEBUG_OUTPUT);
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageCallback(debugCallback, NULL);
+    debug_output = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef GL_DEBUG
+// Errors are already reported by the debug callback when there is one, but
+// they're still cleared here so callers can tell a call failed.
 bool _checkGLError(const char* file, unsigned line) {
     GLenum error;
     bool error_found = false;
@@ -11,6 +57,8 @@ bool _checkGLError(const char* file, unsigned line) {
         error = glGetError();
         if(error != GL_NO_ERROR) {
             error_found = true;
+            if(debug_output)
+                continue;
             //std::string message;
 
             switch(error) {
@@ -36,3 +84,135 @@ bool _checkGLError(const char* file, unsigned line) {
     } while(error != GL_NO_ERROR);
     return error_found;
 }
+#endif
+
+void GLStateCache::useProgram(GLuint program)
+{
+    if(issue(program != m_program)) {
+        glUseProgram(program);
+        m_program = program;
+    }
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+    GLuint* bound = nullptr;
+    if(target == GL_ARRAY_BUFFER)
+        bound = &m_array_buffer;
+    else if(target == GL_UNIFORM_BUFFER)
+        bound = &m_uniform_buffer;
+    else if(target == GL_ELEMENT_ARRAY_BUFFER)
+        bound = &m_vertex_arrays[m_vertex_array].element_buffer;
+    if(issue(!bound || *bound != buffer)) {
+        glBindBuffer(target, buffer);
+        if(bound)
+            *bound = buffer;
+    }
+}
+
+// Indexed bindings aren't tracked, since they change about once a frame.
+void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    issue(true);
+    glBindBufferBase(target, index, buffer);
+    if(target == GL_UNIFORM_BUFFER)
+        m_uniform_buffer = buffer;
+}
+
+void GLStateCache::bindVertexArray(GLuint vertex_array)
+{
+    if(issue(vertex_array != m_vertex_array)) {
+        glBindVertexArray(vertex_array);
+        m_vertex_array = vertex_array;
+    }
+}
+
+void GLStateCache::activeTexture(GLenum unit)
+{
+    if(issue(unit - GL_TEXTURE0 != m_texture_unit)) {
+        glActiveTexture(unit);
+        m_texture_unit = unit - GL_TEXTURE0;
+    }
+}
+
+// Only 2D bindings on the first few units are tracked.
+void GLStateCache::bindTexture(GLenum target, GLuint texture)
+{
+    bool tracked = target == GL_TEXTURE_2D && m_texture_unit < TEXTURE_UNITS;
+    if(issue(!tracked || m_textures[m_texture_unit] != texture)) {
+        glBindTexture(target, texture);
+        if(tracked)
+            m_textures[m_texture_unit] = texture;
+    }
+}
+
+// Indices past 31, which includes the -1 from a missing attribute, aren't
+// tracked.
+void GLStateCache::enableAttrib(GLuint index)
+{
+    uint32_t& attribs = m_vertex_arrays[m_vertex_array].attribs;
+    bool tracked = index < 32;
+    if(issue(!tracked || !(attribs & 1u << index))) {
+        glEnableVertexAttribArray(index);
+        if(tracked)
+            attribs |= 1u << index;
+    }
+}
+
+void GLStateCache::disableAttrib(GLuint index)
+{
+    uint32_t& attribs = m_vertex_arrays[m_vertex_array].attribs;
+    bool tracked = index < 32;
+    if(issue(!tracked || attribs & 1u << index)) {
+        glDisableVertexAttribArray(index);
+        if(tracked)
+            attribs &= ~(1u << index);
+    }
+}
+
+// Deleting a bound object unbinds it, and its name may be handed out again.
+void GLStateCache::deleteProgram(GLuint program)
+{
+    if(program == m_program)
+        m_program = 0;
+    glDeleteProgram(program);
+}
+
+void GLStateCache::deleteBuffers(GLsizei count, const GLuint* buffers)
+{
+    for(GLsizei i = 0; i < count; ++i) {
+        if(buffers[i] == m_array_buffer)
+            m_array_buffer = 0;
+        if(buffers[i] == m_uniform_buffer)
+            m_uniform_buffer = 0;
+        for(auto& j : m_vertex_arrays)
+            if(buffers[i] == j.second.element_buffer)
+                j.second.element_buffer = 0;
+    }
+    glDeleteBuffers(count, buffers);
+}
+
+void GLStateCache::deleteVertexArrays(GLsizei count, const GLuint* vertex_arrays)
+{
+    for(GLsizei i = 0; i < count; ++i) {
+        if(vertex_arrays[i] == m_vertex_array)
+            m_vertex_array = 0;
+        m_vertex_arrays.erase(vertex_arrays[i]);
+    }
+    glDeleteVertexArrays(count, vertex_arrays);
+}
+
+void GLStateCache::deleteTextures(GLsizei count, const GLuint* textures)
+{
+    for(GLsizei i = 0; i < count; ++i)
+        for(auto& j : m_textures)
+            if(textures[i] == j)
+                j = 0;
+    glDeleteTextures(count, textures);
+}
+
+void GLStateCache::endFrame(void)
+{
+    m_last_frame = m_frame;
+    m_frame = {0, 0};
+}
@@ -1,7 +1,11 @@
 #ifndef RENDER_UTIL
 #define RENDER_UTIL
 #include <GL/glew.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
 
 enum RenderPass
 {
@@ -16,10 +20,99 @@ enum RenderPass
     LAST_PASS
 };
 
+// Attribute locations that shaders are linked with, so that vertex arrays set
+// up by models work with any shader. instance_world takes four locations.
+enum VertexAttrib
+{
+    ATTRIB_POSITION = 0,
+    ATTRIB_UV,
+    ATTRIB_NORMAL,
+    ATTRIB_INSTANCE_WORLD
+};
+
 const unsigned MAX_PARTICLES = 100000;
 
+// Camera constants that the scene uploads once a frame, laid out to match the
+// std140 Frame block in FRAME_UNIFORM_BLOCK. Shaders that declare the block
+// get them without any per draw uniforms.
+struct FrameUniforms
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 view_projection;
+    // w is always 1.
+    glm::vec4 camera_position;
+    // Width and height in pixels, then their reciprocals.
+    glm::vec4 viewport;
+};
+const GLuint FRAME_UNIFORM_BINDING = 0;
+// Points the program's Frame block at FRAME_UNIFORM_BINDING, if it has one.
+void bindFrameUniforms(GLuint program);
+
+// glGetError stalls the pipeline, so errors are only checked in GL_DEBUG
+// builds. Elsewhere checkGLError never finds one.
+#ifdef GL_DEBUG
 bool _checkGLError(const char* file, unsigned line);
 #define checkGLError() _checkGLError(__FILE__, __LINE__)
+#else
+inline bool checkGLError(void) { return false; }
+#endif
+// In GL_DEBUG builds, routes driver messages to the log through KHR_debug if
+// the context has it. Returns whether it does.
+bool enableGLDebugOutput(void);
+
+struct GLStateStats
+{
+    unsigned issued;
+    unsigned skipped;
+};
+
+// Shadows the binding state that draw code changes most, and skips calls that
+// wouldn't change it. All such calls, including deleting bound objects, have
+// to go through here or the shadow goes stale.
+//
+// Element array bindings and attribute enables belong to the bound vertex
+// array and are tracked per vertex array.
+class GLStateCache
+{
+public:
+    void useProgram(GLuint program);
+    void bindBuffer(GLenum target, GLuint buffer);
+    // Also binds buffer to target, as glBindBufferBase does.
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    void bindVertexArray(GLuint vertex_array);
+    void activeTexture(GLenum unit);
+    void bindTexture(GLenum target, GLuint texture);
+    void enableAttrib(GLuint index);
+    void disableAttrib(GLuint index);
+    void deleteProgram(GLuint program);
+    void deleteBuffers(GLsizei count, const GLuint* buffers);
+    void deleteVertexArrays(GLsizei count, const GLuint* vertex_arrays);
+    void deleteTextures(GLsizei count, const GLuint* textures);
+    // Starts counting a new frame. The counts are for the last whole frame.
+    void endFrame(void);
+    inline const GLStateStats& getStats(void) const { return m_last_frame; }
+private:
+    static const unsigned TEXTURE_UNITS = 16;
+    struct VertexArrayState
+    {
+        GLuint element_buffer;
+        uint32_t attribs;
+    };
+    inline bool issue(bool changed) { if(changed) ++m_frame.issued; else ++m_frame.skipped; return changed; }
+
+    GLuint m_program = 0;
+    GLuint m_array_buffer = 0;
+    GLuint m_uniform_buffer = 0;
+    GLuint m_vertex_array = 0;
+    unsigned m_texture_unit = 0;
+    GLuint m_textures[TEXTURE_UNITS] = { 0 };
+    std::unordered_map<GLuint, VertexArrayState> m_vertex_arrays;
+    GLStateStats m_frame = {0, 0};
+    GLStateStats m_last_frame = {0, 0};
+};
+
+extern GLStateCache g_gl_state;
 
 extern GLuint WIREFRAME_PROGRAM;
 extern GLuint SPRITE_PROGRAM;
@@ -27,6 +120,9 @@ extern GLuint LETTERBOX_PROGRAM;
 extern GLuint PARTICLE_PROGRAM;
 extern GLuint TEXT_PROGRAM;
 extern GLuint QUAD_BUFFER;
+// For draws that aren't of a model and set their attribute pointers each
+// time.
+extern GLuint STREAM_VERTEX_ARRAY;
 extern GLuint BLANK_TEXTURE;
 
 struct Texture
@@ -23,36 +23,50 @@
 #define VERTEX_SHADER_SUFFIX ".vert"
 #define FRAGMENT_SHADER_SUFFIX ".frag"
 #define SCRIPT_SUFFIX ".lua"
+#define SCRIPT_CACHE_SUFFIX ".luac"
 #define TEXTURE_SUFFIX ".png"
 
+// Matches FrameUniforms in RenderUtil.h. Shaders loaded from files have to
+// declare it themselves.
+#define FRAME_UNIFORM_BLOCK \
+"layout(std140) uniform Frame {\n" \
+"mat4 view;\n" \
+"mat4 projection;\n" \
+"mat4 view_projection;\n" \
+"vec4 camera_position;\n" \
+"vec4 viewport;\n" \
+"};\n"
+
 static const char* WIREFRAME_VERTEX_SHADER[] =
-{"# version 120\n"
-"attribute vec3 vertex_pos;\n"
-"attribute vec3 vertex_color;\n"
-"varying vec3 color;"
-"uniform mat4 view_projection;\n"
+{"# version 330\n"
+FRAME_UNIFORM_BLOCK
+"in vec3 vertex_pos;\n"
+"in vec3 vertex_color;\n"
+"out vec3 color;"
 "void main() {\n"
 "gl_Position = view_projection * vec4(vertex_pos, 1.0);\n"
 "color = vertex_color;"
 "}"};
 static const char* WIREFRAME_FRAGMENT_SHADER[] =
-{"# version 120\n"
-"varying vec3 color;"
+{"# version 330\n"
+"in vec3 color;"
+"out vec4 frag_color;\n"
 "void main() {\n"
-"gl_FragColor = vec4(color, 1);"
+"frag_color = vec4(color, 1);"
 "}"};
 static const char* SPRITE_VERTEX_SHADER[] =
 {"# version 330\n"
-"attribute vec3 vertex_pos;\n"
+FRAME_UNIFORM_BLOCK
+"in vec3 vertex_pos;\n"
 "out vec2 uv;\n"
-"uniform vec3 right;\n"
-"uniform vec3 up;\n"
 "uniform vec2 dims;\n"
-"uniform mat4 model_view_projection;\n"
+"uniform mat4 world;\n"
 "void main() {\n"
+"vec3 right = vec3(view[0][0], view[1][0], view[2][0]);\n"
+"vec3 up = vec3(view[0][1], view[1][1], view[2][1]);\n"
 "uv = (vertex_pos.xy - vec2(0.5, 0.5)) + 1;\n"// TODO: Might just want to add uvs to the buffer, it's likely cheaper in the long run
 "vec3 wvp = right * vertex_pos.x * dims.x + -up * vertex_pos.y * dims.y;\n"
-"gl_Position = model_view_projection * vec4(wvp, 1.0);\n"
+"gl_Position = view_projection * world * vec4(wvp, 1.0);\n"
 "}"};
 static const char* SPRITE_FRAGMENT_SHADER[] =
 {"# version 330\n"
@@ -66,30 +80,31 @@ static const char* SPRITE_FRAGMENT_SHADER[] =
 "discard;\n"
 "}"};
 static const char* PARTICLE_VERTEX_SHADER[] =
-{"# version 120\n"
-"attribute vec3 vertex_pos;\n"
-"varying vec2 uv;\n"
-"varying vec4 p_color;\n"
-"uniform vec3 right;\n"
-"uniform vec3 up;\n"
-"attribute vec3 position;\n"
-"attribute vec4 color;\n"
+{"# version 330\n"
+FRAME_UNIFORM_BLOCK
+"in vec3 vertex_pos;\n"
+"out vec2 uv;\n"
+"out vec4 p_color;\n"
+"in vec3 position;\n"
+"in vec4 color;\n"
 "uniform vec2 dims;\n"
-"uniform mat4 model_view_projection;\n"
 "void main() {\n"
+"vec3 right = vec3(view[0][0], view[1][0], view[2][0]);\n"
+"vec3 up = vec3(view[0][1], view[1][1], view[2][1]);\n"
 "uv = (vertex_pos.xy - vec2(0.5, 0.5)) + 1;\n"
 "p_color = color;"
 "vec3 wvp = position + right * vertex_pos.x * dims.x + up * vertex_pos.y * dims.y;\n"
-"gl_Position = model_view_projection * vec4(wvp, 1.0);\n"
+"gl_Position = view_projection * vec4(wvp, 1.0);\n"
 "}"};
 static const char* PARTICLE_FRAGMENT_SHADER[] =
-{"# version 120\n"
-"varying vec2 uv;\n"
-"varying vec4 p_color;\n"
+{"# version 330\n"
+"in vec2 uv;\n"
+"in vec4 p_color;\n"
 "uniform sampler2D texture;\n"
+"out vec4 frag_color;\n"
 "void main() {\n"
-"gl_FragColor = p_color * texture2D(texture, uv);\n"
-"if(gl_FragColor.a == 0)\n"
+"frag_color = p_color * texture2D(texture, uv);\n"
+"if(frag_color.a == 0)\n"
 "discard;\n"
 "}"};
 static const char* LETTERBOX_VERTEX_SHADER[] =
@@ -108,23 +123,27 @@ static const char* LETTERBOX_FRAGMENT_SHADER[] =
 "frag_color = color;\n"
 "}"};
 
+// world is already in clip space when screen_space is set.
 static const char* TEXT_VERTEX_SHADER[] =
-{"# version 120\n"
-"attribute vec3 vertex_pos;\n"
-"varying vec2 uv;\n"
-"uniform mat4 model_view_projection;\n"
+{"# version 330\n"
+FRAME_UNIFORM_BLOCK
+"in vec3 vertex_pos;\n"
+"out vec2 uv;\n"
+"uniform mat4 world;\n"
+"uniform bool screen_space;\n"
 "void main() {\n"
 "uv = (vertex_pos.xy + vec2(0.5, 0.5)) * -1 + 1;\n"// TODO: Might just want to add uvs to the buffer, it's likely cheaper in the long run
-"gl_Position = model_view_projection * vec4(vertex_pos, 1.0);\n"
+"gl_Position = (screen_space ? world : view_projection * world) * vec4(vertex_pos, 1.0);\n"
 "}"};
 static const char* TEXT_FRAGMENT_SHADER[] =
-{"# version 120\n"
-"varying vec2 uv;\n"
+{"# version 330\n"
+"in vec2 uv;\n"
 "uniform vec3 color;\n"
 "uniform sampler2D texture;\n"
+"out vec4 frag_color;\n"
 "void main() {\n"
-"gl_FragColor = vec4(color, texture2D(texture, uv).r);\n"
-"if(gl_FragColor.a <= 0.1)\n"
+"frag_color = vec4(color, texture2D(texture, uv).r);\n"
+"if(frag_color.a <= 0.1)\n"
 "discard;\n"
 "}"};
 
@@ -19,6 +19,7 @@ GLuint PARTICLE_PROGRAM;
 GLuint TEXT_PROGRAM;
 GLuint LETTERBOX_PROGRAM;
 GLuint QUAD_BUFFER;
+GLuint STREAM_VERTEX_ARRAY;
 GLuint BLANK_TEXTURE;
 
 DFBaseResourceManager::~DFBaseResourceManager(void)
@@ -53,6 +54,7 @@ bool DFBaseResourceManager::initialize(void)
     glAttachShader(WIREFRAME_PROGRAM, vertex_shader);
     glAttachShader(WIREFRAME_PROGRAM, fragment_shader);
     glLinkProgram(WIREFRAME_PROGRAM);
+    bindFrameUniforms(WIREFRAME_PROGRAM);
     if(checkGLError())
         return false;
     
@@ -69,6 +71,7 @@ bool DFBaseResourceManager::initialize(void)
     glAttachShader(SPRITE_PROGRAM, vertex_shader);
     glAttachShader(SPRITE_PROGRAM, fragment_shader);
     glLinkProgram(SPRITE_PROGRAM);
+    bindFrameUniforms(SPRITE_PROGRAM);
     if(checkGLError())
         return false;
     glGetShaderInfoLog(vertex_shader, 1024, &len, log);
@@ -92,6 +95,7 @@ bool DFBaseResourceManager::initialize(void)
     glAttachShader(PARTICLE_PROGRAM, vertex_shader);
     glAttachShader(PARTICLE_PROGRAM, fragment_shader);
     glLinkProgram(PARTICLE_PROGRAM);
+    bindFrameUniforms(PARTICLE_PROGRAM);
     if(checkGLError())
         return false;
     glGetShaderInfoLog(vertex_shader, 1024, &len, log);
@@ -115,6 +119,7 @@ bool DFBaseResourceManager::initialize(void)
     glAttachShader(TEXT_PROGRAM, vertex_shader);
     glAttachShader(TEXT_PROGRAM, fragment_shader);
     glLinkProgram(TEXT_PROGRAM);
+    bindFrameUniforms(TEXT_PROGRAM);
     if(checkGLError())
         return false;
     glGetShaderInfoLog(vertex_shader, 1024, &len, log);
@@ -160,11 +165,12 @@ bool DFBaseResourceManager::initialize(void)
 
 
     glGenBuffers(1, &QUAD_BUFFER);
-    glBindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
 	glBufferData(GL_ARRAY_BUFFER, 18 * sizeof(float), QUAD_BUFFER_DATA, GL_STATIC_DRAW);
+    glGenVertexArrays(1, &STREAM_VERTEX_ARRAY);
 
     glGenTextures(1, &BLANK_TEXTURE);
-    glBindTexture(GL_TEXTURE_2D, BLANK_TEXTURE);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, BLANK_TEXTURE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -684,6 +690,7 @@ GLuint DFBaseResourceManager::_loadProgram(std::string id)
     glAttachShader(program, vertex_shader);
     glAttachShader(program, fragment_shader);
     glLinkProgram(program);
+    bindFrameUniforms(program);
     checkGLError();
     GLsizei len;
     char log[1024];
@@ -740,7 +747,12 @@ IShader* DFBaseResourceManager::_loadShader(std::string id, std::string name)
     glCompileShader(fragment_shader);
     glAttachShader(program, vertex_shader);
     glAttachShader(program, fragment_shader);
+    glBindAttribLocation(program, ATTRIB_POSITION, "vertex_pos");
+    glBindAttribLocation(program, ATTRIB_UV, "vertex_uv");
+    glBindAttribLocation(program, ATTRIB_NORMAL, "vertex_normal");
+    glBindAttribLocation(program, ATTRIB_INSTANCE_WORLD, "instance_world");
     glLinkProgram(program);
+    bindFrameUniforms(program);
     checkGLError();
     GLsizei len;
     char log[1024];
@@ -811,7 +823,7 @@ Texture* DFBaseResourceManager::_loadTexture(std::string id, std::string name)
 	Texture* texture = new Texture();
     texture->name = name;
 	glGenTextures(1, &texture->texture_handle);
-	glBindTexture(GL_TEXTURE_2D, texture->texture_handle);
+	g_gl_state.bindTexture(GL_TEXTURE_2D, texture->texture_handle);
 	
 	FILE* infile = fopen((getPath() + "/" + id).c_str(), "rb");
 	if(!infile) {
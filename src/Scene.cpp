@@ -6,41 +6,18 @@
 #include "Scene.h"
 #include "SceneNode.h"
 #include "Util.h"
+#include <algorithm>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <stack>
 
 using namespace rapidxml;
 
-glm::mat4 MatrixStack::getMatrix(void) const
-{
-    if(m_is_empty)
-        return glm::mat4(1.0f);
-
-    return m_result_stack.top();
-}
-
-void MatrixStack::push(glm::mat4 matrix)
-{
-// Multiply the matrix being added by the top of the stack.
-// That way, geting the result is significantly faster.
-    if(m_is_empty) {
-        m_result_stack.push(matrix);
-        m_is_empty = false;
-    } else
-        m_result_stack.push(m_result_stack.top() * matrix);
-}
-
-void MatrixStack::pop(void)
-{
-    if(!m_is_empty) {
-        m_result_stack.pop();
-        if(m_result_stack.empty())
-            m_is_empty = true;
-    }
-}
-
 Scene::Scene(void)
 {
     m_view_dims = glm::vec2(800, 600);
     m_root_node = new SceneNode();
+    m_root_node->attach(this);
     glGenFramebuffers(1, &m_light_fbo);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_light_fbo);
     glGenTextures(4, m_light_textures);
@@ -48,7 +25,7 @@ Scene::Scene(void)
     glGenTextures(1, &m_final_texture);
     glGenTextures(1, &m_specular_texture);
     for(int i = 0; i < 4; ++i) {
-        glBindTexture(GL_TEXTURE_2D, m_light_textures[i]);
+        g_gl_state.bindTexture(GL_TEXTURE_2D, m_light_textures[i]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_view_dims.x, m_view_dims.y, 0, GL_RGBA, GL_FLOAT, NULL);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -60,16 +37,16 @@ Scene::Scene(void)
     m_diffuse_t_uniform = glGetUniformLocation(u_program, "diffusetex");
     m_specular_t_uniform = glGetUniformLocation(u_program, "speculartex");
 
-    glBindTexture(GL_TEXTURE_2D, m_z_texture);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, m_z_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, m_view_dims.x, m_view_dims.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_z_texture, 0);
 
-    glBindTexture(GL_TEXTURE_2D, m_final_texture);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, m_final_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_view_dims.x, m_view_dims.y, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, m_final_texture, 0);
-    glBindTexture(GL_TEXTURE_2D, m_specular_texture);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, m_specular_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_view_dims.x, m_view_dims.y, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -89,18 +66,35 @@ Scene::Scene(void)
         error("Failed to init framebuffer");
     }
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    glGenBuffers(1, &m_frame_uniforms);
+    g_gl_state.bindBuffer(GL_UNIFORM_BUFFER, m_frame_uniforms);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_STREAM_DRAW);
 }
 
 Scene::~Scene(void)
 {
+    g_gl_state.deleteBuffers(1, &m_frame_uniforms);
     glDeleteFramebuffers(1, &m_light_fbo);
-    glDeleteTextures(4, m_light_textures);
-    glDeleteTextures(1, &m_z_texture);
+    g_gl_state.deleteTextures(4, m_light_textures);
+    g_gl_state.deleteTextures(1, &m_z_texture);
+    m_root_node->deleteChildren();
     delete m_root_node;
 }
 
 void Scene::render(void)
 {
+    m_root_node->updateTransforms();
+    m_transforms.update();
+    if(m_active_camera) {
+        Frustum frustum(m_active_camera->getProjectionMatrix() * m_active_camera->getViewMatrix());
+        m_render_queue.cull(&frustum);
+    } else {
+        m_render_queue.cull(NULL);
+    }
+    m_render_queue.sort(getActiveViewMatrix());
+    updateFrameUniforms();
+
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_light_fbo);
     glDrawBuffer(GL_COLOR_ATTACHMENT4);
     glClearColor(0, 0, 0, 0);
@@ -115,9 +109,7 @@ void Scene::render(void)
     checkGLError();
 
     for(int pass = FIRST_PASS; pass != LIGHTING_PASS; ++pass) {
-        if(m_root_node != nullptr) {
-            m_root_node->drawChildren(this, static_cast<RenderPass>(pass));
-        }
+        m_render_queue.submit(this, static_cast<RenderPass>(pass));
         checkGLError();
     }
     glDepthMask(GL_FALSE);
@@ -138,40 +130,41 @@ void Scene::render(void)
     checkGLError();
 
     for (unsigned int i = 0 ; i < 4; i++) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, m_light_textures[i]);
+        g_gl_state.activeTexture(GL_TEXTURE0 + i);
+        g_gl_state.bindTexture(GL_TEXTURE_2D, m_light_textures[i]);
     }
-    m_root_node->drawChildren(this, LIGHTING_PASS);
+    m_render_queue.submit(this, LIGHTING_PASS);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     glBindFramebuffer(GL_READ_FRAMEBUFFER, m_light_fbo);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 
-    glUseProgram(u_program);
-    glEnableVertexAttribArray(m_vertex_attrib);
-    glBindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
+    g_gl_state.useProgram(u_program);
+    g_gl_state.bindVertexArray(STREAM_VERTEX_ARRAY);
+    g_gl_state.enableAttrib(m_vertex_attrib);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
     glVertexAttribPointer(m_vertex_attrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
     //glReadBuffer(GL_COLOR_ATTACHMENT0);
 
     //glReadBuffer(GL_COLOR_ATTACHMENT4);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_light_textures[0]);
+    g_gl_state.activeTexture(GL_TEXTURE0);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, m_light_textures[0]);
     glUniform1i(m_color_t_uniform, 0);
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, m_final_texture);
+    g_gl_state.activeTexture(GL_TEXTURE1);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, m_final_texture);
     glUniform1i(m_diffuse_t_uniform, 1);
     
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, m_specular_texture);
+    g_gl_state.activeTexture(GL_TEXTURE2);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, m_specular_texture);
     glUniform1i(m_specular_t_uniform, 2);
     checkGLError();
     glDrawArrays(GL_TRIANGLES, 0, 6);
     glBindFramebuffer(GL_READ_FRAMEBUFFER, m_light_fbo);
     checkGLError();
 
-    glDisableVertexAttribArray(m_vertex_attrib);
+    g_gl_state.disableAttrib(m_vertex_attrib);
 
     glDepthMask(GL_TRUE);
     glEnable(GL_DEPTH_TEST);
@@ -181,18 +174,9 @@ void Scene::render(void)
     glBlitFramebuffer(0, 0, m_view_dims.x, m_view_dims.y, 0, 0, m_view_dims.x, m_view_dims.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     for(int pass = LIGHTING_PASS + 1; pass != LAST_PASS; ++pass) {
-        if(m_root_node != nullptr) {
-            m_root_node->drawChildren(this, static_cast<RenderPass>(pass));
-        }
+        m_render_queue.submit(this, static_cast<RenderPass>(pass));
         checkGLError();
     }
-    //checkGLError();
-
-    for(int pass = LIGHTING_PASS + 1; pass != LAST_PASS; ++pass) {
-        if(m_root_node != nullptr) {
-            m_root_node->drawChildren(this, static_cast<RenderPass>(pass));
-        }
-    }
 }
 
 float Scene::getDPU(void) const
@@ -202,6 +186,24 @@ float Scene::getDPU(void) const
     return m_dpu;
 }
 
+// Shaders read the camera from the Frame block, so it's uploaded once here
+// instead of per draw.
+void Scene::updateFrameUniforms(void)
+{
+    FrameUniforms frame;
+    frame.view = getActiveViewMatrix();
+    frame.projection = getActiveProjectionMatrix();
+    frame.view_projection = frame.projection * frame.view;
+    frame.camera_position = glm::inverse(frame.view)[3];
+    frame.viewport = glm::vec4(m_view_dims, 1.0f / m_view_dims.x, 1.0f / m_view_dims.y);
+
+    g_gl_state.bindBuffer(GL_UNIFORM_BUFFER, m_frame_uniforms);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+    g_gl_state.bindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, m_frame_uniforms);
+    checkGLError();
+}
+
 glm::mat4 const Scene::getActiveProjectionMatrix(void) const
 {
     if(m_active_camera != nullptr)
@@ -262,21 +264,6 @@ bool Scene::removeChild(unsigned long id, ISceneNode* child)
     return false;
 }
 
-void Scene::pushMatrix(glm::mat4 matrix)
-{
-    m_matrices.push(matrix);
-}
-
-void Scene::popMatrix(void)
-{
-    m_matrices.pop();
-}
-
-glm::mat4 Scene::getMatrix(void) const
-{
-    return m_matrices.getMatrix();
-}
-
 void Scene::updateViewportSize(int width, int height)
 {
     if(m_active_camera)
@@ -284,10 +271,10 @@ void Scene::updateViewportSize(int width, int height)
     m_view_dims = glm::vec2(width, height);
 
     glDeleteFramebuffers(1, &m_light_fbo);
-    glDeleteTextures(4, m_light_textures);
-    glDeleteTextures(1, &m_z_texture);
-    glDeleteTextures(1, &m_final_texture);
-    glDeleteTextures(1, &m_specular_texture);
+    g_gl_state.deleteTextures(4, m_light_textures);
+    g_gl_state.deleteTextures(1, &m_z_texture);
+    g_gl_state.deleteTextures(1, &m_final_texture);
+    g_gl_state.deleteTextures(1, &m_specular_texture);
     glGenFramebuffers(1, &m_light_fbo);
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_light_fbo);
     glGenTextures(4, m_light_textures);
@@ -295,23 +282,23 @@ void Scene::updateViewportSize(int width, int height)
     glGenTextures(1, &m_final_texture);
     glGenTextures(1, &m_specular_texture);
     for(int i = 0; i < 4; ++i) {
-        glBindTexture(GL_TEXTURE_2D, m_light_textures[i]);
+        g_gl_state.bindTexture(GL_TEXTURE_2D, m_light_textures[i]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_view_dims.x, m_view_dims.y, 0, GL_RGBA, GL_FLOAT, NULL);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, m_light_textures[i], 0);
     }
 
-    glBindTexture(GL_TEXTURE_2D, m_z_texture);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, m_z_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, m_view_dims.x, m_view_dims.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_z_texture, 0);
 
-    glBindTexture(GL_TEXTURE_2D, m_final_texture);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, m_final_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_view_dims.x, m_view_dims.y, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, m_final_texture, 0);
-    glBindTexture(GL_TEXTURE_2D, m_specular_texture);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, m_specular_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_view_dims.x, m_view_dims.y, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -353,6 +340,22 @@ glm::vec2 Scene::getViewportRemainder(void) const
     return remainder;
 }
 
+void Scene::queryBox(const AABB& box, std::vector<ISceneNode*>& nodes) const
+{
+    nodes.clear();
+    m_render_queue.getBoundsTree().query(box, [&nodes](void* data) { nodes.push_back(static_cast<ISceneNode*>(data)); });
+}
+
+void Scene::queryRay(const glm::vec3& origin, const glm::vec3& direction, float max_distance, std::vector<ISceneNode*>& nodes) const
+{
+    std::vector<std::pair<float, ISceneNode*>> hits;
+    m_render_queue.getBoundsTree().raycast(origin, glm::normalize(direction), max_distance, [&hits](void* data, float distance) { hits.push_back(std::make_pair(distance, static_cast<ISceneNode*>(data))); });
+    std::sort(hits.begin(), hits.end());
+    nodes.clear();
+    for(auto& i : hits)
+        nodes.push_back(i.second);
+}
+
 void Scene::CGraphicsCreatedCallback(const IEvent& event)
 {
     if(event.getEventType() != CGraphicsCreatedEvent::m_type) {
@@ -1,30 +1,23 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include "RenderQueue.h"
 #include "RenderUtil.h"
+#include "TransformHierarchy.h"
 #include <glm/mat4x4.hpp>
 #include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
 #include <map>
 #include <rapidxml.hpp>
-#include <stack>
 #include <set>
+#include <vector>
 
 class ISceneNode;
+class SceneNode;
 class CameraSceneNode;
 class LightSceneNode;
 class IEvent;
 
-class MatrixStack
-{
-public:
-    glm::mat4 getMatrix(void) const;
-    void push(glm::mat4 matrix);
-    void pop(void);
-private:
-    std::stack<glm::mat4> m_result_stack;
-    bool m_is_empty = true;
-};
-
 class IScene
 {
 public:
@@ -34,15 +27,17 @@ public:
     virtual const glm::mat4 getActiveViewMatrix(void) const = 0;
     virtual bool addChild(unsigned long id, ISceneNode* child) = 0;
     virtual bool removeChild(unsigned long id, ISceneNode* child) = 0;
-    virtual void pushMatrix(glm::mat4 matrix) = 0;
-    virtual void popMatrix(void) = 0;
-    virtual glm::mat4 getMatrix(void) const = 0;
     virtual void updateViewportSize(int width, int height) = 0;
     virtual void updateViewportSize() = 0;
     virtual glm::vec2 getViewportSize(void) const = 0;
     virtual GLuint getLightTexture(int id) const = 0;
     virtual float getDPU(void) const = 0;
     virtual glm::vec2 getViewportRemainder(void) const = 0;
+    virtual const CullStats& getCullStats(void) const = 0;
+    // Finds drawable nodes by their bounds as of the last frame.
+    virtual void queryBox(const AABB& box, std::vector<ISceneNode*>& nodes) const = 0;
+    // Nearest first.
+    virtual void queryRay(const glm::vec3& origin, const glm::vec3& direction, float max_distance, std::vector<ISceneNode*>& nodes) const = 0;
     
     virtual void CGraphicsCreatedCallback(const IEvent& event) = 0;
     virtual void actorRemovedCallback(const IEvent& event) = 0;
@@ -66,33 +61,38 @@ public:
     virtual bool addLight(unsigned long id, LightSceneNode* light);
     virtual bool addCamera(unsigned long id, CameraSceneNode* camera);
     virtual bool removeChild(unsigned long id, ISceneNode* child);
-    virtual void pushMatrix(glm::mat4 matrix);
-    virtual void popMatrix(void);
-    virtual glm::mat4 getMatrix(void) const;
     virtual void updateViewportSize(int width, int height);
     virtual void updateViewportSize();
     virtual glm::vec2 getViewportSize(void) const { return m_view_dims; }
     virtual GLuint getLightTexture(int id) const { return m_light_textures[id]; }
     virtual float getDPU(void) const;
     virtual glm::vec2 getViewportRemainder(void) const;
+    virtual const CullStats& getCullStats(void) const { return m_render_queue.getCullStats(); }
+    virtual void queryBox(const AABB& box, std::vector<ISceneNode*>& nodes) const;
+    virtual void queryRay(const glm::vec3& origin, const glm::vec3& direction, float max_distance, std::vector<ISceneNode*>& nodes) const;
+    inline TransformHierarchy* getTransforms(void) { return &m_transforms; }
+    inline RenderQueue* getRenderQueue(void) { return &m_render_queue; }
 
     virtual void CGraphicsCreatedCallback(const IEvent& event);
     virtual void actorRemovedCallback(const IEvent& event);
 private:
     virtual void deleteRecursive(unsigned long id);
+    void updateFrameUniforms(void);
 
-    ISceneNode* m_root_node;
+    SceneNode* m_root_node;
     CameraSceneNode* m_active_camera = nullptr;
     std::map<unsigned long, LightSceneNode*> m_light_nodes;
     std::map<unsigned long, CameraSceneNode*> m_camera_nodes;
     std::map<unsigned long, std::set<ISceneNode*>> m_actor_nodes;
-    MatrixStack m_matrices;
+    TransformHierarchy m_transforms;
+    RenderQueue m_render_queue;
     glm::vec2 m_view_dims;
     GLuint m_light_textures[4] = { 0 };
     GLuint m_light_fbo = 0;
     GLuint m_z_texture = 0;
     GLuint m_final_texture = 0;
     GLuint m_specular_texture = 0;
+    GLuint m_frame_uniforms = 0;
 
     GLuint u_program = 0;
     GLuint m_vertex_attrib = 0;
@@ -3,8 +3,10 @@
 #include "ResourceManager.h"
 #include "Font.h"
 #include "PhysicsSystem.h"
+#include "RenderQueue.h"
 #include "Scene.h"
 #include "SceneNode.h"
+#include "ScriptSystem.h"
 #include "Shader.h"
 #include "Util.h"
 #include <glm/gtc/matrix_transform.hpp>
@@ -21,6 +23,7 @@ SceneNode::SceneNode()
 
 SceneNode::~SceneNode(void)
 {
+    detach();
     delete m_local_transform;
 }
 
@@ -35,12 +38,10 @@ void SceneNode::drawChildren(IScene* scene, RenderPass pass)
     if(!m_renders)
         return;
 
-    scene->pushMatrix(m_final_transform);
     for(ISceneNode* node : u_children) {
         node->draw(scene, pass);
         node->drawChildren(scene, pass);
     }
-    scene->popMatrix();
 }
 
 bool SceneNode::addChild(ISceneNode* child)
@@ -56,7 +57,7 @@ bool SceneNode::addChild(ISceneNode* child)
     }
     u_children.push_back(child);
     if(auto ch = dynamic_cast<SceneNode*>(child))
-        ch->setParent(nullptr);
+        ch->setParent(this);
     return true;
 }
 
@@ -117,17 +118,82 @@ bool SceneNode::fromXml(rapidxml::xml_node<>* node)
 void SceneNode::setParent(ISceneNode* parent)
 {
     u_parent = parent;
+    SceneNode* node = dynamic_cast<SceneNode*>(parent);
+    if(node && node->u_scene)
+        attach(node->u_scene, node->m_slot);
+    else
+        detach();
+}
+
+void SceneNode::attach(Scene* scene, int parent_slot)
+{
+    if(u_scene != scene) {
+        detach();
+        u_scene = scene;
+        m_slot = scene->getTransforms()->add();
+        m_source_version = ~0u;
+        m_local_version = ~0u;
+        scene->getRenderQueue()->add(this);
+    }
+    u_scene->getTransforms()->setParent(m_slot, parent_slot);
+    for(ISceneNode* node : u_children)
+        if(auto child = dynamic_cast<SceneNode*>(node))
+            child->attach(scene, m_slot);
 }
 
-void SceneNode::setTransform(Transform* trans)
+void SceneNode::detach(void)
 {
-    u_transform_source = trans;
-    m_final_transform = u_transform_source->getWorldTransform();
+    if(!u_scene)
+        return;
+    for(ISceneNode* node : u_children)
+        if(auto child = dynamic_cast<SceneNode*>(node))
+            child->detach();
+    u_scene->getRenderQueue()->remove(this);
+    u_scene->getTransforms()->remove(m_slot);
+    u_scene = nullptr;
+}
+
+// Only rebuilds the local matrix when one of its transforms has changed, so
+// still nodes cost a version check.
+void SceneNode::updateTransforms(void)
+{
+    if(u_scene) {
+        unsigned source_version = u_transform_source ? u_transform_source->getVersion() : 0;
+        unsigned local_version = m_local_transform->getVersion();
+        if(source_version != m_source_version || local_version != m_local_version) {
+            m_source_version = source_version;
+            m_local_version = local_version;
+            if(u_transform_source)
+                u_scene->getTransforms()->setLocal(m_slot, u_transform_source->getWorldTransform() * m_local_transform->getWorldTransform());
+            else
+                u_scene->getTransforms()->setLocal(m_slot, m_local_transform->getWorldTransform());
+        }
+    }
+    for(ISceneNode* node : u_children)
+        node->updateTransforms();
 }
 
-bool SceneNode::getVisible(void) const
+// The hierarchy's version also changes when an ancestor moves.
+unsigned SceneNode::getBoundsVersion(void) const
 {
-    return false;
+    unsigned version = m_bounds_version;
+    if(u_scene)
+        version += u_scene->getTransforms()->getVersion(m_slot);
+    return version;
+}
+
+const glm::mat4& SceneNode::getWorldMatrix(void) const
+{
+    if(u_scene)
+        return u_scene->getTransforms()->getWorld(m_slot);
+    return m_final_transform;
+}
+
+void SceneNode::setTransform(Transform* trans)
+{
+    u_transform_source = trans;
+    m_source_version = ~0u;
+    m_final_transform = u_transform_source->getWorldTransform();
 }
 
 void SceneNode::deleteChildren(void)
@@ -149,6 +215,7 @@ long SceneNode::getActor(void) const
 ModelSceneNode::ModelSceneNode(void)
 {
     u_attr_funcs = node_model_attr;
+    m_render_pass = DYNAMIC_PASS;
     u_model = g_game->resources()->getModel("default");
     u_shader = g_game->resources()->getShader("default");
     u_texture = g_game->resources()->getTexture("default");
@@ -167,8 +234,7 @@ void ModelSceneNode::draw(IScene* scene, RenderPass pass)
 {
     if(pass != m_render_pass || !m_renders)
         return;
-    m_final_transform = scene->getMatrix() * u_transform_source->getWorldTransform() * m_local_transform->getWorldTransform();
-    u_shader->prepareForRender(scene, u_model, m_final_transform, u_texture);
+    u_shader->prepareForRender(scene, u_model, getWorldMatrix(), u_texture);
 
     glDrawElements(GL_TRIANGLES, u_model->getIndexCount(), GL_UNSIGNED_INT, 0);
     checkGLError();
@@ -176,11 +242,39 @@ void ModelSceneNode::draw(IScene* scene, RenderPass pass)
     u_shader->postRender();
 }
 
+uint64_t ModelSceneNode::getStateKey(void) const
+{
+    return makeStateKey(u_shader ? u_shader->getProgram() : 0, u_texture ? u_texture->texture_handle : 0, u_model ? u_model->getVertexArray() : 0);
+}
+
+bool ModelSceneNode::canInstanceWith(const ISceneNode* other) const
+{
+    if(!u_shader || !u_shader->getInstanced())
+        return false;
+    const ModelSceneNode* node = dynamic_cast<const ModelSceneNode*>(other);
+    return node && node->u_model == u_model && node->u_shader == u_shader && node->u_texture == u_texture && node->m_render_pass == m_render_pass;
+}
+
+void ModelSceneNode::drawInstances(IScene* scene, RenderPass pass, GLuint buffer, unsigned first, unsigned count)
+{
+    if(pass != m_render_pass || !m_renders)
+        return;
+    u_shader->prepareForRender(scene, u_model, getWorldMatrix(), u_texture);
+    u_shader->bindInstances(buffer, first);
+
+    glDrawElementsInstanced(GL_TRIANGLES, u_model->getIndexCount(), GL_UNSIGNED_INT, 0, count);
+    checkGLError();
+
+    u_shader->postRender();
+}
+
 bool ModelSceneNode::fromXml(rapidxml::xml_node<>* node)
 {
     SceneNode::fromXml(node);
-    if(xml_attribute<>* model_att = node->first_attribute("mesh", 4, false))
+    if(xml_attribute<>* model_att = node->first_attribute("mesh", 4, false)) {
         u_model = g_game->resources()->getModel(model_att->value());
+        ++m_bounds_version;
+    }
 
     if(xml_attribute<>* shader_att = node->first_attribute("shader", 6, false))
         u_shader = g_game->resources()->getShader(shader_att->value());
@@ -189,10 +283,12 @@ bool ModelSceneNode::fromXml(rapidxml::xml_node<>* node)
     return true;
 }
 
-bool ModelSceneNode::getVisible(void)
+bool ModelSceneNode::getWorldBounds(AABB& bounds) const
 {
-    warn("Calculating visibility is unimplemented.");
-    return false;
+    if(!u_model)
+        return false;
+    bounds = u_model->getBounds().transformed(getWorldMatrix());
+    return true;
 }
 
 CameraSceneNode::CameraSceneNode() : SceneNode()
@@ -334,7 +430,6 @@ LightSceneNode::LightSceneNode(xml_node<>* node)
     m_normal_t_uniform = glGetUniformLocation(u_program, "normaltex");
     m_direction_uniform = glGetUniformLocation(u_program, "direction");
     m_position_t_uniform = glGetUniformLocation(u_program, "positiontex");
-    m_eye_position_uniform = glGetUniformLocation(u_program, "eye_position");
     m_color_uniform = glGetUniformLocation(u_program, "color");
     checkGLError();
 }
@@ -343,22 +438,21 @@ void LightSceneNode::draw(IScene* scene, RenderPass pass)
 {
     if(pass != m_render_pass || !m_renders)
         return;
-    glUseProgram(u_program);
+    g_gl_state.useProgram(u_program);
     checkGLError();
 
-    glm::mat4 view = glm::inverse(scene->getActiveViewMatrix());
-    glUniform3f(m_eye_position_uniform, view[3][0], view[3][1], view[3][2]);
     glUniform3f(m_direction_uniform, m_direction.x, m_direction.y, m_direction.z);
 
     glUniform4f(m_color_uniform, m_color.x, m_color.y, m_color.z, 1.0f);
     checkGLError();
-    glEnableVertexAttribArray(m_vertex_attrib);
-    glBindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
+    g_gl_state.bindVertexArray(STREAM_VERTEX_ARRAY);
+    g_gl_state.enableAttrib(m_vertex_attrib);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
     glVertexAttribPointer(m_vertex_attrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
     checkGLError();
 
-    //glActiveTexture(GL_TEXTURE0);
-    //glBindTexture(GL_TEXTURE_2D, texture);
+    //g_gl_state.activeTexture(GL_TEXTURE0);
+    //g_gl_state.bindTexture(GL_TEXTURE_2D, texture);
     glUniform1i(m_color_t_uniform, 0);
     glUniform1i(m_position_t_uniform, 1);
     glUniform1i(m_normal_t_uniform, 2);
@@ -366,7 +460,7 @@ void LightSceneNode::draw(IScene* scene, RenderPass pass)
     glDrawArrays(GL_TRIANGLES, 0, 6);
     checkGLError();
 
-    glDisableVertexAttribArray(m_vertex_attrib);
+    g_gl_state.disableAttrib(m_vertex_attrib);
 }
 
 bool LightSceneNode::fromXml(rapidxml::xml_node<>* node)
@@ -443,9 +537,7 @@ BillboardSceneNode::BillboardSceneNode()
     m_vertex_position_attrib = glGetAttribLocation(SPRITE_PROGRAM, "vertex_pos");
     m_texture_uniform = glGetUniformLocation(SPRITE_PROGRAM, "texture");
     m_color_uniform = glGetUniformLocation(SPRITE_PROGRAM, "color");
-    m_transform_uniform = glGetUniformLocation(SPRITE_PROGRAM, "model_view_projection");
-    m_up_uniform = glGetUniformLocation(SPRITE_PROGRAM, "up");
-    m_right_uniform = glGetUniformLocation(SPRITE_PROGRAM, "right");
+    m_transform_uniform = glGetUniformLocation(SPRITE_PROGRAM, "world");
     m_dims_uniform = glGetUniformLocation(SPRITE_PROGRAM, "dims");
     checkGLError();
 }
@@ -458,9 +550,7 @@ BillboardSceneNode::BillboardSceneNode(Texture* texture, RGBAColor color, Render
     m_vertex_position_attrib = glGetAttribLocation(SPRITE_PROGRAM, "vertex_pos");
     m_texture_uniform = glGetUniformLocation(SPRITE_PROGRAM, "texture");
     m_color_uniform = glGetUniformLocation(SPRITE_PROGRAM, "color");
-    m_transform_uniform = glGetUniformLocation(SPRITE_PROGRAM, "model_view_projection");
-    m_up_uniform = glGetUniformLocation(SPRITE_PROGRAM, "up");
-    m_right_uniform = glGetUniformLocation(SPRITE_PROGRAM, "right");
+    m_transform_uniform = glGetUniformLocation(SPRITE_PROGRAM, "world");
     m_dims_uniform = glGetUniformLocation(SPRITE_PROGRAM, "dims");
     checkGLError();
     m_color = color;
@@ -470,47 +560,54 @@ void BillboardSceneNode::draw(IScene* scene, RenderPass pass)
 {
     if(pass != m_render_pass || !m_renders)
         return;
-    m_final_transform = scene->getMatrix() * u_transform_source->getWorldTransform() * m_local_transform->getWorldTransform();
-
-    glUseProgram(SPRITE_PROGRAM);
+    g_gl_state.useProgram(SPRITE_PROGRAM);
     checkGLError();
 
-    glm::mat4 view = scene->getActiveViewMatrix();
-    glm::mat4 world = scene->getMatrix() * m_final_transform;
+    glm::mat4 world = getWorldMatrix();
     glm::vec3 pos;
     glm::vec3 scale;
     glm::quat rot;
     glm::vec3 skew;
     glm::vec4 persp;
     glm::decompose(world, scale, rot, pos, skew, persp);
-    glm::mat4 transform_matrix = scene->getActiveProjectionMatrix() * view * glm::translate(glm::mat4(1), pos) * glm::mat4_cast(glm::quat(glm::vec3(0.0f, 0.0f, -glm::roll(rot)))) * glm::scale(glm::mat4(1), scale);
+    glm::mat4 transform_matrix = glm::translate(glm::mat4(1), pos) * glm::mat4_cast(glm::quat(glm::vec3(0.0f, 0.0f, -glm::roll(rot)))) * glm::scale(glm::mat4(1), scale);
     glUniformMatrix4fv(m_transform_uniform, 1, GL_FALSE, &transform_matrix[0][0]);
-    glUniform3f(m_up_uniform, view[0][1], view[1][1], view[2][1]);
     checkGLError();
-    glUniform3f(m_right_uniform, view[0][0], view[1][0], view[2][0]);
-    glUniform2f(m_dims_uniform, (float)u_texture->texture_width * scene->getDPU(), (float)u_texture->texture_height * scene->getDPU());
+    if(m_dpu != scene->getDPU()) {
+        m_dpu = scene->getDPU();
+        ++m_bounds_version;
+    }
+    glUniform2f(m_dims_uniform, (float)u_texture->texture_width * m_dpu, (float)u_texture->texture_height * m_dpu);
     glUniform4f(m_color_uniform, m_color.x, m_color.y, m_color.z, m_color.w);
-    glEnableVertexAttribArray(m_vertex_position_attrib);
-    glBindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
+    g_gl_state.bindVertexArray(STREAM_VERTEX_ARRAY);
+    g_gl_state.enableAttrib(m_vertex_position_attrib);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
     glVertexAttribPointer(m_vertex_position_attrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
     checkGLError();
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, u_texture->texture_handle);
+    g_gl_state.activeTexture(GL_TEXTURE0);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, u_texture->texture_handle);
     glUniform1i(m_texture_uniform, 0);
 
     glDrawArrays(GL_TRIANGLES, 0, 6);
     checkGLError();
 
-    glDisableVertexAttribArray(m_vertex_position_attrib);
+    g_gl_state.disableAttrib(m_vertex_position_attrib);
+}
+
+uint64_t BillboardSceneNode::getStateKey(void) const
+{
+    return makeStateKey(SPRITE_PROGRAM, u_texture ? u_texture->texture_handle : 0, QUAD_BUFFER);
 }
 
 bool BillboardSceneNode::fromXml(rapidxml::xml_node<>* node)
 {
     SceneNode::fromXml(node);
 
-    if(xml_attribute<>* tex_att = node->first_attribute("id", 2, false))
+    if(xml_attribute<>* tex_att = node->first_attribute("id", 2, false)) {
         u_texture = g_game->resources()->getTexture(tex_att->value());
+        ++m_bounds_version;
+    }
     if(xml_node<>* ncolor = node->first_node("color", 5, false)) {
         attr(ncolor, "r", &m_color.x);
         attr(ncolor, "g", &m_color.y);
@@ -520,10 +617,19 @@ bool BillboardSceneNode::fromXml(rapidxml::xml_node<>* node)
     return true;
 }
 
-bool BillboardSceneNode::getVisible(void)
+// The quad's size depends on the scene's DPU, so there are no bounds until
+// it has been drawn once. It always faces the camera, so the box is a cube
+// around its largest dimension.
+bool BillboardSceneNode::getWorldBounds(AABB& bounds) const
 {
-    warn("Calculating visibility is unimplemented.");
-    return false;
+    if(!u_texture || m_dpu <= 0)
+        return false;
+    const glm::mat4& world = getWorldMatrix();
+    float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+    float size = std::max(u_texture->texture_width, u_texture->texture_height) * m_dpu * scale;
+    glm::vec3 position(world[3]);
+    bounds = { position - glm::vec3(size), position + glm::vec3(size) };
+    return true;
 }
 
 ParticleSceneNode::ParticleSceneNode()
@@ -533,19 +639,16 @@ ParticleSceneNode::ParticleSceneNode()
     m_vertex_position_attrib = glGetAttribLocation(PARTICLE_PROGRAM, "vertex_pos");
     m_texture_uniform = glGetUniformLocation(PARTICLE_PROGRAM, "texture");
     m_color_attrib = glGetAttribLocation(PARTICLE_PROGRAM, "color");
-    m_transform_uniform = glGetUniformLocation(PARTICLE_PROGRAM, "model_view_projection");
     m_position_attrib = glGetAttribLocation(PARTICLE_PROGRAM, "position");
-    m_up_uniform = glGetUniformLocation(PARTICLE_PROGRAM, "up");
-    m_right_uniform = glGetUniformLocation(PARTICLE_PROGRAM, "right");
     m_dims_uniform = glGetUniformLocation(PARTICLE_PROGRAM, "dims");
     glGenBuffers(1, &m_particle_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, m_particle_buffer);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_particle_buffer);
     glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * sizeof(Particle), NULL, GL_STREAM_DRAW);
     glGenBuffers(1, &m_particle_buffer_p);
-    glBindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_p);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_p);
     glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
     glGenBuffers(1, &m_particle_buffer_c);
-    glBindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_c);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_c);
     glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
     checkGLError();
 }
@@ -559,20 +662,17 @@ ParticleSceneNode::ParticleSceneNode(Texture* texture, RGBAColor color, float ra
     m_vertex_position_attrib = glGetAttribLocation(PARTICLE_PROGRAM, "vertex_pos");
     m_texture_uniform = glGetUniformLocation(PARTICLE_PROGRAM, "texture");
     m_color_attrib = glGetAttribLocation(PARTICLE_PROGRAM, "color");
-    m_transform_uniform = glGetUniformLocation(PARTICLE_PROGRAM, "model_view_projection");
     m_position_attrib = glGetAttribLocation(PARTICLE_PROGRAM, "position");
-    m_up_uniform = glGetUniformLocation(PARTICLE_PROGRAM, "up");
-    m_right_uniform = glGetUniformLocation(PARTICLE_PROGRAM, "right");
     m_dims_uniform = glGetUniformLocation(PARTICLE_PROGRAM, "dims");
 
     glGenBuffers(1, &m_particle_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, m_particle_buffer);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_particle_buffer);
     glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * sizeof(Particle), NULL, GL_STREAM_DRAW);
     glGenBuffers(1, &m_particle_buffer_p);
-    glBindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_p);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_p);
     glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
     glGenBuffers(1, &m_particle_buffer_c);
-    glBindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_c);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_c);
     glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
     checkGLError();
     m_dims = dims;
@@ -588,23 +688,17 @@ void ParticleSceneNode::draw(IScene* scene, RenderPass pass)
     if(pass != m_render_pass || !m_renders)
         return;
     glDisable(GL_DEPTH_TEST);
-    glm::mat4 view = scene->getActiveViewMatrix();
-    m_last_cam = glm::vec3(glm::inverse(view)[3]);
+    m_last_cam = glm::vec3(glm::inverse(scene->getActiveViewMatrix())[3]);
 
     //std::sort(&m_particles[0], &m_particles[MAX_PARTICLES]);
 
-    m_final_transform = scene->getMatrix() * u_transform_source->getWorldTransform() * m_local_transform->getWorldTransform();
-
-    glUseProgram(PARTICLE_PROGRAM);
+    g_gl_state.useProgram(PARTICLE_PROGRAM);
     checkGLError();
 
-    glm::mat4 transform_matrix = scene->getActiveProjectionMatrix() * view;
-    glUniformMatrix4fv(m_transform_uniform, 1, GL_FALSE, &transform_matrix[0][0]);
-    glUniform3f(m_up_uniform, view[0][1], view[1][1], view[2][1]);
-    glUniform3f(m_right_uniform, view[0][0], view[1][0], view[2][0]);
     glUniform2f(m_dims_uniform, m_dims.x, m_dims.y);
-    glEnableVertexAttribArray(m_vertex_position_attrib);
-    glBindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
+    g_gl_state.bindVertexArray(STREAM_VERTEX_ARRAY);
+    g_gl_state.enableAttrib(m_vertex_position_attrib);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, QUAD_BUFFER);
     glVertexAttribPointer(m_vertex_position_attrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
     checkGLError();
 
@@ -613,21 +707,21 @@ void ParticleSceneNode::draw(IScene* scene, RenderPass pass)
         m_particle_color[i] = m_particles[i].color;
     }
 
-    glEnableVertexAttribArray(m_color_attrib);
-    glBindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_p);
+    g_gl_state.enableAttrib(m_color_attrib);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_p);
     glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
     glBufferSubData(GL_ARRAY_BUFFER, 0, m_particle_count * sizeof(glm::vec4), m_particle_color);
     glVertexAttribPointer(m_color_attrib, 4, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
-    glEnableVertexAttribArray(m_position_attrib);
-    glBindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_c);
+    g_gl_state.enableAttrib(m_position_attrib);
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, m_particle_buffer_c);
     glBufferData(GL_ARRAY_BUFFER, MAX_PARTICLES * sizeof(glm::vec3), NULL, GL_STREAM_DRAW);
     glBufferSubData(GL_ARRAY_BUFFER, 0, m_particle_count * sizeof(glm::vec3), m_particle_pos);
     glVertexAttribPointer(m_position_attrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
     checkGLError();
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, u_texture->texture_handle);
+    g_gl_state.activeTexture(GL_TEXTURE0);
+    g_gl_state.bindTexture(GL_TEXTURE_2D, u_texture->texture_handle);
     glUniform1i(m_texture_uniform, 0);
     checkGLError();
 
@@ -639,9 +733,9 @@ void ParticleSceneNode::draw(IScene* scene, RenderPass pass)
     glDrawArraysInstanced(GL_TRIANGLES, 0, 6, m_particle_count);
     checkGLError();
 
-    glDisableVertexAttribArray(m_vertex_position_attrib);
-    glDisableVertexAttribArray(m_color_attrib);
-    glDisableVertexAttribArray(m_position_attrib);
+    g_gl_state.disableAttrib(m_vertex_position_attrib);
+    g_gl_state.disableAttrib(m_color_attrib);
+    g_gl_state.disableAttrib(m_position_attrib);
     glVertexAttribDivisor(m_vertex_position_attrib, 0);
     glVertexAttribDivisor(m_color_attrib, 0);
     glVertexAttribDivisor(m_position_attrib, 0);
@@ -689,6 +783,13 @@ void ParticleSceneNode::update(float delta_time)
             particle.life.x -= delta_time;
             particle.velocity += particle.acceleration * delta_time;
             particle.position += particle.velocity * delta_time;
+            if(m_particle_count == 0) {
+                m_bounds.min = particle.position;
+                m_bounds.max = particle.position;
+            } else {
+                m_bounds.min = glm::min(m_bounds.min, particle.position);
+                m_bounds.max = glm::max(m_bounds.max, particle.position);
+            }
             particle.cam_distance = glm::length2(particle.position - m_last_cam);
             particle.color.w = particle.life.x / particle.life.y * m_starting_color.w;
             ++m_particle_count;
@@ -696,6 +797,8 @@ void ParticleSceneNode::update(float delta_time)
             particle.cam_distance = -1.0f;
         }
     }
+    // The particles move every update whether or not the emitter does.
+    ++m_bounds_version;
 }
 
 void ParticleSceneNode::createParticle(void)
@@ -732,10 +835,14 @@ void ParticleSceneNode::createParticle(void)
     }
 }
 
-bool ParticleSceneNode::getVisible(void)
+// Particles live in world space, so their bounds are tracked as they move.
+bool ParticleSceneNode::getWorldBounds(AABB& bounds) const
 {
-    warn("Calculating visibility is unimplemented.");
-    return false;
+    if(m_particle_count == 0)
+        return false;
+    float size = std::max(m_dims.x, m_dims.y);
+    bounds = { m_bounds.min - glm::vec3(size), m_bounds.max + glm::vec3(size) };
+    return true;
 }
 
 TextSceneNode::TextSceneNode()
@@ -757,8 +864,7 @@ void TextSceneNode::draw(IScene* scene, RenderPass pass)
 {
     if(pass != m_render_pass || !m_renders)
         return;
-    m_final_transform = scene->getMatrix() * u_transform_source->getWorldTransform() * m_local_transform->getWorldTransform();
-    u_font->draw(scene, m_text.c_str(), m_final_transform, m_size, m_color);
+    u_font->draw(scene, m_text.c_str(), getWorldMatrix(), m_size, m_color);
 }
 
 bool TextSceneNode::fromXml(rapidxml::xml_node<>* node)
@@ -772,16 +878,10 @@ bool TextSceneNode::fromXml(rapidxml::xml_node<>* node)
     return true;
 }
 
-bool TextSceneNode::getVisible(void)
-{
-    warn("Calculating visibility is unimplemented.");
-    return false;
-}
-
 int node_render(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access render state, but the Graphics Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -795,10 +895,17 @@ int node_render(lua_State* state)
     return 1;
 }
 
+int node_transform(lua_State* state)
+{
+    CGraphics* gfx = toInstance<CGraphics>(state, 1);
+    pushProxy(state, gfx->getNode()->getLocalTransform(), transform_funcs, transform_meta, transform_props);
+    return 1;
+}
+
 int model_model(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access a model, but the Graphics Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -815,7 +922,7 @@ int model_model(lua_State* state)
 int model_shader(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access a model, but the Graphics Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -832,7 +939,7 @@ int model_shader(lua_State* state)
 int model_texture(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access a model, but the Graphics Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -849,7 +956,7 @@ int model_texture(lua_State* state)
 int camera_sky(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access render state, but the Graphics Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -883,7 +990,7 @@ int camera_sky(lua_State* state)
 int billboard_texture(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access a billboard, but the Graphics Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -900,7 +1007,7 @@ int billboard_texture(lua_State* state)
 int billboard_color(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access a billboard, but the Graphics Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -939,7 +1046,7 @@ int billboard_color(lua_State* state)
 int particle_color(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access a particle system, but the Graphics Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -978,7 +1085,7 @@ int particle_color(lua_State* state)
 int particle_spawning(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access render state, but the Graphics Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -995,7 +1102,7 @@ int particle_spawning(lua_State* state)
 int particle_count(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access render state, but the Graphics Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -1008,7 +1115,7 @@ int particle_count(lua_State* state)
 int text_text(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access text, but the Text Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -1025,7 +1132,7 @@ int text_text(lua_State* state)
 int text_color(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access text, but the Text Component is missing its instance!");
     CGraphics* gfx = *static_cast<CGraphics**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
@@ -1,18 +1,22 @@
 #ifndef SCENE_NODE_H
 #define SCENE_NODE_H
 #include "Color.h"
+#include "Frustum.h"
 #include "Model.h"
 #include "RenderUtil.h"
+#include "ScriptBinding.h"
 #include "Transform.h"
 #include "Util.h"
 #include "XmlSerializable.h"
 #include <glm/mat4x4.hpp>
 #include <glm/vec2.hpp>
+#include <cstdint>
 #include <vector>
 
 class IScene;
 class IShader;
 class IFont;
+class Scene;
 
 class ISceneNode : public IXmlSerializable
 {
@@ -23,7 +27,14 @@ public:
     virtual bool addChild(ISceneNode* child) = 0;
     virtual bool removeChild(ISceneNode* child) = 0;
     virtual bool hasChild(ISceneNode* child) const = 0;
+    // Whether the node survived the last culling pass.
     virtual bool getVisible(void) const = 0;
+    virtual void setVisible(bool visible) = 0;
+    // Returns false if the node has no bounds and so is never culled.
+    virtual bool getWorldBounds(AABB& bounds) const = 0;
+    // Changes whenever the world bounds might have, so only nodes that moved
+    // need their bounds read again.
+    virtual unsigned getBoundsVersion(void) const = 0;
     virtual bool getRenders(void) const = 0;
     virtual void setRenders(bool visible) = 0;
     virtual void deleteChildren(void) = 0;
@@ -32,14 +43,26 @@ public:
     virtual void setTransform(Transform* trans) = 0;
     virtual void setLocalTransform(Transform* trans) = 0;
     virtual Transform* getLocalTransform(void) const = 0;
+    // Pushes changed transforms into the scene's hierarchy, for this node and
+    // everything under it.
+    virtual void updateTransforms(void) = 0;
+    virtual const glm::mat4& getWorldMatrix(void) const = 0;
+    // The GL state the node draws with, from makeStateKey.
+    virtual uint64_t getStateKey(void) const = 0;
+    // Whether other can be drawn in the same instanced call as this node.
+    virtual bool canInstanceWith(const ISceneNode* other) const = 0;
+    // Draws count copies of this node in one call, with world matrices read
+    // from buffer starting at the first'th.
+    virtual void drawInstances(IScene* scene, RenderPass pass, GLuint buffer, unsigned first, unsigned count) = 0;
     virtual ISceneNode* getParent(void) const = 0;
     virtual const luaL_Reg* getFuncs(void) const = 0;
-    virtual const luaL_Reg* getAttrFuncs(void) const = 0;
+    virtual const ScriptProperty* getAttrFuncs(void) const = 0;
 protected:
     virtual void setParent(ISceneNode* parent) = 0;
 };
 
 int node_render(lua_State* state);
+int node_transform(lua_State* state);
 
 int model_model(lua_State* state);
 int model_shader(lua_State* state);
@@ -62,50 +85,56 @@ const luaL_Reg node_default_funcs[] =
     {0, 0}
 };
 
-const luaL_Reg node_default_attr[] =
+// Attributes work as both getter and setter, setting when passed a value.
+const ScriptProperty node_default_attr[] =
 {
-    {"render", node_render},
-    {0, 0}
+    {"render", node_render, node_render},
+    {"transform", node_transform, 0},
+    {0, 0, 0}
 };
 
-const luaL_Reg node_camera_attr[] =
+const ScriptProperty node_camera_attr[] =
 {
-    {"sky_color", camera_sky},
-    {0, 0}
+    {"sky_color", camera_sky, camera_sky},
+    {0, 0, 0}
 };
 
-const luaL_Reg node_model_attr[] =
+const ScriptProperty node_model_attr[] =
 {
-    {"render", node_render},
-    {"model", model_model},
-    {"shader", model_shader},
-    {"texture", model_texture},
-    {0, 0}
+    {"render", node_render, node_render},
+    {"transform", node_transform, 0},
+    {"model", model_model, model_model},
+    {"shader", model_shader, model_shader},
+    {"texture", model_texture, model_texture},
+    {0, 0, 0}
 };
 
-const luaL_Reg node_billboard_attr[] =
+const ScriptProperty node_billboard_attr[] =
 {
-    {"render", node_render},
-    {"color", billboard_color},
-    {"texture", billboard_texture},
-    {0, 0}
+    {"render", node_render, node_render},
+    {"transform", node_transform, 0},
+    {"color", billboard_color, billboard_color},
+    {"texture", billboard_texture, billboard_texture},
+    {0, 0, 0}
 };
 
-const luaL_Reg node_particle_attr[] =
+const ScriptProperty node_particle_attr[] =
 {
-    {"render", node_render},
-    {"spawning", particle_spawning},
-    {"color", particle_color},
-    {"particle_count", particle_count},
-    {0, 0}
+    {"render", node_render, node_render},
+    {"transform", node_transform, 0},
+    {"spawning", particle_spawning, particle_spawning},
+    {"color", particle_color, particle_color},
+    {"particle_count", particle_count, particle_count},
+    {0, 0, 0}
 };
 
-const luaL_Reg node_text_attr[] =
+const ScriptProperty node_text_attr[] =
 {
-    {"render", node_render},
-    {"text", text_text},
-    {"color", text_color},
-    {0, 0}
+    {"render", node_render, node_render},
+    {"transform", node_transform, 0},
+    {"text", text_text, text_text},
+    {"color", text_color, text_color},
+    {0, 0, 0}
 };
 
 inline ISceneNode::~ISceneNode(void) {}
@@ -120,7 +149,10 @@ public:
     virtual bool addChild(ISceneNode* child);
     virtual bool removeChild(ISceneNode* child);
     virtual bool hasChild(ISceneNode* child) const;
-    virtual bool getVisible(void) const;
+    virtual bool getVisible(void) const { return m_visible; }
+    virtual void setVisible(bool visible) { m_visible = visible; }
+    virtual bool getWorldBounds(AABB& bounds) const { return false; }
+    virtual unsigned getBoundsVersion(void) const;
     virtual bool fromXml(rapidxml::xml_node<>* node);
     virtual bool getRenders(void) const { return m_renders; }
     virtual void setRenders(bool visible) { m_renders = visible; }
@@ -129,22 +161,38 @@ public:
     virtual long getActor(void) const;
     virtual ISceneNode* getParent(void) const { return u_parent; }
     virtual const luaL_Reg* getFuncs(void) const { return u_funcs; }
-    virtual const luaL_Reg* getAttrFuncs(void) const { return u_attr_funcs; }
+    virtual const ScriptProperty* getAttrFuncs(void) const { return u_attr_funcs; }
     void setTransform(Transform* trans) final;
-    void setLocalTransform(Transform* trans) final { m_local_transform = trans; }
+    void setLocalTransform(Transform* trans) final { m_local_transform = trans; m_local_version = ~0u; }
     Transform* getLocalTransform(void) const { return m_local_transform; }
+    virtual void updateTransforms(void);
+    virtual const glm::mat4& getWorldMatrix(void) const;
+    virtual uint64_t getStateKey(void) const { return 0; }
+    virtual bool canInstanceWith(const ISceneNode* other) const { return false; }
+    virtual void drawInstances(IScene* scene, RenderPass pass, GLuint buffer, unsigned first, unsigned count) {}
+    // Adds this node and its children to a scene's transform hierarchy and
+    // render queue. Nodes join their parent's scene when added to it.
+    void attach(Scene* scene, int parent_slot = -1);
+    void detach(void);
 protected:
     void setParent(ISceneNode* parent) final;
-    glm::mat4 m_final_transform;
+    glm::mat4 m_final_transform = glm::mat4(1.0f);
     Transform* m_local_transform = 0;
     Transform* u_transform_source = 0;
-    RenderPass m_render_pass;
+    RenderPass m_render_pass = HIDDEN_PASS;
     bool m_renders = true;
+    bool m_visible = true;
+    // Bumped by nodes whose bounds change without their transform moving.
+    unsigned m_bounds_version = 0;
     const luaL_Reg* u_funcs = node_default_funcs;
-    const luaL_Reg* u_attr_funcs = node_default_attr;
+    const ScriptProperty* u_attr_funcs = node_default_attr;
 private:
     std::vector<ISceneNode*> u_children;
     ISceneNode* u_parent = nullptr;
+    Scene* u_scene = nullptr;
+    unsigned m_slot = 0;
+    unsigned m_source_version = ~0u;
+    unsigned m_local_version = ~0u;
     long m_actor_id = -1;
 };
 
@@ -160,12 +208,15 @@ public:
     ModelSceneNode(void);
     ModelSceneNode(IModel* model, IShader* shader, Texture* texture = 0, RenderPass pass = RenderPass::DYNAMIC_PASS);
     virtual void draw(IScene* scene, RenderPass pass);
-    virtual bool getVisible(void);
+    virtual bool getWorldBounds(AABB& bounds) const;
     virtual bool fromXml(rapidxml::xml_node<>* node);
+    virtual uint64_t getStateKey(void) const;
+    virtual bool canInstanceWith(const ISceneNode* other) const;
+    virtual void drawInstances(IScene* scene, RenderPass pass, GLuint buffer, unsigned first, unsigned count);
     virtual const IModel* getModel(void) { return u_model; }
     virtual const IShader* getShader(void) { return u_shader; }
     virtual const Texture* getTexture(void) { return u_texture; }
-    virtual void setModel(IModel* model) { u_model = model; }
+    virtual void setModel(IModel* model) { u_model = model; ++m_bounds_version; }
     virtual void setShader(IShader* shader) { u_shader = shader; }
     virtual void setTexture(Texture* texture) { u_texture = texture; }
 protected:
@@ -233,7 +284,6 @@ protected:
     GLuint m_color_t_uniform = 0;
     GLuint m_normal_t_uniform = 0;
     GLuint m_position_t_uniform = 0;
-    GLuint m_eye_position_uniform = 0;
 };
 
 class BillboardSceneNode : public SceneNode
@@ -243,23 +293,23 @@ public:
     BillboardSceneNode(Texture* texture, RGBAColor color = RGBAColor(Color::White, 1.0f), RenderPass pass = RenderPass::UI_PASS);
     virtual void draw(IScene* scene, RenderPass pass);
     virtual bool fromXml(rapidxml::xml_node<>* node);
+    virtual uint64_t getStateKey(void) const;
     void setColor(RGBAColor color) { m_color = color; }
     RGBAColor getColor(void) { return m_color; }
     virtual const Texture* getTexture(void) { return u_texture; }
-    void setTexture(Texture* texture) { u_texture = texture; }
-    virtual bool getVisible(void);
+    void setTexture(Texture* texture) { u_texture = texture; ++m_bounds_version; }
+    virtual bool getWorldBounds(AABB& bounds) const;
 protected:
     GLuint m_vertex_position_attrib = 0;
     GLuint m_texture_uniform = 0;
     GLuint m_color_uniform = 0;
     GLuint m_direction_uniform = 0;
     GLuint m_transform_uniform = 0;
-    GLuint m_up_uniform = 0;
-    GLuint m_right_uniform = 0;
     GLuint m_dims_uniform = 0;
 
     RGBAColor m_color = RGBAColor(Color::White, 1.0f);
     Texture* u_texture = 0;
+    float m_dpu = 0;
 };
 
 struct Particle
@@ -280,7 +330,7 @@ public:
     ParticleSceneNode(Texture* texture, RGBAColor color, float rate, float life = 4, glm::vec2 dims = {1, 1}, bool burst = false, RenderPass pass = RenderPass::UI_PASS);
     virtual void draw(IScene* scene, RenderPass pass);
     virtual bool fromXml(rapidxml::xml_node<>* node);
-    virtual bool getVisible(void);
+    virtual bool getWorldBounds(AABB& bounds) const;
     virtual void update(float delta_time);
     virtual void createParticle(void);
     bool getSpawning(void) { return m_spawning; }
@@ -288,13 +338,11 @@ public:
     RGBAColor getStartingColor(void) const { return m_starting_color; }
     void setStartingColor(RGBAColor color) { m_starting_color = color; }
     unsigned getParticleCount(void) { return m_particle_count; }
+    Particle* getParticles(void) { return m_particles; }
 protected:
     GLuint m_vertex_position_attrib = 0;
     GLuint m_texture_uniform = 0;
     GLuint m_color_attrib = 0;
-    GLuint m_transform_uniform = 0;
-    GLuint m_up_uniform = 0;
-    GLuint m_right_uniform = 0;
     GLuint m_dims_uniform = 0;
     GLuint m_position_attrib = 0;
     GLuint m_particle_attrib = 0;
@@ -310,6 +358,7 @@ protected:
     glm::vec3 m_last_cam;
     unsigned m_particle_count = 0;
     unsigned m_last = 0;
+    AABB m_bounds;
     glm::vec2 m_dims = { 1, 1 };
     bool m_spawning = true;
     bool m_burst = true;
@@ -325,7 +374,6 @@ public:
     TextSceneNode(IFont* font, const char* text, RenderPass pass = RenderPass::UI_PASS);
     virtual void draw(IScene* scene, RenderPass pass);
     virtual bool fromXml(rapidxml::xml_node<>* node);
-    virtual bool getVisible(void);
     void setColor(RGBColor color) { m_color = color; }
     RGBColor getColor(void) { return m_color; }
     void setText(const char* text) { m_text = text; }
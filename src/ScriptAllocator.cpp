@@ -0,0 +1,104 @@
+#include "ScriptAllocator.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#define ALLOCATOR_MAX_SIZE (ALLOCATOR_GRANULARITY * ALLOCATOR_CLASS_COUNT)
+
+static inline unsigned sizeClass(size_t size)
+{
+    return (size - 1) / ALLOCATOR_GRANULARITY;
+}
+
+ScriptAllocator::ScriptAllocator(void)
+{
+    for(unsigned i = 0; i < ALLOCATOR_CLASS_COUNT; ++i)
+        m_free[i] = 0;
+}
+
+ScriptAllocator::~ScriptAllocator(void)
+{
+    for(auto i : m_chunks)
+        free(i);
+}
+
+void* ScriptAllocator::allocate(void* userdata, void* ptr, size_t old_size, size_t new_size)
+{
+    // Lua passes a type tag in old_size for new blocks, not a size.
+    if(!ptr)
+        old_size = 0;
+    return static_cast<ScriptAllocator*>(userdata)->reallocate(ptr, old_size, new_size);
+}
+
+void* ScriptAllocator::reallocate(void* ptr, size_t old_size, size_t new_size)
+{
+    if(new_size > old_size && m_limit && m_usage + new_size - old_size > m_limit)
+        return NULL;
+
+    bool old_pooled = ptr && old_size <= ALLOCATOR_MAX_SIZE;
+    bool new_pooled = new_size && new_size <= ALLOCATOR_MAX_SIZE;
+    void* block = NULL;
+
+    if(!new_size) {
+        if(old_pooled)
+            poolFree(ptr, sizeClass(old_size));
+        else
+            free(ptr);
+    } else if(old_pooled && new_pooled && sizeClass(old_size) == sizeClass(new_size)) {
+        block = ptr;
+    } else if(!old_pooled && !new_pooled && ptr) {
+        block = realloc(ptr, new_size);
+    } else {
+        block = new_pooled ? poolAlloc(sizeClass(new_size)) : malloc(new_size);
+        if(!block)
+            return NULL;
+        if(ptr) {
+            memcpy(block, ptr, old_size < new_size ? old_size : new_size);
+            if(old_pooled)
+                poolFree(ptr, sizeClass(old_size));
+            else
+                free(ptr);
+        }
+    }
+
+    if(new_size && !block)
+        return NULL;
+    m_usage = m_usage + new_size - old_size;
+    if(m_usage > m_peak)
+        m_peak = m_usage;
+    return block;
+}
+
+void* ScriptAllocator::poolAlloc(unsigned size_class)
+{
+    if(void* block = m_free[size_class]) {
+        m_free[size_class] = *static_cast<void**>(block);
+        return block;
+    }
+
+    size_t size = (size_class + 1) * ALLOCATOR_GRANULARITY;
+    if(m_chunk_end - m_chunk_pos < static_cast<ptrdiff_t>(size)) {
+        // The tail of the old chunk is too small for this class, so it's
+        // handed to the free list that fits it instead of being wasted.
+        size_t left = m_chunk_end - m_chunk_pos;
+        if(left >= ALLOCATOR_GRANULARITY)
+            poolFree(m_chunk_pos, sizeClass(left));
+
+        char* chunk = static_cast<char*>(malloc(ALLOCATOR_CHUNK_SIZE));
+        if(!chunk)
+            return NULL;
+        m_chunks.push_back(chunk);
+        m_chunk_pos = chunk;
+        m_chunk_end = chunk + ALLOCATOR_CHUNK_SIZE;
+    }
+
+    void* block = m_chunk_pos;
+    m_chunk_pos += size;
+    return block;
+}
+
+void ScriptAllocator::poolFree(void* ptr, unsigned size_class)
+{
+    *static_cast<void**>(ptr) = m_free[size_class];
+    m_free[size_class] = ptr;
+}
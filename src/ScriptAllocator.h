@@ -0,0 +1,41 @@
+#ifndef SCRIPT_ALLOCATOR_H
+#define SCRIPT_ALLOCATOR_H
+#include <cstddef>
+#include <vector>
+
+#define ALLOCATOR_GRANULARITY 16
+#define ALLOCATOR_CLASS_COUNT 16
+#define ALLOCATOR_CHUNK_SIZE 65536
+
+// A lua_Alloc that serves small blocks from per-size-class free lists, and
+// tracks how much memory its VM is using. One allocator belongs to one VM,
+// so it does no locking.
+class ScriptAllocator
+{
+public:
+    ScriptAllocator(void);
+    ~ScriptAllocator(void);
+    static void* allocate(void* userdata, void* ptr, size_t old_size, size_t new_size);
+
+    // Bytes the VM may use, or 0 for no limit. Allocations past the limit
+    // fail, which Lua reports as a memory error in the offending script.
+    inline void setLimit(size_t limit) { m_limit = limit; }
+    inline size_t getLimit(void) const { return m_limit; }
+    inline size_t getUsage(void) const { return m_usage; }
+    inline size_t getPeak(void) const { return m_peak; }
+    inline size_t getReserved(void) const { return m_chunks.size() * ALLOCATOR_CHUNK_SIZE; }
+private:
+    void* reallocate(void* ptr, size_t old_size, size_t new_size);
+    void* poolAlloc(unsigned size_class);
+    void poolFree(void* ptr, unsigned size_class);
+
+    size_t m_limit = 0;
+    size_t m_usage = 0;
+    size_t m_peak = 0;
+    void* m_free[ALLOCATOR_CLASS_COUNT];
+    char* m_chunk_pos = 0;
+    char* m_chunk_end = 0;
+    std::vector<char*> m_chunks;
+};
+
+#endif
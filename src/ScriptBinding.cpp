@@ -0,0 +1,77 @@
+#include "ScriptBinding.h"
+#include "Util.h"
+
+// Upvalues: the name to slot table, the property array and the fallback
+// metamethod from meta, if any.
+static int boundIndex(lua_State* state)
+{
+    lua_pushvalue(state, 2);
+    if(lua_rawget(state, lua_upvalueindex(1)) == LUA_TNUMBER) {
+        const ScriptProperty* props = static_cast<const ScriptProperty*>(lua_touserdata(state, lua_upvalueindex(2)));
+        const ScriptProperty& prop = props[lua_tointeger(state, -1)];
+        if(prop.get) {
+            lua_settop(state, 1);
+            return prop.get(state);
+        }
+    }
+
+    lua_settop(state, 2);
+    if(lua_CFunction fallback = lua_tocfunction(state, lua_upvalueindex(3)))
+        return fallback(state);
+    return 0;
+}
+
+static int boundNewIndex(lua_State* state)
+{
+    lua_settop(state, 3);
+    lua_pushvalue(state, 2);
+    if(lua_rawget(state, lua_upvalueindex(1)) == LUA_TNUMBER) {
+        const ScriptProperty* props = static_cast<const ScriptProperty*>(lua_touserdata(state, lua_upvalueindex(2)));
+        const ScriptProperty& prop = props[lua_tointeger(state, -1)];
+        if(!prop.set) {
+            warn(std::string("Trying to set the read-only field ") + prop.name);
+            return 0;
+        }
+        lua_settop(state, 3);
+        lua_remove(state, 2);
+        return prop.set(state);
+    }
+
+    lua_settop(state, 3);
+    if(lua_CFunction fallback = lua_tocfunction(state, lua_upvalueindex(3)))
+        return fallback(state);
+    if(lua_type(state, 2) == LUA_TSTRING)
+        warn(std::string("Trying to set a field that doesn't exist: ") + lua_tostring(state, 2));
+    return 0;
+}
+
+void pushBoundMetatable(lua_State* state, const ScriptProperty* props, const luaL_Reg* meta)
+{
+    if(lua_rawgetp(state, LUA_REGISTRYINDEX, props) != LUA_TNIL)
+        return;
+    lua_pop(state, 1);
+
+    lua_newtable(state);
+    if(meta)
+        luaL_setfuncs(state, meta, 0);
+
+    lua_createtable(state, 0, 8);
+    for(int i = 0; props[i].name != 0; ++i) {
+        lua_pushinteger(state, i);
+        lua_setfield(state, -2, props[i].name);
+    }
+
+    lua_pushvalue(state, -1);
+    lua_pushlightuserdata(state, const_cast<ScriptProperty*>(props));
+    lua_getfield(state, -4, "__index");
+    lua_pushcclosure(state, boundIndex, 3);
+    lua_setfield(state, -3, "__index");
+
+    lua_pushlightuserdata(state, const_cast<ScriptProperty*>(props));
+    lua_getfield(state, -3, "__newindex");
+    lua_pushcclosure(state, boundNewIndex, 3);
+    lua_setfield(state, -2, "__newindex");
+
+    lua_pushvalue(state, -1);
+    lua_rawsetp(state, LUA_REGISTRYINDEX, props);
+}
@@ -0,0 +1,132 @@
+#ifndef SCRIPT_BINDING_H
+#define SCRIPT_BINDING_H
+#include "LuaCompat.h"
+#include "ScriptMath.h"
+#include <string>
+
+// A field on a script proxy. get is called with just the proxy on the stack,
+// set with the proxy and the new value. Either can be NULL, and both can be
+// the same function if it checks lua_gettop.
+struct ScriptProperty
+{
+    const char* name;
+    lua_CFunction get;
+    lua_CFunction set;
+};
+
+// Pushes the metatable for proxies with the given properties, creating it the
+// first time it's used. Property names are resolved to slots when the
+// metatable is built, so a field access is one table lookup rather than a
+// string compare per field. Other keys fall through to meta's __index and
+// __newindex if it has them.
+void pushBoundMetatable(lua_State* state, const ScriptProperty* props, const luaL_Reg* meta);
+
+// Whether the value at index is a proxy's instance whose object still exists.
+// Releasing a proxy clears its instance, since scripts may still hold it.
+inline bool isLiveInstance(lua_State* state, int index)
+{
+    return lua_isuserdata(state, index) && *static_cast<void**>(lua_touserdata(state, index));
+}
+
+// Returns the object behind the proxy at index.
+template<typename T>
+T* toInstance(lua_State* state, int index)
+{
+    lua_getfield(state, index, "instance");
+    if(!isLiveInstance(state, -1))
+        luaL_error(state, "Trying to access data, but the object is missing its instance!");
+    T* object = *static_cast<T**>(lua_touserdata(state, -1));
+    lua_pop(state, 1);
+    return object;
+}
+
+// Converts between C++ values and the Lua stack for the generated accessors.
+// read leaves value untouched and returns false if the types don't match.
+template<typename V> struct ScriptValue;
+
+template<> struct ScriptValue<bool>
+{
+    static void push(lua_State* state, bool value) { lua_pushboolean(state, value); }
+    static bool read(lua_State* state, int index, bool& value) { value = lua_toboolean(state, index); return true; }
+};
+
+template<> struct ScriptValue<int>
+{
+    static void push(lua_State* state, int value) { lua_pushinteger(state, value); }
+    static bool read(lua_State* state, int index, int& value)
+    {
+        if(!lua_isnumber(state, index))
+            return false;
+        value = lua_tointeger(state, index);
+        return true;
+    }
+};
+
+template<> struct ScriptValue<float>
+{
+    static void push(lua_State* state, float value) { lua_pushnumber(state, value); }
+    static bool read(lua_State* state, int index, float& value)
+    {
+        if(!lua_isnumber(state, index))
+            return false;
+        value = lua_tonumber(state, index);
+        return true;
+    }
+};
+
+template<> struct ScriptValue<std::string>
+{
+    static void push(lua_State* state, const std::string& value) { lua_pushlstring(state, value.data(), value.size()); }
+    static bool read(lua_State* state, int index, std::string& value)
+    {
+        size_t length;
+        const char* str = lua_tolstring(state, index, &length);
+        if(!str)
+            return false;
+        value.assign(str, length);
+        return true;
+    }
+};
+
+template<> struct ScriptValue<glm::vec3>
+{
+    static void push(lua_State* state, const glm::vec3& value) { pushVec3(state, value); }
+    static bool read(lua_State* state, int index, glm::vec3& value) { return toVec3(state, index, value); }
+};
+
+template<> struct ScriptValue<glm::quat>
+{
+    static void push(lua_State* state, const glm::quat& value) { pushQuat(state, value); }
+    static bool read(lua_State* state, int index, glm::quat& value)
+    {
+        glm::quat* q = testQuat(state, index);
+        if(!q)
+            return false;
+        value = *q;
+        return true;
+    }
+};
+
+// Generates a property getter from a const member function.
+template<typename T, typename V, V (T::*Get)(void) const>
+int propertyGet(lua_State* state)
+{
+    T* object = toInstance<T>(state, 1);
+    ScriptValue<V>::push(state, (object->*Get)());
+    return 1;
+}
+
+// Generates a property setter from a getter and setter pair. The new value is
+// read over the current one, so tables with only some of x, y and z set keep
+// the other components.
+template<typename T, typename V, V (T::*Get)(void) const, void (T::*Set)(V)>
+int propertySet(lua_State* state)
+{
+    T* object = toInstance<T>(state, 1);
+    V value = (object->*Get)();
+    if(ScriptValue<V>::read(state, 2, value))
+        (object->*Set)(value);
+    return 0;
+}
+
+#endif
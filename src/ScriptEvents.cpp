@@ -0,0 +1,233 @@
+#include "EventSystem.h"
+#include "Game.h"
+#include "InputSystem.h"
+#include "ScriptEvents.h"
+#include "ScriptSystem.h"
+#include "TweenSystem.h"
+#include "Util.h"
+
+#include <algorithm>
+
+const EventType TimerEvent::m_type(6);
+
+TimerEvent::TimerEvent(unsigned long id)
+{
+    m_id = id;
+}
+
+const EventType& TimerEvent::getEventType(void) const
+{
+    return m_type;
+}
+
+unsigned long TimerEvent::getId(void) const
+{
+    return m_id;
+}
+
+// Pushes the event's fields as handler arguments and returns how many there
+// are. The first one is what handlers can filter on.
+static int pushEventArgs(lua_State* state, const IEvent& event)
+{
+    if(event.getEventType() == ActorDestroyedEvent::m_type) {
+        lua_pushinteger(state, static_cast<const ActorDestroyedEvent&>(event).getId());
+        return 1;
+    } else if(event.getEventType() == KeyEvent::m_type) {
+        const KeyEvent& e = static_cast<const KeyEvent&>(event);
+        lua_pushinteger(state, e.getKey());
+        lua_pushinteger(state, e.getAction());
+        return 2;
+    } else if(event.getEventType() == TweenFinishedEvent::m_type) {
+        const TweenFinishedEvent& e = static_cast<const TweenFinishedEvent&>(event);
+        lua_pushinteger(state, e.getActor());
+        pushTween(state, e.getTween());
+        return 2;
+    } else if(event.getEventType() == TimerEvent::m_type) {
+        lua_pushinteger(state, static_cast<const TimerEvent&>(event).getId());
+        return 1;
+    }
+    return 0;
+}
+
+static bool getEventSubject(const IEvent& event, lua_Integer& subject)
+{
+    if(event.getEventType() == ActorDestroyedEvent::m_type)
+        subject = static_cast<const ActorDestroyedEvent&>(event).getId();
+    else if(event.getEventType() == KeyEvent::m_type)
+        subject = static_cast<const KeyEvent&>(event).getKey();
+    else if(event.getEventType() == TweenFinishedEvent::m_type)
+        subject = static_cast<const TweenFinishedEvent&>(event).getActor();
+    else if(event.getEventType() == TimerEvent::m_type)
+        subject = static_cast<const TimerEvent&>(event).getId();
+    else
+        return false;
+    return true;
+}
+
+void ScriptEvents::initialize(lua_State* state)
+{
+    m_state = state;
+    lua_pushglobaltable(state);
+    luaL_setfuncs(state, events_funcs, 0);
+    lua_pop(state, 1);
+}
+
+void ScriptEvents::update(float dt)
+{
+    m_time += dt;
+
+    std::vector<unsigned long> due;
+    while(!m_timer_queue.empty() && m_timer_queue.top().first <= m_time) {
+        due.push_back(m_timer_queue.top().second);
+        m_timer_queue.pop();
+    }
+
+    for(auto i : due) {
+        auto search = m_timers.find(i);
+        if(search == m_timers.end())
+            continue;
+        if(search->second.repeat)
+            m_timer_queue.push(TimerWake(m_time + search->second.interval, i));
+        else
+            m_timers.erase(search);
+        g_game->events()->callEvent(TimerEvent(i));
+    }
+}
+
+void ScriptEvents::cleanup(void)
+{
+    for(auto i : m_subscribed)
+        g_game->events()->rmSubscription(this, i);
+    m_subscribed.clear();
+    for(auto i : m_handlers)
+        luaL_unref(m_state, LUA_REGISTRYINDEX, i.second.ref);
+    m_handlers.clear();
+    m_type_handlers.clear();
+    m_timers.clear();
+    m_timer_queue = decltype(m_timer_queue)();
+    m_state = 0;
+}
+
+void ScriptEvents::cancel(void* owner)
+{
+    std::vector<unsigned long> handlers;
+    for(auto& i : m_handlers)
+        if(i.second.owner == owner)
+            handlers.push_back(i.first);
+    for(auto i : handlers)
+        unsubscribe(i);
+
+    // Cancelled timers are skipped when they come up in the queue.
+    for(auto i = m_timers.begin(); i != m_timers.end();)
+        if(i->second.owner == owner)
+            i = m_timers.erase(i);
+        else
+            ++i;
+}
+
+void ScriptEvents::dispatch(const IEvent& event)
+{
+    auto type_search = m_type_handlers.find(event.getEventType());
+    if(type_search == m_type_handlers.end() || type_search->second.empty())
+        return;
+
+    lua_Integer subject = 0;
+    bool has_subject = getEventSubject(event, subject);
+
+    // Handlers can subscribe or unsubscribe while this runs, so work from a
+    // copy and skip any that are gone by the time they come up.
+    std::vector<unsigned long> ids = type_search->second;
+    for(auto i : ids) {
+        auto search = m_handlers.find(i);
+        if(search == m_handlers.end())
+            continue;
+        const ScriptHandler& handler = search->second;
+        if(handler.filtered && (!has_subject || handler.subject != subject))
+            continue;
+
+        void* owner = handler.owner;
+        std::string script = handler.script;
+        lua_rawgeti(m_state, LUA_REGISTRYINDEX, handler.ref);
+        int arg_count = pushEventArgs(m_state, event);
+        g_game->scripts()->beginCall(owner, script);
+        if(lua_pcall(m_state, arg_count, 0, 0)) {
+            warn(lua_tostring(m_state, -1));
+            lua_pop(m_state, 1);
+        }
+        g_game->scripts()->endCall();
+    }
+}
+
+void ScriptEvents::unsubscribe(unsigned long id)
+{
+    auto search = m_handlers.find(id);
+    if(search == m_handlers.end())
+        return;
+
+    std::vector<unsigned long>& ids = m_type_handlers[search->second.type];
+    ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+    luaL_unref(m_state, LUA_REGISTRYINDEX, search->second.ref);
+    m_handlers.erase(search);
+}
+
+int events_subscribe(lua_State* state)
+{
+    ScriptEvents* events = g_game->scripts()->getScriptEvents();
+    EventType type = luaL_checkinteger(state, 1);
+    luaL_checktype(state, 2, LUA_TFUNCTION);
+    if(state != events->m_state)
+        return luaL_error(state, "subscribe can only be called from the main script VM.");
+
+    ScriptHandler handler;
+    handler.type = type;
+    handler.owner = g_game->scripts()->getCallOwner();
+    handler.script = g_game->scripts()->getCallScript();
+    if(!lua_isnoneornil(state, 3)) {
+        handler.filtered = true;
+        handler.subject = luaL_checkinteger(state, 3);
+    }
+    lua_pushvalue(state, 2);
+    handler.ref = luaL_ref(state, LUA_REGISTRYINDEX);
+
+    unsigned long id = events->m_next_id++;
+    events->m_handlers.emplace(id, handler);
+    events->m_type_handlers[type].push_back(id);
+    if(events->m_subscribed.insert(type).second)
+        g_game->events()->addSubscription(Callback(events, [events](const IEvent& event) { events->dispatch(event); }), type);
+
+    lua_pushinteger(state, id);
+    return 1;
+}
+
+int events_unsubscribe(lua_State* state)
+{
+    g_game->scripts()->getScriptEvents()->unsubscribe(luaL_checkinteger(state, 1));
+    return 0;
+}
+
+int events_timer(lua_State* state)
+{
+    ScriptEvents* events = g_game->scripts()->getScriptEvents();
+    float interval = luaL_checknumber(state, 1);
+    bool repeat = lua_toboolean(state, 2);
+    if(repeat && interval <= 0)
+        return luaL_error(state, "A repeating timer needs an interval above 0.");
+
+    ScriptTimer timer;
+    timer.owner = g_game->scripts()->getCallOwner();
+    timer.interval = interval;
+    timer.repeat = repeat;
+
+    unsigned long id = events->m_next_id++;
+    events->m_timers.emplace(id, timer);
+    events->m_timer_queue.push(ScriptEvents::TimerWake(events->m_time + interval, id));
+
+    lua_pushinteger(state, id);
+    return 1;
+}
+
+int events_cancel_timer(lua_State* state)
+{
+    g_game->scripts()->getScriptEvents()->m_timers.erase(luaL_checkinteger(state, 1));
+    return 0;
+}
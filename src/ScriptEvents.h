@@ -0,0 +1,97 @@
+#ifndef SCRIPT_EVENTS_H
+#define SCRIPT_EVENTS_H
+#include "Event.h"
+#include "LuaCompat.h"
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Sent when a timer started with timer() runs out.
+class TimerEvent : public IEvent
+{
+    public:
+        TimerEvent(unsigned long id);
+        virtual const EventType& getEventType (void) const;
+        unsigned long getId(void) const;
+
+        static const EventType m_type;
+    private:
+        unsigned long m_id;
+};
+
+struct ScriptHandler
+{
+    EventType type;
+    int ref;
+    void* owner;
+    std::string script;
+    bool filtered = false;
+    lua_Integer subject = 0;
+};
+
+struct ScriptTimer
+{
+    void* owner;
+    float interval;
+    bool repeat;
+};
+
+// Lets scripts subscribe handlers to engine events, so they can react to
+// input and other scripts without polling in update. Handlers get the
+// event's fields as arguments:
+//   EVENT_ACTOR_DESTROYED: actor id
+//   EVENT_KEY: key, KEY_PRESSED or KEY_RELEASED
+//   EVENT_TWEEN_FINISHED: actor id, tween
+//   EVENT_TIMER: timer id
+// A handler can be limited to events whose first field matches a subject.
+class ScriptEvents
+{
+public:
+    void initialize(lua_State* state);
+    void update(float dt);
+    void cleanup(void);
+
+    // Handlers and timers belong to the owner of the script call that created
+    // them, and are removed along with it.
+    void cancel(void* owner);
+    void dispatch(const IEvent& event);
+
+    inline unsigned long getHandlerCount(void) const { return m_handlers.size(); }
+
+    friend int events_subscribe(lua_State* state);
+    friend int events_unsubscribe(lua_State* state);
+    friend int events_timer(lua_State* state);
+    friend int events_cancel_timer(lua_State* state);
+private:
+    typedef std::pair<float, unsigned long> TimerWake;
+
+    void unsubscribe(unsigned long id);
+
+    lua_State* m_state = 0;
+    unsigned long m_next_id = 1;
+    float m_time = 0;
+    std::unordered_map<unsigned long, ScriptHandler> m_handlers;
+    std::unordered_map<EventType, std::vector<unsigned long>> m_type_handlers;
+    std::unordered_set<EventType> m_subscribed;
+    std::unordered_map<unsigned long, ScriptTimer> m_timers;
+    std::priority_queue<TimerWake, std::vector<TimerWake>, std::greater<TimerWake>> m_timer_queue;
+};
+
+int events_subscribe(lua_State* state);
+int events_unsubscribe(lua_State* state);
+int events_timer(lua_State* state);
+int events_cancel_timer(lua_State* state);
+
+const luaL_Reg events_funcs[] =
+{
+    {"subscribe", events_subscribe},
+    {"unsubscribe", events_unsubscribe},
+    {"timer", events_timer},
+    {"cancel_timer", events_cancel_timer},
+    {0, 0}
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "CGraphics.h"
+#include "CRigidBody.h"
+#include "SceneNode.h"
+#include "ScriptFFI.h"
+#include "Transform.h"
+#include "Util.h"
+
+#include <cstddef>
+
+#ifdef SCRIPT_FFI
+// The cdefs below have to match these structs exactly.
+static_assert(sizeof(TransformData) == 11 * sizeof(float) + sizeof(int), "df_transform doesn't match TransformData");
+static_assert(offsetof(TransformData, orientation) == 3 * sizeof(float), "df_transform doesn't match TransformData");
+static_assert(offsetof(TransformData, dirty) == 10 * sizeof(float), "df_transform doesn't match TransformData");
+static_assert(sizeof(RigidBodyState) == 6 * sizeof(float) + sizeof(int), "df_rigidbody doesn't match RigidBodyState");
+static_assert(sizeof(Particle) == 16 * sizeof(float), "df_particle doesn't match Particle");
+static_assert(offsetof(Particle, color) == 11 * sizeof(float), "df_particle doesn't match Particle");
+
+static const char ffi_source[] =
+    "local ffi = require('ffi')\n"
+    "local transform_ptr, rigidbody_ptr, particle_ptr = ...\n"
+    "ffi.cdef[[\n"
+    "typedef struct { float x, y; } df_vec2;\n"
+    "typedef struct { float x, y, z; } df_vec3;\n"
+    "typedef struct { float x, y, z, w; } df_vec4;\n"
+    "typedef struct { float x, y, z, w; } df_quat;\n"
+    "typedef struct { df_vec3 position; df_quat orientation; df_vec3 scale; int32_t dirty; } df_transform;\n"
+    "typedef struct { df_vec3 velocity; df_vec3 angular_velocity; int32_t dirty; } df_rigidbody;\n"
+    "typedef struct { df_vec3 position, velocity, acceleration; df_vec2 life; df_vec4 color; float cam_distance; } df_particle;\n"
+    "]]\n"
+    "local transform_t = ffi.typeof('df_transform*')\n"
+    "local rigidbody_t = ffi.typeof('df_rigidbody*')\n"
+    "local particle_t = ffi.typeof('df_particle*')\n"
+    "function transform_view(transform) return ffi.cast(transform_t, transform_ptr(transform)) end\n"
+    "function rigidbody_view(body) return ffi.cast(rigidbody_t, rigidbody_ptr(body)) end\n"
+    "function particle_view(graphics)\n"
+    "    local particles, count = particle_ptr(graphics)\n"
+    "    return ffi.cast(particle_t, particles), count\n"
+    "end\n";
+
+static int ffi_transform_ptr(lua_State* state)
+{
+    Transform* transform = toInstance<Transform>(state, 1);
+    lua_pushlightuserdata(state, transform->getData());
+    return 1;
+}
+
+static int ffi_rigidbody_ptr(lua_State* state)
+{
+    CRigidBody* body = toInstance<CRigidBody>(state, 1);
+    lua_pushlightuserdata(state, body->getScriptState());
+    return 1;
+}
+
+static int ffi_particle_ptr(lua_State* state)
+{
+    CGraphics* gfx = toInstance<CGraphics>(state, 1);
+    ParticleSceneNode* node = dynamic_cast<ParticleSceneNode*>(gfx->getNode());
+    if(!node)
+        return luaL_error(state, "particle_view needs a Graphics Component with a particle emitter.");
+
+    lua_pushlightuserdata(state, node->getParticles());
+    lua_pushinteger(state, node->getParticleCount());
+    return 2;
+}
+
+void registerFFI(lua_State* state)
+{
+    if(luaL_loadbuffer(state, ffi_source, sizeof(ffi_source) - 1, "=ffi")) {
+        warn(lua_tostring(state, -1));
+        lua_pop(state, 1);
+        return;
+    }
+    lua_pushcfunction(state, ffi_transform_ptr);
+    lua_pushcfunction(state, ffi_rigidbody_ptr);
+    lua_pushcfunction(state, ffi_particle_ptr);
+    if(lua_pcall(state, 3, 0, 0)) {
+        warn(lua_tostring(state, -1));
+        lua_pop(state, 1);
+    }
+}
+#endif
@@ -0,0 +1,16 @@
+#ifndef SCRIPT_FFI_H
+#define SCRIPT_FFI_H
+#include "LuaCompat.h"
+
+#ifdef SCRIPT_FFI
+// Declares the engine structs to LuaJIT's FFI and adds the view functions:
+//   transform_view(transform) returns a df_transform*
+//   rigidbody_view(body) returns a df_rigidbody*
+//   particle_view(graphics) returns a df_particle* and the live particle count
+// Views point straight at engine memory, so reads and writes don't go
+// through any C function. Set dirty after writing a transform or body.
+// Particle views are only valid until the emitter next updates.
+void registerFFI(lua_State* state);
+#endif
+
+#endif
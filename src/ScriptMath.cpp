@@ -0,0 +1,540 @@
+#include "ScriptMath.h"
+
+#include <cstdio>
+#include <glm/geometric.hpp>
+#include <new>
+
+template<typename T> struct MathType;
+template<> struct MathType<glm::vec2> { static const char* name(void) { return VEC2_META; } };
+template<> struct MathType<glm::vec3> { static const char* name(void) { return VEC3_META; } };
+template<> struct MathType<glm::quat> { static const char* name(void) { return QUAT_META; } };
+
+template<typename T> static T* pushMath(lua_State* state, const T& value)
+{
+    T* data = static_cast<T*>(lua_newuserdata(state, sizeof(T)));
+    new (data) T(value);
+    luaL_setmetatable(state, MathType<T>::name());
+    return data;
+}
+
+template<typename T> static T* testMath(lua_State* state, int index)
+{
+    return static_cast<T*>(luaL_testudata(state, index, MathType<T>::name()));
+}
+
+template<typename T> static T* checkMath(lua_State* state, int index)
+{
+    return static_cast<T*>(luaL_checkudata(state, index, MathType<T>::name()));
+}
+
+template<typename T> static void returnMath(lua_State* state, int out, const T& value)
+{
+    if(T* data = testMath<T>(state, out)) {
+        *data = value;
+        lua_pushvalue(state, out);
+    } else {
+        pushMath(state, value);
+    }
+}
+
+static float* component(glm::vec2& value, char name)
+{
+    switch(name) {
+        case 'x': return &value.x;
+        case 'y': return &value.y;
+    }
+    return NULL;
+}
+
+static float* component(glm::vec3& value, char name)
+{
+    switch(name) {
+        case 'x': return &value.x;
+        case 'y': return &value.y;
+        case 'z': return &value.z;
+    }
+    return NULL;
+}
+
+static float* component(glm::quat& value, char name)
+{
+    switch(name) {
+        case 'w': return &value.w;
+        case 'x': return &value.x;
+        case 'y': return &value.y;
+        case 'z': return &value.z;
+    }
+    return NULL;
+}
+
+// Single-letter keys are components, and everything else is looked up in
+// the type's method table, which is the closure's upvalue.
+template<typename T> static int math_index(lua_State* state)
+{
+    T* value = static_cast<T*>(lua_touserdata(state, 1));
+    if(lua_type(state, 2) == LUA_TSTRING) {
+        size_t length;
+        const char* key = lua_tolstring(state, 2, &length);
+        if(length == 1) {
+            if(float* c = component(*value, key[0])) {
+                lua_pushnumber(state, *c);
+                return 1;
+            }
+        }
+    }
+    lua_pushvalue(state, 2);
+    lua_rawget(state, lua_upvalueindex(1));
+    return 1;
+}
+
+template<typename T> static int math_newindex(lua_State* state)
+{
+    T* value = static_cast<T*>(lua_touserdata(state, 1));
+    size_t length = 0;
+    const char* key = lua_type(state, 2) == LUA_TSTRING ? lua_tolstring(state, 2, &length) : NULL;
+    float* c = length == 1 ? component(*value, key[0]) : NULL;
+    if(!c)
+        return luaL_error(state, "Trying to set a field that doesn't exist on a %s.", MathType<T>::name());
+    *c = luaL_checknumber(state, 3);
+    return 0;
+}
+
+template<typename T> static int math_eq(lua_State* state)
+{
+    T* a = testMath<T>(state, 1);
+    T* b = testMath<T>(state, 2);
+    lua_pushboolean(state, a && b && *a == *b);
+    return 1;
+}
+
+template<typename T> static int vec_add(lua_State* state)
+{
+    pushMath(state, *checkMath<T>(state, 1) + *checkMath<T>(state, 2));
+    return 1;
+}
+
+template<typename T> static int vec_sub(lua_State* state)
+{
+    pushMath(state, *checkMath<T>(state, 1) - *checkMath<T>(state, 2));
+    return 1;
+}
+
+template<typename T> static int vec_mul(lua_State* state)
+{
+    if(lua_type(state, 1) == LUA_TNUMBER)
+        pushMath(state, *checkMath<T>(state, 2) * static_cast<float>(lua_tonumber(state, 1)));
+    else if(lua_type(state, 2) == LUA_TNUMBER)
+        pushMath(state, *checkMath<T>(state, 1) * static_cast<float>(lua_tonumber(state, 2)));
+    else
+        pushMath(state, *checkMath<T>(state, 1) * *checkMath<T>(state, 2));
+    return 1;
+}
+
+template<typename T> static int vec_div(lua_State* state)
+{
+    if(lua_type(state, 2) == LUA_TNUMBER)
+        pushMath(state, *checkMath<T>(state, 1) / static_cast<float>(lua_tonumber(state, 2)));
+    else
+        pushMath(state, *checkMath<T>(state, 1) / *checkMath<T>(state, 2));
+    return 1;
+}
+
+template<typename T> static int vec_unm(lua_State* state)
+{
+    pushMath(state, -*checkMath<T>(state, 1));
+    return 1;
+}
+
+template<typename T> static int vec_set(lua_State* state)
+{
+    T* value = checkMath<T>(state, 1);
+    if(T* other = testMath<T>(state, 2)) {
+        *value = *other;
+    } else {
+        for(int i = 0; i < T::length(); ++i)
+            (*value)[i] = luaL_optnumber(state, i + 2, (*value)[i]);
+    }
+    lua_settop(state, 1);
+    return 1;
+}
+
+template<typename T> static int vec_copy(lua_State* state)
+{
+    pushMath(state, *checkMath<T>(state, 1));
+    return 1;
+}
+
+template<typename T> static int vec_length(lua_State* state)
+{
+    lua_pushnumber(state, glm::length(*checkMath<T>(state, 1)));
+    return 1;
+}
+
+template<typename T> static int vec_length_squared(lua_State* state)
+{
+    T* value = checkMath<T>(state, 1);
+    lua_pushnumber(state, glm::dot(*value, *value));
+    return 1;
+}
+
+template<typename T> static int vec_dot(lua_State* state)
+{
+    lua_pushnumber(state, glm::dot(*checkMath<T>(state, 1), *checkMath<T>(state, 2)));
+    return 1;
+}
+
+template<typename T> static int vec_normalize(lua_State* state)
+{
+    T* value = checkMath<T>(state, 1);
+    if(glm::dot(*value, *value) > 0)
+        *value = glm::normalize(*value);
+    lua_settop(state, 1);
+    return 1;
+}
+
+template<typename T> static int vec_normalized(lua_State* state)
+{
+    T value = *checkMath<T>(state, 1);
+    if(glm::dot(value, value) > 0)
+        value = glm::normalize(value);
+    returnMath(state, 2, value);
+    return 1;
+}
+
+// The in-place operators take either another vector or a number.
+template<typename T> static int vec_add_in(lua_State* state)
+{
+    T* value = checkMath<T>(state, 1);
+    if(lua_type(state, 2) == LUA_TNUMBER)
+        *value += static_cast<float>(lua_tonumber(state, 2));
+    else
+        *value += *checkMath<T>(state, 2);
+    lua_settop(state, 1);
+    return 1;
+}
+
+template<typename T> static int vec_sub_in(lua_State* state)
+{
+    T* value = checkMath<T>(state, 1);
+    if(lua_type(state, 2) == LUA_TNUMBER)
+        *value -= static_cast<float>(lua_tonumber(state, 2));
+    else
+        *value -= *checkMath<T>(state, 2);
+    lua_settop(state, 1);
+    return 1;
+}
+
+template<typename T> static int vec_scale_in(lua_State* state)
+{
+    T* value = checkMath<T>(state, 1);
+    if(lua_type(state, 2) == LUA_TNUMBER)
+        *value *= static_cast<float>(lua_tonumber(state, 2));
+    else
+        *value *= *checkMath<T>(state, 2);
+    lua_settop(state, 1);
+    return 1;
+}
+
+template<typename T> static int vec_lerp_in(lua_State* state)
+{
+    T* value = checkMath<T>(state, 1);
+    T* other = checkMath<T>(state, 2);
+    float t = luaL_checknumber(state, 3);
+    *value += (*other - *value) * t;
+    lua_settop(state, 1);
+    return 1;
+}
+
+static int vec2_tostring(lua_State* state)
+{
+    glm::vec2* value = checkMath<glm::vec2>(state, 1);
+    lua_pushfstring(state, "vec2(%f, %f)", value->x, value->y);
+    return 1;
+}
+
+static int vec3_tostring(lua_State* state)
+{
+    glm::vec3* value = checkMath<glm::vec3>(state, 1);
+    lua_pushfstring(state, "vec3(%f, %f, %f)", value->x, value->y, value->z);
+    return 1;
+}
+
+static int vec3_cross(lua_State* state)
+{
+    returnMath(state, 3, glm::cross(*checkMath<glm::vec3>(state, 1), *checkMath<glm::vec3>(state, 2)));
+    return 1;
+}
+
+static int quat_mul(lua_State* state)
+{
+    glm::quat* a = checkMath<glm::quat>(state, 1);
+    if(glm::vec3* v = testMath<glm::vec3>(state, 2))
+        pushMath(state, *a * *v);
+    else
+        pushMath(state, *a * *checkMath<glm::quat>(state, 2));
+    return 1;
+}
+
+static int quat_tostring(lua_State* state)
+{
+    glm::quat* value = checkMath<glm::quat>(state, 1);
+    lua_pushfstring(state, "quat(%f, %f, %f, %f)", value->w, value->x, value->y, value->z);
+    return 1;
+}
+
+static int quat_set(lua_State* state)
+{
+    glm::quat* value = checkMath<glm::quat>(state, 1);
+    if(glm::quat* other = testMath<glm::quat>(state, 2)) {
+        *value = *other;
+    } else if(glm::vec3* euler = testMath<glm::vec3>(state, 2)) {
+        *value = glm::quat(*euler);
+    } else {
+        value->w = luaL_optnumber(state, 2, value->w);
+        value->x = luaL_optnumber(state, 3, value->x);
+        value->y = luaL_optnumber(state, 4, value->y);
+        value->z = luaL_optnumber(state, 5, value->z);
+    }
+    lua_settop(state, 1);
+    return 1;
+}
+
+static int quat_copy(lua_State* state)
+{
+    pushMath(state, *checkMath<glm::quat>(state, 1));
+    return 1;
+}
+
+static int quat_normalize(lua_State* state)
+{
+    glm::quat* value = checkMath<glm::quat>(state, 1);
+    *value = glm::normalize(*value);
+    lua_settop(state, 1);
+    return 1;
+}
+
+static int quat_inverse(lua_State* state)
+{
+    returnMath(state, 2, glm::inverse(*checkMath<glm::quat>(state, 1)));
+    return 1;
+}
+
+static int quat_euler(lua_State* state)
+{
+    returnMath(state, 2, glm::eulerAngles(*checkMath<glm::quat>(state, 1)));
+    return 1;
+}
+
+static int quat_rotate(lua_State* state)
+{
+    returnMath(state, 3, *checkMath<glm::quat>(state, 1) * *checkMath<glm::vec3>(state, 2));
+    return 1;
+}
+
+static int quat_mul_in(lua_State* state)
+{
+    glm::quat* value = checkMath<glm::quat>(state, 1);
+    *value *= *checkMath<glm::quat>(state, 2);
+    lua_settop(state, 1);
+    return 1;
+}
+
+static int quat_slerp_in(lua_State* state)
+{
+    glm::quat* value = checkMath<glm::quat>(state, 1);
+    *value = glm::slerp(*value, *checkMath<glm::quat>(state, 2), static_cast<float>(luaL_checknumber(state, 3)));
+    lua_settop(state, 1);
+    return 1;
+}
+
+static int math_vec2(lua_State* state)
+{
+    if(glm::vec2* other = testMath<glm::vec2>(state, 1))
+        pushMath(state, *other);
+    else
+        pushMath(state, glm::vec2(luaL_optnumber(state, 1, 0), luaL_optnumber(state, 2, 0)));
+    return 1;
+}
+
+static int math_vec3(lua_State* state)
+{
+    if(glm::vec3* other = testMath<glm::vec3>(state, 1))
+        pushMath(state, *other);
+    else
+        pushMath(state, glm::vec3(luaL_optnumber(state, 1, 0), luaL_optnumber(state, 2, 0), luaL_optnumber(state, 3, 0)));
+    return 1;
+}
+
+// quat() is the identity, quat(x, y, z) is built from euler angles and
+// quat(w, x, y, z) from its components.
+static int math_quat(lua_State* state)
+{
+    int arg_count = lua_gettop(state);
+    if(glm::quat* other = testMath<glm::quat>(state, 1))
+        pushMath(state, *other);
+    else if(glm::vec3* euler = testMath<glm::vec3>(state, 1))
+        pushMath(state, glm::quat(*euler));
+    else if(arg_count >= 4)
+        pushMath(state, glm::quat(luaL_checknumber(state, 1), luaL_checknumber(state, 2), luaL_checknumber(state, 3), luaL_checknumber(state, 4)));
+    else if(arg_count == 3)
+        pushMath(state, glm::quat(glm::vec3(luaL_checknumber(state, 1), luaL_checknumber(state, 2), luaL_checknumber(state, 3))));
+    else
+        pushMath(state, glm::quat(1, 0, 0, 0));
+    return 1;
+}
+
+static const luaL_Reg vec2_funcs[] =
+{
+    {"set", vec_set<glm::vec2>},
+    {"copy", vec_copy<glm::vec2>},
+    {"length", vec_length<glm::vec2>},
+    {"length_squared", vec_length_squared<glm::vec2>},
+    {"dot", vec_dot<glm::vec2>},
+    {"normalize", vec_normalize<glm::vec2>},
+    {"normalized", vec_normalized<glm::vec2>},
+    {"add", vec_add_in<glm::vec2>},
+    {"sub", vec_sub_in<glm::vec2>},
+    {"scale", vec_scale_in<glm::vec2>},
+    {"lerp", vec_lerp_in<glm::vec2>},
+    {0, 0}
+};
+
+static const luaL_Reg vec2_meta[] =
+{
+    {"__newindex", math_newindex<glm::vec2>},
+    {"__eq", math_eq<glm::vec2>},
+    {"__add", vec_add<glm::vec2>},
+    {"__sub", vec_sub<glm::vec2>},
+    {"__mul", vec_mul<glm::vec2>},
+    {"__div", vec_div<glm::vec2>},
+    {"__unm", vec_unm<glm::vec2>},
+    {"__tostring", vec2_tostring},
+    {0, 0}
+};
+
+static const luaL_Reg vec3_funcs[] =
+{
+    {"set", vec_set<glm::vec3>},
+    {"copy", vec_copy<glm::vec3>},
+    {"length", vec_length<glm::vec3>},
+    {"length_squared", vec_length_squared<glm::vec3>},
+    {"dot", vec_dot<glm::vec3>},
+    {"cross", vec3_cross},
+    {"normalize", vec_normalize<glm::vec3>},
+    {"normalized", vec_normalized<glm::vec3>},
+    {"add", vec_add_in<glm::vec3>},
+    {"sub", vec_sub_in<glm::vec3>},
+    {"scale", vec_scale_in<glm::vec3>},
+    {"lerp", vec_lerp_in<glm::vec3>},
+    {0, 0}
+};
+
+static const luaL_Reg vec3_meta[] =
+{
+    {"__newindex", math_newindex<glm::vec3>},
+    {"__eq", math_eq<glm::vec3>},
+    {"__add", vec_add<glm::vec3>},
+    {"__sub", vec_sub<glm::vec3>},
+    {"__mul", vec_mul<glm::vec3>},
+    {"__div", vec_div<glm::vec3>},
+    {"__unm", vec_unm<glm::vec3>},
+    {"__tostring", vec3_tostring},
+    {0, 0}
+};
+
+static const luaL_Reg quat_funcs[] =
+{
+    {"set", quat_set},
+    {"copy", quat_copy},
+    {"normalize", quat_normalize},
+    {"inverse", quat_inverse},
+    {"euler", quat_euler},
+    {"rotate", quat_rotate},
+    {"mul", quat_mul_in},
+    {"slerp", quat_slerp_in},
+    {0, 0}
+};
+
+static const luaL_Reg quat_meta[] =
+{
+    {"__newindex", math_newindex<glm::quat>},
+    {"__eq", math_eq<glm::quat>},
+    {"__mul", quat_mul},
+    {"__tostring", quat_tostring},
+    {0, 0}
+};
+
+static const luaL_Reg math_funcs[] =
+{
+    {"vec2", math_vec2},
+    {"vec3", math_vec3},
+    {"quat", math_quat},
+    {0, 0}
+};
+
+template<typename T> static void registerType(lua_State* state, const luaL_Reg* funcs, const luaL_Reg* meta)
+{
+    luaL_newmetatable(state, MathType<T>::name());
+    luaL_setfuncs(state, meta, 0);
+    lua_newtable(state);
+    luaL_setfuncs(state, funcs, 0);
+    lua_pushcclosure(state, math_index<T>, 1);
+    lua_setfield(state, -2, "__index");
+    lua_pop(state, 1);
+}
+
+void registerMath(lua_State* state)
+{
+    registerType<glm::vec2>(state, vec2_funcs, vec2_meta);
+    registerType<glm::vec3>(state, vec3_funcs, vec3_meta);
+    registerType<glm::quat>(state, quat_funcs, quat_meta);
+
+    lua_pushglobaltable(state);
+    luaL_setfuncs(state, math_funcs, 0);
+    lua_pop(state, 1);
+}
+
+glm::vec2* pushVec2(lua_State* state, const glm::vec2& value) { return pushMath(state, value); }
+glm::vec3* pushVec3(lua_State* state, const glm::vec3& value) { return pushMath(state, value); }
+glm::quat* pushQuat(lua_State* state, const glm::quat& value) { return pushMath(state, value); }
+
+glm::vec2* testVec2(lua_State* state, int index) { return testMath<glm::vec2>(state, index); }
+glm::vec3* testVec3(lua_State* state, int index) { return testMath<glm::vec3>(state, index); }
+glm::quat* testQuat(lua_State* state, int index) { return testMath<glm::quat>(state, index); }
+
+void returnVec2(lua_State* state, int out, const glm::vec2& value) { returnMath(state, out, value); }
+void returnVec3(lua_State* state, int out, const glm::vec3& value) { returnMath(state, out, value); }
+void returnQuat(lua_State* state, int out, const glm::quat& value) { returnMath(state, out, value); }
+
+bool toVec3(lua_State* state, int index, glm::vec3& value)
+{
+    if(glm::vec3* v = testMath<glm::vec3>(state, index)) {
+        value = *v;
+        return true;
+    }
+    if(!lua_istable(state, index))
+        return false;
+
+    index = lua_absindex(state, index);
+    lua_getfield(state, index, "x");
+    if(lua_isnumber(state, -1))
+        value.x = lua_tonumber(state, -1);
+    lua_getfield(state, index, "y");
+    if(lua_isnumber(state, -1))
+        value.y = lua_tonumber(state, -1);
+    lua_getfield(state, index, "z");
+    if(lua_isnumber(state, -1))
+        value.z = lua_tonumber(state, -1);
+    lua_pop(state, 3);
+    return true;
+}
+
+int readVec3Args(lua_State* state, int index, glm::vec3& value)
+{
+    if(glm::vec3* v = testMath<glm::vec3>(state, index)) {
+        value = *v;
+        return index + 1;
+    }
+    value = glm::vec3(lua_tonumber(state, index), lua_tonumber(state, index + 1), lua_tonumber(state, index + 2));
+    return index + 3;
+}
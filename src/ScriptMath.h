@@ -0,0 +1,37 @@
+#ifndef SCRIPT_MATH_H
+#define SCRIPT_MATH_H
+#include "LuaCompat.h"
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#define VEC2_META "vec2"
+#define VEC3_META "vec3"
+#define QUAT_META "quat"
+
+// Registers the vec2, vec3 and quat userdata types and their constructors.
+void registerMath(lua_State* state);
+
+glm::vec2* pushVec2(lua_State* state, const glm::vec2& value);
+glm::vec3* pushVec3(lua_State* state, const glm::vec3& value);
+glm::quat* pushQuat(lua_State* state, const glm::quat& value);
+
+// Returns the value at index if it's of the given type, or NULL otherwise.
+glm::vec2* testVec2(lua_State* state, int index);
+glm::vec3* testVec3(lua_State* state, int index);
+glm::quat* testQuat(lua_State* state, int index);
+
+// Reads a vec3, or a table with x, y and z fields for older scripts.
+bool toVec3(lua_State* state, int index, glm::vec3& value);
+// Reads either a vec3 or three numbers starting at index, and returns the
+// index of the first argument after them.
+int readVec3Args(lua_State* state, int index, glm::vec3& value);
+
+// If the value at out is of the right type it's overwritten and pushed,
+// otherwise a new value is pushed. This lets scripts reuse one value
+// instead of creating garbage every call.
+void returnVec2(lua_State* state, int out, const glm::vec2& value);
+void returnVec3(lua_State* state, int out, const glm::vec3& value);
+void returnQuat(lua_State* state, int out, const glm::quat& value);
+
+#endif
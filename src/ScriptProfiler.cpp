@@ -0,0 +1,133 @@
+#include "ScriptProfiler.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+static std::string frameName(lua_Debug& ar, bool leaf)
+{
+    std::string name = ar.short_src;
+    name += ":";
+    if(ar.name)
+        name += ar.name;
+    else if(*ar.what == 'm')
+        name += "main";
+    else
+        name += "line " + std::to_string(ar.linedefined);
+    if(leaf && ar.currentline > 0)
+        name += ":" + std::to_string(ar.currentline);
+    return name;
+}
+
+void ScriptProfiler::tick(lua_State* state, int count)
+{
+    m_pending += count;
+    if(m_pending < m_interval)
+        return;
+    m_pending = 0;
+    sample(state);
+}
+
+void ScriptProfiler::recordCall(const std::string& script, float time)
+{
+    ScriptTiming& timing = m_scripts[script];
+    timing.total_time += time;
+    timing.max_time = std::max(timing.max_time, time);
+    ++timing.calls;
+}
+
+void ScriptProfiler::recordOverrun(const std::string& script)
+{
+    ++m_scripts[script].overruns;
+}
+
+void ScriptProfiler::sample(lua_State* state)
+{
+    std::vector<std::string> frames;
+    std::string function;
+    lua_Debug ar;
+    for(int level = 0; lua_getstack(state, level, &ar); ++level) {
+        if(!lua_getinfo(state, "Snl", &ar))
+            break;
+        // Only the folded stacks keep the leaf's line, so the function table
+        // has one row per function.
+        if(level == 0)
+            function = frameName(ar, false);
+        frames.push_back(frameName(ar, level == 0));
+    }
+    if(frames.empty())
+        return;
+
+    std::string stack;
+    for(auto i = frames.rbegin(); i != frames.rend(); ++i) {
+        if(!stack.empty())
+            stack += ";";
+        stack += *i;
+    }
+    ++m_stacks[stack];
+    ++m_functions[function];
+    ++m_sample_count;
+}
+
+void ScriptProfiler::reset(void)
+{
+    m_scripts.clear();
+    m_stacks.clear();
+    m_functions.clear();
+    m_sample_count = 0;
+}
+
+void ScriptProfiler::merge(ScriptProfiler& other)
+{
+    for(auto& i : other.m_scripts) {
+        ScriptTiming& timing = m_scripts[i.first];
+        timing.total_time += i.second.total_time;
+        timing.max_time = std::max(timing.max_time, i.second.max_time);
+        timing.calls += i.second.calls;
+        timing.overruns += i.second.overruns;
+    }
+    for(auto& i : other.m_stacks)
+        m_stacks[i.first] += i.second;
+    for(auto& i : other.m_functions)
+        m_functions[i.first] += i.second;
+    m_sample_count += other.m_sample_count;
+    other.reset();
+}
+
+bool ScriptProfiler::writeFoldedStacks(std::string path) const
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if(!file) {
+        warn("Failed to open " + path + " for writing.");
+        return false;
+    }
+    for(auto i : m_stacks)
+        fprintf(file, "%s %lu\n", i.first.c_str(), i.second);
+    fclose(file);
+    return true;
+}
+
+bool ScriptProfiler::writeSummary(std::string path) const
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if(!file) {
+        warn("Failed to open " + path + " for writing.");
+        return false;
+    }
+
+    std::vector<std::pair<std::string, ScriptTiming>> scripts(m_scripts.begin(), m_scripts.end());
+    std::sort(scripts.begin(), scripts.end(), [](const std::pair<std::string, ScriptTiming>& a, const std::pair<std::string, ScriptTiming>& b) { return a.second.total_time > b.second.total_time; });
+    fprintf(file, "%-32s %12s %10s %10s %10s %10s\n", "script", "total (ms)", "calls", "avg (ms)", "max (ms)", "overruns");
+    for(auto i : scripts)
+        fprintf(file, "%-32s %12.3f %10lu %10.4f %10.4f %10lu\n", i.first.c_str(), i.second.total_time, i.second.calls, i.second.calls ? i.second.total_time / i.second.calls : 0, i.second.max_time, i.second.overruns);
+
+    std::vector<std::pair<std::string, unsigned long>> functions(m_functions.begin(), m_functions.end());
+    std::sort(functions.begin(), functions.end(), [](const std::pair<std::string, unsigned long>& a, const std::pair<std::string, unsigned long>& b) { return a.second > b.second; });
+    fprintf(file, "\n%-48s %10s %8s\n", "function", "samples", "%");
+    for(auto i : functions)
+        fprintf(file, "%-48s %10lu %8.2f\n", i.first.c_str(), i.second, 100.0 * i.second / m_sample_count);
+
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef SCRIPT_PROFILER_H
+#define SCRIPT_PROFILER_H
+#include "LuaCompat.h"
+#include <string>
+#include <unordered_map>
+
+struct ScriptTiming
+{
+    float total_time = 0;
+    float max_time = 0;
+    unsigned long calls = 0;
+    unsigned long overruns = 0;
+};
+
+class ScriptProfiler
+{
+public:
+    inline void setEnabled(bool enabled) { m_enabled = enabled; }
+    inline bool getEnabled(void) const { return m_enabled; }
+    // Number of VM instructions between samples.
+    inline void setSampleInterval(int interval) { m_interval = interval; }
+    inline int getSampleInterval(void) const { return m_interval; }
+
+    void recordCall(const std::string& script, float time);
+    // Counts a script going over its instruction budget.
+    void recordOverrun(const std::string& script);
+    // Called from the count hook with the instructions run since the last
+    // call. Samples the stack once every interval.
+    void tick(lua_State* state, int count);
+    void sample(lua_State* state);
+    void reset(void);
+    // Adds other's timings and samples to this profile, and resets other.
+    void merge(ScriptProfiler& other);
+
+    // Writes one "frame;frame;frame count" line per sampled stack, for use
+    // with flamegraph tools.
+    bool writeFoldedStacks(std::string path) const;
+    // Writes per-script call timings and per-function sample counts.
+    bool writeSummary(std::string path) const;
+private:
+    bool m_enabled = false;
+    int m_interval = 1000;
+    int m_pending = 0;
+    unsigned long m_sample_count = 0;
+    std::unordered_map<std::string, ScriptTiming> m_scripts;
+    std::unordered_map<std::string, unsigned long> m_stacks;
+    std::unordered_map<std::string, unsigned long> m_functions;
+};
+
+#endif
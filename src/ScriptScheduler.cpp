@@ -0,0 +1,218 @@
+#include "EventSystem.h"
+#include "Game.h"
+#include "ScriptScheduler.h"
+#include "ScriptSystem.h"
+#include "Util.h"
+
+#include <algorithm>
+
+void ScriptScheduler::initialize(lua_State* state)
+{
+    m_state = state;
+    lua_pushglobaltable(state);
+    luaL_setfuncs(state, scheduler_funcs, 0);
+    lua_pop(state, 1);
+}
+
+void ScriptScheduler::update(float dt)
+{
+    m_time += dt;
+    ++m_frame;
+
+    // Collect everything that's due before resuming anything, so a task that
+    // waits again during this update can't wake twice in the same frame.
+    std::vector<unsigned long> due;
+    while(!m_timed.empty() && m_timed.top().first <= m_time) {
+        due.push_back(m_timed.top().second);
+        m_timed.pop();
+    }
+    while(!m_framed.empty() && m_framed.top().first <= m_frame) {
+        due.push_back(m_framed.top().second);
+        m_framed.pop();
+    }
+
+    for(auto i : due)
+        resume(i);
+}
+
+void ScriptScheduler::cleanup(void)
+{
+    for(auto i : m_subscribed)
+        g_game->events()->rmSubscription(this, i);
+    m_subscribed.clear();
+    for(auto i : m_tasks)
+        luaL_unref(m_state, LUA_REGISTRYINDEX, i.second.ref);
+    m_tasks.clear();
+    m_owned_tasks.clear();
+    m_event_waits.clear();
+    m_timed = decltype(m_timed)();
+    m_framed = decltype(m_framed)();
+    m_state = 0;
+}
+
+void ScriptScheduler::cancel(void* owner)
+{
+    auto search = m_owned_tasks.find(owner);
+    if(search == m_owned_tasks.end())
+        return;
+
+    std::vector<unsigned long> ids = search->second;
+    for(auto i : ids) {
+        ScriptTask& task = m_tasks.at(i);
+        // A running task can't be released from under its own resume, so it's
+        // finished once it yields.
+        if(task.running)
+            task.cancelled = true;
+        else
+            finish(i);
+    }
+}
+
+unsigned long ScriptScheduler::start(lua_State* state, int arg_count)
+{
+    lua_State* thread = lua_newthread(state);
+    int ref = luaL_ref(state, LUA_REGISTRYINDEX);
+    lua_xmove(state, thread, arg_count + 1);
+
+    unsigned long id = m_next_id++;
+    ScriptTask& task = m_tasks[id];
+    task.thread = thread;
+    task.ref = ref;
+    task.owner = g_game->scripts()->getCallOwner();
+    task.script = g_game->scripts()->getCallScript();
+    m_owned_tasks[task.owner].push_back(id);
+
+    resume(id);
+    return id;
+}
+
+void ScriptScheduler::resume(unsigned long id)
+{
+    auto search = m_tasks.find(id);
+    if(search == m_tasks.end())
+        return;
+    ScriptTask& task = search->second;
+
+    int arg_count = 0;
+    if(lua_status(task.thread) == LUA_OK)
+        arg_count = lua_gettop(task.thread) - 1;
+    else
+        lua_settop(task.thread, 0);
+
+    unsigned long running = m_running;
+    bool scheduled = m_scheduled;
+    m_running = id;
+    m_scheduled = false;
+    task.running = true;
+
+    // Threads keep the hook they were created with, so they pick up any
+    // profiler or watchdog changes made since.
+    lua_sethook(task.thread, lua_gethook(m_state), lua_gethookmask(m_state), lua_gethookcount(m_state));
+
+    g_game->scripts()->beginCall(task.owner, task.script);
+#if LUA_VERSION_NUM >= 504
+    int result_count;
+    int status = lua_resume(task.thread, m_state, arg_count, &result_count);
+#else
+    int status = lua_resume(task.thread, m_state, arg_count);
+#endif
+    g_game->scripts()->endCall();
+
+    task.running = false;
+    bool yielded = m_scheduled;
+    m_running = running;
+    m_scheduled = scheduled;
+
+    if(status == LUA_YIELD && !task.cancelled) {
+        // A bare coroutine.yield() just sleeps until the next frame.
+        if(!yielded)
+            m_framed.push(FrameWake(m_frame + 1, id));
+        return;
+    }
+    if(status != LUA_YIELD && status != LUA_OK)
+        warn(lua_tostring(task.thread, -1));
+    finish(id);
+}
+
+void ScriptScheduler::finish(unsigned long id)
+{
+    auto search = m_tasks.find(id);
+    if(search == m_tasks.end())
+        return;
+
+    auto owned = m_owned_tasks.find(search->second.owner);
+    if(owned != m_owned_tasks.end()) {
+        owned->second.erase(std::remove(owned->second.begin(), owned->second.end(), id), owned->second.end());
+        if(owned->second.empty())
+            m_owned_tasks.erase(owned);
+    }
+    luaL_unref(m_state, LUA_REGISTRYINDEX, search->second.ref);
+    m_tasks.erase(search);
+}
+
+void ScriptScheduler::wakeEvent(EventType type)
+{
+    auto search = m_event_waits.find(type);
+    if(search == m_event_waits.end())
+        return;
+
+    std::vector<unsigned long> waiting;
+    waiting.swap(search->second);
+    for(auto i : waiting)
+        resume(i);
+}
+
+ScriptTask* ScriptScheduler::getRunning(lua_State* state)
+{
+    auto search = m_tasks.find(m_running);
+    if(search == m_tasks.end() || search->second.thread != state)
+        return NULL;
+    return &search->second;
+}
+
+int scheduler_start(lua_State* state)
+{
+    luaL_checktype(state, 1, LUA_TFUNCTION);
+    g_game->scripts()->getScheduler()->start(state, lua_gettop(state) - 1);
+    return 0;
+}
+
+int scheduler_wait(lua_State* state)
+{
+    ScriptScheduler* scheduler = g_game->scripts()->getScheduler();
+    float time = luaL_checknumber(state, 1);
+    if(!scheduler->getRunning(state))
+        return luaL_error(state, "wait can only be called from a function run with start.");
+
+    scheduler->m_timed.push(ScriptScheduler::TimedWake(scheduler->m_time + time, scheduler->m_running));
+    scheduler->m_scheduled = true;
+    return lua_yield(state, 0);
+}
+
+int scheduler_wait_frames(lua_State* state)
+{
+    ScriptScheduler* scheduler = g_game->scripts()->getScheduler();
+    lua_Integer frames = luaL_optinteger(state, 1, 1);
+    if(!scheduler->getRunning(state))
+        return luaL_error(state, "wait_frames can only be called from a function run with start.");
+
+    if(frames < 1)
+        frames = 1;
+    scheduler->m_framed.push(ScriptScheduler::FrameWake(scheduler->m_frame + frames, scheduler->m_running));
+    scheduler->m_scheduled = true;
+    return lua_yield(state, 0);
+}
+
+int scheduler_wait_event(lua_State* state)
+{
+    ScriptScheduler* scheduler = g_game->scripts()->getScheduler();
+    EventType type = luaL_checkinteger(state, 1);
+    if(!scheduler->getRunning(state))
+        return luaL_error(state, "wait_event can only be called from a function run with start.");
+
+    if(scheduler->m_subscribed.insert(type).second)
+        g_game->events()->addSubscription(Callback(scheduler, [scheduler](const IEvent& event) { scheduler->wakeEvent(event.getEventType()); }), type);
+    scheduler->m_event_waits[type].push_back(scheduler->m_running);
+    scheduler->m_scheduled = true;
+    return lua_yield(state, 0);
+}
@@ -0,0 +1,79 @@
+#ifndef SCRIPT_SCHEDULER_H
+#define SCRIPT_SCHEDULER_H
+#include "Event.h"
+#include "LuaCompat.h"
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct ScriptTask
+{
+    lua_State* thread;
+    int ref;
+    void* owner;
+    std::string script;
+    bool running = false;
+    bool cancelled = false;
+};
+
+class ScriptScheduler
+{
+public:
+    void initialize(lua_State* state);
+    void update(float dt);
+    void cleanup(void);
+
+    // Tasks belong to the owner of the script call that started them, and
+    // are cancelled along with it.
+    void cancel(void* owner);
+    void wakeEvent(EventType type);
+
+    inline unsigned long getTaskCount(void) const { return m_tasks.size(); }
+
+    friend int scheduler_start(lua_State* state);
+    friend int scheduler_wait(lua_State* state);
+    friend int scheduler_wait_frames(lua_State* state);
+    friend int scheduler_wait_event(lua_State* state);
+private:
+    typedef std::pair<float, unsigned long> TimedWake;
+    typedef std::pair<unsigned long, unsigned long> FrameWake;
+
+    unsigned long start(lua_State* state, int arg_count);
+    void resume(unsigned long id);
+    void finish(unsigned long id);
+    ScriptTask* getRunning(lua_State* state);
+
+    lua_State* m_state = 0;
+    unsigned long m_next_id = 1;
+    unsigned long m_running = 0;
+    bool m_scheduled = false;
+    float m_time = 0;
+    unsigned long m_frame = 0;
+    std::unordered_map<unsigned long, ScriptTask> m_tasks;
+    std::unordered_map<void*, std::vector<unsigned long>> m_owned_tasks;
+    // Sleeping tasks sit in min-heaps keyed by their wake time or frame, so
+    // each update only looks at the tasks that are due.
+    std::priority_queue<TimedWake, std::vector<TimedWake>, std::greater<TimedWake>> m_timed;
+    std::priority_queue<FrameWake, std::vector<FrameWake>, std::greater<FrameWake>> m_framed;
+    std::unordered_map<EventType, std::vector<unsigned long>> m_event_waits;
+    std::unordered_set<EventType> m_subscribed;
+};
+
+int scheduler_start(lua_State* state);
+int scheduler_wait(lua_State* state);
+int scheduler_wait_frames(lua_State* state);
+int scheduler_wait_event(lua_State* state);
+
+const luaL_Reg scheduler_funcs[] =
+{
+    {"start", scheduler_start},
+    {"wait", scheduler_wait},
+    {"wait_frames", scheduler_wait_frames},
+    {"wait_event", scheduler_wait_event},
+    {0, 0}
+};
+
+#endif
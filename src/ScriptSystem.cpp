@@ -0,0 +1,971 @@
+#include "Actor.h"
+#include "AudioSystem.h"
+#include "CScript.h"
+#include "Event.h"
+#include "Game.h"
+#include "InputSystem.h"
+#include "ResourceDefines.h"
+#include "ResourceManager.h"
+#include "ScriptBinding.h"
+#include "ScriptFFI.h"
+#include "ScriptMath.h"
+#include "ScriptSystem.h"
+#include "Transform.h"
+#include "TweenSystem.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// The environment is passed in as the chunk's argument and bound to a local
+// _ENV, so every closure the chunk creates stays tied to the instance that
+// ran it. LuaJIT has no _ENV, so there the chunk's environment is set before
+// each instance runs it instead, which its closures inherit.
+#ifdef SCRIPT_LUAJIT
+#define SCRIPT_PRELUDE ""
+#else
+#define SCRIPT_PRELUDE "local _ENV = ...; "
+#endif
+
+static const char proxy_cache_key = 0;
+static const char env_meta_key = 0;
+static const char isolated_vm_key = 0;
+
+static void scriptHook(lua_State* state, lua_Debug* ar)
+{
+    g_game->scripts()->countHook(state);
+}
+
+static int scriptPanic(lua_State* state)
+{
+    error(std::string("Unprotected error in a script: ") + lua_tostring(state, -1));
+    return 0;
+}
+
+// Engine calls an isolated script may make. They're queued and run on the
+// main thread once every isolated script has updated.
+static const luaL_Reg deferred_game_funcs[] =
+{
+    {"create_actor", game_create_actor},
+    {"load_level", game_load_level},
+    {"debug_render", game_debug_render},
+    {"exit", game_exit},
+    {0, 0}
+};
+
+static const luaL_Reg isolated_game_funcs[] =
+{
+    {"get_data_path", game_get_data_path},
+    {0, 0}
+};
+
+static int deferCall(lua_State* state)
+{
+    int arg_count = lua_gettop(state);
+    for(int i = 1; i <= arg_count; ++i) {
+        int type = lua_type(state, i);
+        if(type != LUA_TNIL && type != LUA_TBOOLEAN && type != LUA_TNUMBER && type != LUA_TSTRING)
+            return luaL_error(state, "Isolated scripts can only pass nil, booleans, numbers and strings to engine calls.");
+    }
+
+    std::vector<DeferredCommand>* commands = static_cast<std::vector<DeferredCommand>*>(lua_touserdata(state, lua_upvalueindex(1)));
+    DeferredCommand command;
+    command.func = lua_tocfunction(state, lua_upvalueindex(2));
+    for(int i = 1; i <= arg_count; ++i) {
+        DeferredValue value;
+        value.type = lua_type(state, i);
+        value.is_integer = lua_isinteger(state, i);
+        value.number = 0;
+        value.integer = 0;
+        value.pointer = 0;
+        if(value.type == LUA_TBOOLEAN)
+            value.integer = lua_toboolean(state, i);
+        else if(value.type == LUA_TNUMBER && value.is_integer)
+            value.integer = lua_tointeger(state, i);
+        else if(value.type == LUA_TNUMBER)
+            value.number = lua_tonumber(state, i);
+        else if(value.type == LUA_TSTRING)
+            value.string = lua_tostring(state, i);
+        command.args.push_back(value);
+    }
+    commands->push_back(command);
+    return 0;
+}
+
+static void setDeferredFuncs(lua_State* state, const luaL_Reg* funcs, std::vector<DeferredCommand>* commands)
+{
+    for(; funcs->name; ++funcs) {
+        lua_pushlightuserdata(state, commands);
+        lua_pushcfunction(state, funcs->func);
+        lua_pushcclosure(state, deferCall, 2);
+        lua_setfield(state, -2, funcs->name);
+    }
+}
+
+static void pushDeferredValue(lua_State* state, const DeferredValue& value)
+{
+    switch(value.type) {
+        case LUA_TBOOLEAN:
+            lua_pushboolean(state, value.integer);
+            break;
+        case LUA_TNUMBER:
+            if(value.is_integer)
+                lua_pushinteger(state, value.integer);
+            else
+                lua_pushnumber(state, value.number);
+            break;
+        case LUA_TSTRING:
+            lua_pushstring(state, value.string.c_str());
+            break;
+        case LUA_TLIGHTUSERDATA:
+            lua_pushlightuserdata(state, value.pointer);
+            break;
+        default:
+            lua_pushnil(state);
+    }
+}
+
+// Some 64 bit LuaJIT builds can't use a custom allocator, in which case the VM
+// uses its own and script memory isn't tracked or limited.
+static lua_State* newState(ScriptAllocator* allocator)
+{
+    lua_State* state = lua_newstate(ScriptAllocator::allocate, allocator);
+#ifdef SCRIPT_LUAJIT
+    if(!state) {
+        warn("This LuaJIT build doesn't support custom allocators, script memory won't be tracked.");
+        state = luaL_newstate();
+    }
+#endif
+    return state;
+}
+
+// Sets up what every script VM shares: the standard libraries, input, the
+// engine's constants and the environment metatable.
+static void initState(lua_State* state)
+{
+    lua_atpanic(state, scriptPanic);
+    luaL_openlibs(state);
+    registerMath(state);
+
+    lua_newtable(state);
+    luaL_setfuncs(state, input_funcs, 0);
+    lua_setglobal(state, "input");
+
+    lua_pushinteger(state, 3);
+    lua_setglobal(state, "KEY_UP");
+    lua_pushinteger(state, 2);
+    lua_setglobal(state, "KEY_DOWN");
+    lua_pushinteger(state, 0);
+    lua_setglobal(state, "KEY_RELEASED");
+    lua_pushinteger(state, 1);
+    lua_setglobal(state, "KEY_PRESSED");
+
+    lua_pushinteger(state, COLLISION_ENTER);
+    lua_setglobal(state, "COLLISION_ENTER");
+    lua_pushinteger(state, COLLISION_STAY);
+    lua_setglobal(state, "COLLISION_STAY");
+    lua_pushinteger(state, COLLISION_LEAVE);
+    lua_setglobal(state, "COLLISION_LEAVE");
+
+    lua_pushinteger(state, ActorDestroyedEvent::m_type);
+    lua_setglobal(state, "EVENT_ACTOR_DESTROYED");
+    lua_pushinteger(state, KeyEvent::m_type);
+    lua_setglobal(state, "EVENT_KEY");
+    lua_pushinteger(state, TweenFinishedEvent::m_type);
+    lua_setglobal(state, "EVENT_TWEEN_FINISHED");
+    lua_pushinteger(state, TimerEvent::m_type);
+    lua_setglobal(state, "EVENT_TIMER");
+
+#ifdef SCRIPT_FFI
+    registerFFI(state);
+#endif
+
+    lua_newtable(state);
+    lua_pushglobaltable(state);
+    lua_setfield(state, -2, "__index");
+    lua_rawsetp(state, LUA_REGISTRYINDEX, &env_meta_key);
+}
+
+static void pushProxyCache(lua_State* state)
+{
+    if(lua_rawgetp(state, LUA_REGISTRYINDEX, &proxy_cache_key) != LUA_TNIL)
+        return;
+    lua_pop(state, 1);
+
+    lua_newtable(state);
+    lua_newtable(state);
+    lua_pushstring(state, "v");
+    lua_setfield(state, -2, "__mode");
+    lua_setmetatable(state, -2);
+    lua_pushvalue(state, -1);
+    lua_rawsetp(state, LUA_REGISTRYINDEX, &proxy_cache_key);
+}
+
+static int writeBytecode(lua_State* state, const void* data, size_t size, void* userdata)
+{
+    static_cast<std::string*>(userdata)->append(static_cast<const char*>(data), size);
+    return 0;
+}
+
+static bool readBytecodeFile(std::string path, unsigned long long hash, std::string& bytecode)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if(!file)
+        return false;
+
+    unsigned long long file_hash = 0;
+    if(fread(&file_hash, sizeof(file_hash), 1, file) != 1 || file_hash != hash) {
+        fclose(file);
+        return false;
+    }
+
+    char buf[4096];
+    size_t len;
+    while((len = fread(buf, 1, sizeof(buf), file)) > 0)
+        bytecode.append(buf, len);
+    fclose(file);
+    return !bytecode.empty();
+}
+
+static void writeBytecodeFile(std::string path, unsigned long long hash, const std::string& bytecode)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!file)
+        return;
+    fwrite(&hash, sizeof(hash), 1, file);
+    fwrite(bytecode.data(), 1, bytecode.size(), file);
+    fclose(file);
+}
+
+ScriptSystem::ScriptSystem(size_t memory_limit)
+{
+    m_allocator.setLimit(memory_limit);
+}
+
+ScriptSystem::~ScriptSystem(void)
+{
+}
+
+bool ScriptSystem::initialize(void)
+{
+    m_state = newState(&m_allocator);
+    if(!m_state) {
+        warn("Failed to create the script VM.");
+        return false;
+    }
+    initState(m_state);
+
+    lua_newtable(m_state);
+    luaL_setfuncs(m_state, game_funcs, 0);
+    lua_setglobal(m_state, "game");
+
+    lua_newtable(m_state);
+    luaL_setfuncs(m_state, audio_funcs, 0);
+    lua_setglobal(m_state, "audio");
+
+    m_scheduler.initialize(m_state);
+    m_script_events.initialize(m_state);
+    updateHook();
+
+    setGCMode(m_gc_mode);
+
+    return true;
+}
+
+void ScriptSystem::update(float dt)
+{
+    m_scheduler.update(dt);
+    m_script_events.update(dt);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if(m_gc_mode == GCMode::INCREMENTAL)
+        collectGarbage(m_state, m_gc, m_gc_budget);
+    m_gc_time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_heap_size = lua_gc(m_state, LUA_GCCOUNT, 0) + lua_gc(m_state, LUA_GCCOUNTB, 0) / 1024.0f;
+    m_watchdog.beginFrame();
+}
+
+void ScriptSystem::cleanup(void)
+{
+    if(m_profiler.getEnabled())
+        dumpProfile("profile");
+    if(m_state) {
+        m_scheduler.cleanup();
+        m_script_events.cleanup();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_work_mutex);
+        m_workers_quit = true;
+    }
+    m_work_ready.notify_all();
+    for(auto& i : m_workers)
+        i.join();
+    m_workers.clear();
+    m_isolated.clear();
+    for(auto& i : m_isolated_vms)
+        lua_close(i.first);
+    m_isolated_vms.clear();
+    m_calls.clear();
+    m_chunks.clear();
+    m_batches.clear();
+    m_script_hashes.clear();
+    m_bytecode.clear();
+    if(m_state)
+        lua_close(m_state);
+    m_state = 0;
+}
+
+void ScriptSystem::setGCMode(GCMode mode)
+{
+#if LUA_VERSION_NUM < 504
+    if(mode == GCMode::GENERATIONAL) {
+        warn("Generational garbage collection requires Lua 5.4, using incremental collection instead.");
+        mode = GCMode::INCREMENTAL;
+    }
+#endif
+    m_gc_mode = mode;
+    m_gc = GCState();
+    if(m_state)
+        applyGCMode(m_state);
+    for(auto& i : m_isolated_vms) {
+        i.second->gc = GCState();
+        applyGCMode(i.first);
+    }
+}
+
+void ScriptSystem::applyGCMode(lua_State* state)
+{
+    switch(m_gc_mode) {
+        case GCMode::AUTOMATIC:
+#if LUA_VERSION_NUM >= 504
+            lua_gc(state, LUA_GCINC, 0, 0, 0);
+#endif
+            lua_gc(state, LUA_GCRESTART, 0);
+            break;
+        case GCMode::INCREMENTAL:
+#if LUA_VERSION_NUM >= 504
+            lua_gc(state, LUA_GCINC, 0, 0, 0);
+#endif
+            // Collection only happens in budgeted steps once a frame.
+            lua_gc(state, LUA_GCSTOP, 0);
+            break;
+        case GCMode::GENERATIONAL:
+#if LUA_VERSION_NUM >= 504
+            lua_gc(state, LUA_GCGEN, 0, 0);
+#endif
+            lua_gc(state, LUA_GCRESTART, 0);
+            break;
+    }
+}
+
+void ScriptSystem::beginCall(void* owner, const std::string& script)
+{
+    ScriptCall call;
+    call.owner = owner;
+    call.script = script;
+    if(m_profiler.getEnabled())
+        call.start = std::chrono::steady_clock::now();
+    m_calls.push_back(call);
+    m_watchdog.beginCall();
+}
+
+void ScriptSystem::endCall(void)
+{
+    if(m_calls.empty())
+        return;
+    const ScriptCall& call = m_calls.back();
+    if(m_profiler.getEnabled() && call.start != std::chrono::steady_clock::time_point())
+        m_profiler.recordCall(call.script, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - call.start).count());
+    m_calls.pop_back();
+    m_watchdog.endCall();
+}
+
+const std::string& ScriptSystem::getCallScript(void) const
+{
+    static const std::string none;
+    return m_calls.empty() ? none : m_calls.back().script;
+}
+
+void ScriptSystem::setProfiling(bool profiling)
+{
+    m_profiler.setEnabled(profiling);
+    updateHook();
+}
+
+void ScriptSystem::setInstructionBudget(unsigned long call_budget, unsigned long frame_budget, bool abort)
+{
+    m_watchdog.setCallBudget(call_budget);
+    m_watchdog.setFrameBudget(frame_budget);
+    m_watchdog.setAbort(abort);
+    updateHook();
+}
+
+// The profiler and the watchdog share one count hook, running at the finer
+// of their two intervals.
+void ScriptSystem::updateHook(void)
+{
+    m_hook_interval = 0;
+    if(m_profiler.getEnabled())
+        m_hook_interval = m_profiler.getSampleInterval();
+    if(m_watchdog.getEnabled() && (!m_hook_interval || m_watchdog.getInterval() < m_hook_interval))
+        m_hook_interval = m_watchdog.getInterval();
+
+    for(auto& i : m_isolated_vms)
+        configureIsolated(i.first, *i.second);
+    if(!m_state)
+        return;
+    if(m_hook_interval)
+        lua_sethook(m_state, scriptHook, LUA_MASKCOUNT, m_hook_interval);
+    else
+        lua_sethook(m_state, NULL, 0, 0);
+}
+
+// Runs on worker threads for isolated VMs, which only touch their own
+// profiler and watchdog.
+void ScriptSystem::countHook(lua_State* state)
+{
+    IsolatedVM* vm = findIsolated(state);
+    ScriptProfiler& profiler = vm ? vm->profiler : m_profiler;
+    ScriptWatchdog& watchdog = vm ? vm->watchdog : m_watchdog;
+    if(profiler.getEnabled())
+        profiler.tick(state, m_hook_interval);
+    if(watchdog.getEnabled() && watchdog.tick(m_hook_interval, vm ? vm->script : getCallScript(), &profiler))
+        luaL_error(state, "Script stopped for going over its instruction budget.");
+}
+
+bool ScriptSystem::dumpProfile(std::string name)
+{
+    std::string path = getPath() + "/" + name;
+    return m_profiler.writeFoldedStacks(path + ".folded") && m_profiler.writeSummary(path + ".txt");
+}
+
+bool ScriptSystem::runBenchmark(std::string id, unsigned long iterations)
+{
+    pushEnvironment(m_state);
+    if(!instantiate(m_state, id)) {
+        lua_pop(m_state, 1);
+        return false;
+    }
+    lua_getfield(m_state, -1, "benchmarks");
+    if(!lua_istable(m_state, -1)) {
+        warn(id + " doesn't define a benchmarks table.");
+        lua_pop(m_state, 2);
+        return false;
+    }
+
+    // Benchmarks get the iteration count and a transform that isn't attached
+    // to anything.
+    Transform transform;
+#ifdef SCRIPT_LUAJIT
+    printf("%s, %lu iterations\n", LUAJIT_VERSION, iterations);
+#else
+    printf("%s, %lu iterations\n", LUA_RELEASE, iterations);
+#endif
+    printf("%-24s %12s %12s\n", "benchmark", "total (ms)", "ns / iter");
+    for(int i = 1; ; ++i) {
+        lua_rawgeti(m_state, -1, i);
+        if(!lua_istable(m_state, -1)) {
+            lua_pop(m_state, 1);
+            break;
+        }
+        lua_rawgeti(m_state, -1, 1);
+        std::string name = lua_isstring(m_state, -1) ? lua_tostring(m_state, -1) : "?";
+        lua_pop(m_state, 1);
+
+        lua_rawgeti(m_state, -1, 2);
+        lua_pushinteger(m_state, iterations);
+        pushProxy(m_state, &transform, transform_funcs, transform_meta, transform_props);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int status = lua_pcall(m_state, 2, 1, 0);
+        float time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if(status)
+            printf("%-24s failed: %s\n", name.c_str(), lua_tostring(m_state, -1));
+        else if(lua_isboolean(m_state, -1) && !lua_toboolean(m_state, -1))
+            printf("%-24s %12s\n", name.c_str(), "skipped");
+        else
+            printf("%-24s %12.3f %12.1f\n", name.c_str(), time, time * 1e6f / iterations);
+        lua_pop(m_state, 2);
+    }
+
+    dropProxy(m_state, &transform);
+    lua_pop(m_state, 2);
+    return true;
+}
+
+void ScriptSystem::pushEnvironment(lua_State* state)
+{
+    lua_newtable(state);
+    lua_rawgetp(state, LUA_REGISTRYINDEX, &env_meta_key);
+    lua_setmetatable(state, -2);
+}
+
+bool ScriptSystem::instantiate(lua_State* state, std::string id)
+{
+    if(state == m_state ? !pushChunk(id) : !loadChunk(state, id))
+        return false;
+
+    lua_pushvalue(state, -2);
+#ifdef SCRIPT_LUAJIT
+    lua_pushvalue(state, -1);
+    lua_setfenv(state, -3);
+#endif
+    if(lua_pcall(state, 1, 0, 0)) {
+        warn(lua_tostring(state, -1));
+        lua_pop(state, 1);
+        return false;
+    }
+    return true;
+}
+
+lua_State* ScriptSystem::newIsolatedState(void* owner, std::string script)
+{
+    std::unique_ptr<IsolatedVM> vm(new IsolatedVM());
+    vm->owner = owner;
+    vm->script = script;
+    vm->allocator.setLimit(m_allocator.getLimit());
+    lua_State* state = newState(&vm->allocator);
+    if(!state) {
+        warn("Failed to create an isolated script VM.");
+        return NULL;
+    }
+    initState(state);
+    applyGCMode(state);
+    // Coroutines share the registry, so hooks running on one can still find
+    // their VM.
+    lua_pushlightuserdata(state, (void*)&isolated_vm_key);
+    lua_pushlightuserdata(state, vm.get());
+    lua_rawset(state, LUA_REGISTRYINDEX);
+    configureIsolated(state, *vm);
+
+    lua_newtable(state);
+    luaL_setfuncs(state, isolated_game_funcs, 0);
+    setDeferredFuncs(state, deferred_game_funcs, &vm->commands);
+    lua_setglobal(state, "game");
+
+    lua_newtable(state);
+    setDeferredFuncs(state, audio_funcs, &vm->commands);
+    lua_setglobal(state, "audio");
+
+    m_isolated_vms[state] = std::move(vm);
+    return state;
+}
+
+void* ScriptSystem::getIsolatedOwner(lua_State* state) const
+{
+    IsolatedVM* vm = findIsolated(state);
+    return vm ? vm->owner : NULL;
+}
+
+IsolatedVM* ScriptSystem::findIsolated(lua_State* state) const
+{
+    if(m_isolated_vms.empty())
+        return NULL;
+    lua_pushlightuserdata(state, (void*)&isolated_vm_key);
+    lua_rawget(state, LUA_REGISTRYINDEX);
+    IsolatedVM* vm = static_cast<IsolatedVM*>(lua_touserdata(state, -1));
+    lua_pop(state, 1);
+    return vm;
+}
+
+// Copies the main VM's profiler and watchdog settings.
+void ScriptSystem::configureIsolated(lua_State* state, IsolatedVM& vm)
+{
+    vm.profiler.setEnabled(m_profiler.getEnabled());
+    vm.profiler.setSampleInterval(m_profiler.getSampleInterval());
+    vm.watchdog.setCallBudget(m_watchdog.getCallBudget());
+    vm.watchdog.setFrameBudget(m_watchdog.getFrameBudget());
+    vm.watchdog.setAbort(m_watchdog.getAbort());
+    vm.watchdog.setInterval(m_watchdog.getInterval());
+    if(m_hook_interval)
+        lua_sethook(state, scriptHook, LUA_MASKCOUNT, m_hook_interval);
+    else
+        lua_sethook(state, NULL, 0, 0);
+}
+
+void ScriptSystem::closeIsolatedState(lua_State* state)
+{
+    auto search = m_isolated_vms.find(state);
+    if(search == m_isolated_vms.end())
+        return;
+    lua_close(state);
+    m_isolated_vms.erase(search);
+}
+
+void ScriptSystem::addIsolated(CScript* script)
+{
+    // Scripts on the same owner are kept next to each other, so they can be
+    // handed to one thread together and never race on their actor.
+    void* owner = m_isolated_vms.at(script->getState())->owner;
+    auto last = std::find_if(m_isolated.rbegin(), m_isolated.rend(), [this, owner](CScript* i) { return m_isolated_vms.at(i->getState())->owner == owner; });
+    if(last == m_isolated.rend())
+        m_isolated.push_back(script);
+    else
+        m_isolated.insert(last.base(), script);
+    m_isolated_dirty = true;
+    if(!m_workers.empty())
+        return;
+
+    // The main thread takes a share of the work too.
+    unsigned count = std::thread::hardware_concurrency();
+    for(unsigned i = 1; i < count; ++i)
+        m_workers.push_back(std::thread(&ScriptSystem::workerLoop, this));
+}
+
+void ScriptSystem::removeIsolated(CScript* script)
+{
+    auto search = std::find(m_isolated.begin(), m_isolated.end(), script);
+    if(search != m_isolated.end()) {
+        m_isolated.erase(search);
+        m_isolated_dirty = true;
+    }
+}
+
+void ScriptSystem::updateIsolated(float dt)
+{
+    if(m_isolated.empty())
+        return;
+
+    if(m_isolated_dirty) {
+        m_isolated_groups.clear();
+        for(unsigned i = 0; i < m_isolated.size(); ++i)
+            if(i == 0 || m_isolated_vms.at(m_isolated[i]->getState())->owner != m_isolated_vms.at(m_isolated[i - 1]->getState())->owner)
+                m_isolated_groups.push_back(i);
+        m_isolated_groups.push_back(m_isolated.size());
+        m_isolated_dirty = false;
+    }
+
+    m_isolated_dt = dt;
+    // The isolated VMs share one frame's collection budget between them.
+    m_isolated_gc_budget = m_gc_budget / m_isolated.size();
+    m_next_isolated = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_work_mutex);
+        m_workers_busy = m_workers.size();
+        ++m_work_generation;
+    }
+    m_work_ready.notify_all();
+    runIsolated();
+    {
+        std::unique_lock<std::mutex> lock(m_work_mutex);
+        m_work_done.wait(lock, [this]() { return m_workers_busy == 0; });
+    }
+
+    if(m_profiler.getEnabled())
+        for(auto i : m_isolated)
+            m_profiler.merge(m_isolated_vms.at(i->getState())->profiler);
+
+    // Commands run in script order, so the result doesn't depend on which
+    // thread got to which script first. Object calls go first, since a
+    // deferred load_level can delete the objects they refer to.
+    std::vector<DeferredCommand> commands;
+    for(auto i : m_isolated) {
+        std::vector<DeferredCommand>& queued = m_isolated_vms.at(i->getState())->object_commands;
+        commands.insert(commands.end(), queued.begin(), queued.end());
+        queued.clear();
+    }
+    for(auto i : m_isolated) {
+        std::vector<DeferredCommand>& queued = m_isolated_vms.at(i->getState())->commands;
+        commands.insert(commands.end(), queued.begin(), queued.end());
+        queued.clear();
+    }
+    for(auto& i : commands) {
+        lua_pushcfunction(m_state, i.func);
+        for(auto& j : i.args)
+            pushDeferredValue(m_state, j);
+        if(lua_pcall(m_state, i.args.size(), 0, 0)) {
+            warn(lua_tostring(m_state, -1));
+            lua_pop(m_state, 1);
+        }
+    }
+}
+
+// Only the VM's own worker touches its queue, so this needs no locking.
+bool ScriptSystem::deferObjectCall(lua_State* state, lua_CFunction func, void* object, std::initializer_list<lua_Number> numbers)
+{
+    IsolatedVM* vm = findIsolated(state);
+    if(!vm)
+        return false;
+
+    std::vector<DeferredCommand>& queued = vm->object_commands;
+    // Repeated calls without arguments, like transform syncs, only need to
+    // run once.
+    if(numbers.size() == 0 && !queued.empty() && queued.back().func == func && queued.back().args.size() == 1 && queued.back().args[0].pointer == object)
+        return true;
+
+    DeferredCommand command;
+    command.func = func;
+    DeferredValue value;
+    value.type = LUA_TLIGHTUSERDATA;
+    value.is_integer = false;
+    value.number = 0;
+    value.integer = 0;
+    value.pointer = object;
+    command.args.push_back(value);
+    for(lua_Number i : numbers) {
+        value.type = LUA_TNUMBER;
+        value.number = i;
+        value.pointer = 0;
+        command.args.push_back(value);
+    }
+    queued.push_back(command);
+    return true;
+}
+
+void ScriptSystem::runIsolated(void)
+{
+    unsigned group;
+    while((group = m_next_isolated++) + 1 < m_isolated_groups.size()) {
+        for(unsigned i = m_isolated_groups[group]; i < m_isolated_groups[group + 1]; ++i) {
+            lua_State* state = m_isolated[i]->getState();
+            IsolatedVM& vm = *m_isolated_vms.at(state);
+            std::chrono::steady_clock::time_point start;
+            if(vm.profiler.getEnabled())
+                start = std::chrono::steady_clock::now();
+            vm.watchdog.beginFrame();
+            vm.watchdog.beginCall();
+            m_isolated[i]->updateIsolated(m_isolated_dt);
+            vm.watchdog.endCall();
+            if(vm.profiler.getEnabled())
+                vm.profiler.recordCall(vm.script, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+            if(m_gc_mode == GCMode::INCREMENTAL)
+                collectGarbage(state, vm.gc, m_isolated_gc_budget);
+        }
+    }
+}
+
+void ScriptSystem::workerLoop(void)
+{
+    unsigned long generation = 0;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(m_work_mutex);
+            m_work_ready.wait(lock, [this, generation]() { return m_workers_quit || m_work_generation != generation; });
+            if(m_workers_quit)
+                return;
+            generation = m_work_generation;
+        }
+        runIsolated();
+        {
+            std::lock_guard<std::mutex> lock(m_work_mutex);
+            if(--m_workers_busy == 0)
+                m_work_done.notify_one();
+        }
+    }
+}
+
+void ScriptSystem::addBatchMember(std::string id, void* owner, int env, int update)
+{
+    ScriptBatch& batch = m_batches[id];
+    BatchMember member = { owner, env, update };
+    batch.members.push_back(member);
+    batch.dirty = true;
+}
+
+void ScriptSystem::removeBatchMember(std::string id, void* owner)
+{
+    auto search = m_batches.find(id);
+    if(search == m_batches.end())
+        return;
+
+    std::vector<BatchMember>& members = search->second.members;
+    for(auto i = members.begin(); i != members.end(); ++i) {
+        if(i->owner == owner) {
+            members.erase(i);
+            search->second.dirty = true;
+            // Tasks and handlers started from update_batch belong to the batch,
+            // so they last until its final member goes.
+            if(members.empty()) {
+                m_scheduler.cancel(&search->second);
+                m_script_events.cancel(&search->second);
+            }
+            return;
+        }
+    }
+}
+
+void ScriptSystem::updateBatches(float dt)
+{
+    for(auto& i : m_batches) {
+        ScriptBatch& batch = i.second;
+        if(batch.dirty) {
+            luaL_unref(m_state, LUA_REGISTRYINDEX, batch.instances);
+            batch.instances = LUA_NOREF;
+            if(!batch.members.empty()) {
+                lua_createtable(m_state, batch.members.size(), 0);
+                for(unsigned j = 0; j < batch.members.size(); ++j) {
+                    lua_rawgeti(m_state, LUA_REGISTRYINDEX, batch.members[j].env);
+                    lua_rawseti(m_state, -2, j + 1);
+                }
+                batch.instances = luaL_ref(m_state, LUA_REGISTRYINDEX);
+            }
+            batch.dirty = false;
+        }
+        if(batch.members.empty())
+            continue;
+
+        // Every instance compiled the same update_batch, so the first one's
+        // stands in for the whole batch. The batch owns anything it starts.
+        beginCall(&batch, i.first);
+        lua_rawgeti(m_state, LUA_REGISTRYINDEX, batch.members.front().update);
+        lua_rawgeti(m_state, LUA_REGISTRYINDEX, batch.instances);
+        lua_pushnumber(m_state, dt);
+        if(lua_pcall(m_state, 2, 0, 0)) {
+            warn(lua_tostring(m_state, -1));
+            lua_pop(m_state, 1);
+        }
+        endCall();
+    }
+}
+
+void ScriptSystem::releaseProxy(void* object)
+{
+    if(m_state)
+        dropProxy(m_state, object);
+    for(auto& i : m_isolated_vms)
+        dropProxy(i.first, object);
+}
+
+void ScriptSystem::collectGarbage(lua_State* state, GCState& gc, float budget)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if(!gc.collecting) {
+        if(lua_gc(state, LUA_GCCOUNT, 0) < gc.threshold)
+            return;
+        gc.collecting = true;
+    }
+
+    do {
+        if(lua_gc(state, LUA_GCSTEP, m_gc_step_size)) {
+            gc.collecting = false;
+            gc.threshold = lua_gc(state, LUA_GCCOUNT, 0) * m_gc_pause / 100.0f;
+            return;
+        }
+    } while(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() < budget);
+}
+
+bool ScriptSystem::loadChunk(lua_State* state, std::string id)
+{
+    const std::string* bytecode = getBytecode(id);
+    if(!bytecode)
+        return false;
+
+    if(luaL_loadbufferx(state, bytecode->data(), bytecode->size(), ("=" + id).c_str(), "b")) {
+        warn(lua_tostring(state, -1));
+        lua_pop(state, 1);
+        return false;
+    }
+    return true;
+}
+
+bool ScriptSystem::pushChunk(std::string id)
+{
+    auto search = m_chunks.find(id);
+    if(search == m_chunks.end()) {
+        int ref = LUA_REFNIL;
+        if(loadChunk(m_state, id))
+            ref = luaL_ref(m_state, LUA_REGISTRYINDEX);
+        search = m_chunks.emplace(id, ref).first;
+    }
+
+    if(search->second == LUA_REFNIL)
+        return false;
+    lua_rawgeti(m_state, LUA_REGISTRYINDEX, search->second);
+    return true;
+}
+
+const std::string* ScriptSystem::getBytecode(std::string id)
+{
+    auto search = m_script_hashes.find(id);
+    if(search != m_script_hashes.end())
+        return &m_bytecode.at(search->second);
+
+    char* const source = g_game->resources()->getScript(id);
+    if(!source)
+        return NULL;
+
+    // Bytecode is keyed by the chunk's contents and the Lua release, so
+    // identical scripts share an entry and stale cache files are ignored.
+    std::string chunk = std::string(SCRIPT_PRELUDE) + source;
+    unsigned long long hash = hashData(LUA_RELEASE, strlen(LUA_RELEASE));
+    hash = hashData(chunk.c_str(), chunk.size(), hash);
+
+    auto cached = m_bytecode.find(hash);
+    if(cached == m_bytecode.end()) {
+        std::string path = getPath() + "/" + SCRIPT_DATA_PATH + id + SCRIPT_CACHE_SUFFIX;
+        std::string bytecode;
+        if(!m_disk_cache || !readBytecodeFile(path, hash, bytecode)) {
+            bytecode.clear();
+            if(luaL_loadbuffer(m_state, chunk.c_str(), chunk.size(), ("=" + id).c_str())) {
+                warn(lua_tostring(m_state, -1));
+                lua_pop(m_state, 1);
+                return NULL;
+            }
+            lua_dump(m_state, writeBytecode, &bytecode, 0);
+            lua_pop(m_state, 1);
+            if(m_disk_cache)
+                writeBytecodeFile(path, hash, bytecode);
+        }
+        cached = m_bytecode.emplace(hash, bytecode).first;
+    }
+    m_script_hashes.emplace(id, hash);
+
+    return &cached->second;
+}
+
+void pushMetatable(lua_State* state, const luaL_Reg* meta)
+{
+    if(lua_rawgetp(state, LUA_REGISTRYINDEX, meta) != LUA_TNIL)
+        return;
+    lua_pop(state, 1);
+
+    lua_newtable(state);
+    luaL_setfuncs(state, meta, 0);
+    lua_pushvalue(state, -1);
+    lua_rawsetp(state, LUA_REGISTRYINDEX, meta);
+}
+
+void pushProxy(lua_State* state, void* object, const luaL_Reg* funcs, const luaL_Reg* meta, const ScriptProperty* props)
+{
+    pushProxyCache(state);
+    if(lua_rawgetp(state, -1, object) != LUA_TNIL) {
+        lua_remove(state, -2);
+        return;
+    }
+    lua_pop(state, 1);
+
+    lua_newtable(state);
+    if(funcs)
+        luaL_setfuncs(state, funcs, 0);
+    void** dat = static_cast<void**>(lua_newuserdata(state, sizeof(void*)));
+    *dat = object;
+    lua_setfield(state, -2, "instance");
+    if(props) {
+        pushBoundMetatable(state, props, meta);
+        lua_setmetatable(state, -2);
+    } else if(meta) {
+        pushMetatable(state, meta);
+        lua_setmetatable(state, -2);
+    }
+
+    lua_pushvalue(state, -1);
+    lua_rawsetp(state, -3, object);
+    lua_remove(state, -2);
+}
+
+void dropProxy(lua_State* state, void* object)
+{
+    pushProxyCache(state);
+    if(lua_rawgetp(state, -1, object) == LUA_TTABLE) {
+        lua_getfield(state, -1, "instance");
+        if(lua_isuserdata(state, -1))
+            *static_cast<void**>(lua_touserdata(state, -1)) = NULL;
+        lua_pop(state, 1);
+    }
+    lua_pop(state, 1);
+    lua_pushnil(state);
+    lua_rawsetp(state, -2, object);
+    lua_pop(state, 1);
+}
@@ -0,0 +1,236 @@
+#ifndef SCRIPT_SYSTEM_H
+#define SCRIPT_SYSTEM_H
+#include "LuaCompat.h"
+#include "ScriptAllocator.h"
+#include "ScriptEvents.h"
+#include "ScriptProfiler.h"
+#include "ScriptScheduler.h"
+#include "ScriptWatchdog.h"
+#include "System.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class CScript;
+struct ScriptProperty;
+
+struct BatchMember
+{
+    void* owner;
+    int env;
+    int update;
+};
+
+// Instances of one script that update together through a single call.
+struct ScriptBatch
+{
+    std::vector<BatchMember> members;
+    int instances = LUA_NOREF;
+    bool dirty = true;
+};
+
+// A script call in progress, so hooks know whose code is running.
+struct ScriptCall
+{
+    void* owner;
+    std::string script;
+    std::chrono::steady_clock::time_point start;
+};
+
+struct DeferredValue
+{
+    int type;
+    bool is_integer;
+    lua_Number number;
+    lua_Integer integer;
+    std::string string;
+    void* pointer;
+};
+
+// An engine call made by an isolated script, to be run on the main thread.
+struct DeferredCommand
+{
+    lua_CFunction func;
+    std::vector<DeferredValue> args;
+};
+
+// Where a VM is in its budgeted collection cycle.
+struct GCState
+{
+    bool collecting = false;
+    // Heap size in KB at which the next cycle starts.
+    float threshold = 0;
+};
+
+// A VM that belongs to a single isolated script.
+struct IsolatedVM
+{
+    // The actor the script is attached to.
+    void* owner;
+    std::string script;
+    ScriptAllocator allocator;
+    GCState gc;
+    // Each VM has its own, since the hooks run on worker threads. Profiles
+    // are merged into the main profiler after each frame.
+    ScriptProfiler profiler;
+    ScriptWatchdog watchdog;
+    std::vector<DeferredCommand> commands;
+    // Calls on engine objects, such as syncing an actor's transform with the
+    // physics world. Their first argument is the object.
+    std::vector<DeferredCommand> object_commands;
+};
+
+enum class GCMode
+{
+    AUTOMATIC,
+    INCREMENTAL,
+    GENERATIONAL,
+};
+
+class ScriptSystem : public ISystem
+{
+public:
+    // A memory_limit of 0 leaves script memory unlimited.
+    ScriptSystem(size_t memory_limit = 0);
+    virtual ~ScriptSystem(void);
+    bool initialize(void);
+    void update(float dt);
+    void cleanup(void);
+    inline lua_State* getState(void) const { return m_state; }
+    inline bool getDiskCache(void) const { return m_disk_cache; }
+    inline void setDiskCache(bool disk_cache) { m_disk_cache = disk_cache; }
+
+    void setGCMode(GCMode mode);
+    inline GCMode getGCMode(void) const { return m_gc_mode; }
+    // Milliseconds per frame the incremental collector is allowed to run.
+    inline void setGCBudget(float budget) { m_gc_budget = budget; }
+    inline float getGCBudget(void) const { return m_gc_budget; }
+    // Size of each incremental step in KB, or 0 for Lua's basic step.
+    inline void setGCStepSize(int step_size) { m_gc_step_size = step_size; }
+    // Percentage the heap must grow past its post-collection size before
+    // the next cycle starts.
+    inline void setGCPause(int pause) { m_gc_pause = pause; }
+    inline float getGCTime(void) const { return m_gc_time; }
+    inline float getHeapSize(void) const { return m_heap_size; }
+
+    inline ScriptAllocator* getAllocator(void) { return &m_allocator; }
+    // Caps the script VM's memory, in bytes. 0 removes the cap.
+    inline void setMemoryLimit(size_t limit) { m_allocator.setLimit(limit); }
+
+    // Every call into script code is bracketed by these, so that time,
+    // instructions and new tasks are attributed to the right script.
+    void beginCall(void* owner, const std::string& script);
+    void endCall(void);
+    inline void* getCallOwner(void) const { return m_calls.empty() ? NULL : m_calls.back().owner; }
+    const std::string& getCallScript(void) const;
+
+    inline ScriptScheduler* getScheduler(void) { return &m_scheduler; }
+    inline ScriptEvents* getScriptEvents(void) { return &m_script_events; }
+    inline ScriptProfiler* getProfiler(void) { return &m_profiler; }
+    inline ScriptWatchdog* getWatchdog(void) { return &m_watchdog; }
+    void setProfiling(bool profiling);
+    // Sets the watchdog's instruction budgets. 0 turns a budget off.
+    void setInstructionBudget(unsigned long call_budget, unsigned long frame_budget, bool abort);
+    void countHook(lua_State* state);
+    // Writes <name>.folded and <name>.txt next to the executable.
+    bool dumpProfile(std::string name);
+    // Runs each entry of the benchmarks table defined by script id and
+    // prints the timings, so backends can be compared on the same scripts.
+    bool runBenchmark(std::string id, unsigned long iterations);
+
+    // Pushes a new instance environment onto the stack. Globals that aren't
+    // set by the instance fall through to the VM's globals table.
+    void pushEnvironment(lua_State* state);
+    // Runs the script's chunk inside the environment at the top of the stack.
+    // The environment is left on the stack.
+    bool instantiate(lua_State* state, std::string id);
+
+    // Isolated scripts get a VM of their own, and update on worker threads.
+    // Engine calls that touch shared state are deferred and run afterwards
+    // on the main thread. Scripts on the same owner update on the same
+    // thread, one after another.
+    lua_State* newIsolatedState(void* owner, std::string script);
+    // Returns the isolated VM's owner, or NULL for the main VM.
+    void* getIsolatedOwner(lua_State* state) const;
+    void closeIsolatedState(lua_State* state);
+    void addIsolated(CScript* script);
+    void removeIsolated(CScript* script);
+    void updateIsolated(float dt);
+    // From an isolated VM, queues func(object, numbers...) to run on the main
+    // thread and returns true. Returns false on the main VM, where the caller
+    // should do the work itself.
+    bool deferObjectCall(lua_State* state, lua_CFunction func, void* object, std::initializer_list<lua_Number> numbers = {});
+    // Loads the script's compiled chunk onto the given state's stack.
+    bool loadChunk(lua_State* state, std::string id);
+    // Scripts that define update_batch(instances, dt) are updated once per
+    // frame per script, with an array of every live instance's environment.
+    void addBatchMember(std::string id, void* owner, int env, int update);
+    void removeBatchMember(std::string id, void* owner);
+    void updateBatches(float dt);
+    // Forgets the cached proxy for an object that is about to be deleted.
+    void releaseProxy(void* object);
+private:
+    bool pushChunk(std::string id);
+    const std::string* getBytecode(std::string id);
+    void applyGCMode(lua_State* state);
+    void collectGarbage(lua_State* state, GCState& gc, float budget);
+    void updateHook(void);
+    IsolatedVM* findIsolated(lua_State* state) const;
+    void configureIsolated(lua_State* state, IsolatedVM& vm);
+    void runIsolated(void);
+    void workerLoop(void);
+
+    ScriptAllocator m_allocator;
+    lua_State* m_state = 0;
+    bool m_disk_cache = true;
+    GCMode m_gc_mode = GCMode::INCREMENTAL;
+    float m_gc_budget = 1;
+    int m_gc_step_size = 0;
+    int m_gc_pause = 200;
+    GCState m_gc;
+    float m_gc_time = 0;
+    float m_heap_size = 0;
+    ScriptScheduler m_scheduler;
+    ScriptEvents m_script_events;
+    ScriptProfiler m_profiler;
+    ScriptWatchdog m_watchdog;
+    int m_hook_interval = 0;
+    std::vector<ScriptCall> m_calls;
+    std::unordered_map<lua_State*, std::unique_ptr<IsolatedVM>> m_isolated_vms;
+    std::vector<CScript*> m_isolated;
+    // Where each owner's run of scripts starts in m_isolated, followed by
+    // the end of the last run.
+    std::vector<unsigned> m_isolated_groups;
+    bool m_isolated_dirty = false;
+    std::vector<std::thread> m_workers;
+    std::mutex m_work_mutex;
+    std::condition_variable m_work_ready;
+    std::condition_variable m_work_done;
+    unsigned long m_work_generation = 0;
+    unsigned m_workers_busy = 0;
+    bool m_workers_quit = false;
+    std::atomic<unsigned> m_next_isolated{0};
+    float m_isolated_dt = 0;
+    float m_isolated_gc_budget = 0;
+    std::unordered_map<std::string, int> m_chunks;
+    std::unordered_map<std::string, ScriptBatch> m_batches;
+    std::unordered_map<std::string, unsigned long long> m_script_hashes;
+    std::unordered_map<unsigned long long, std::string> m_bytecode;
+};
+
+// Pushes the metatable built from meta, creating it the first time it's used.
+void pushMetatable(lua_State* state, const luaL_Reg* meta);
+// Pushes the proxy table for object. Proxies are cached weakly, so repeated
+// lookups of a live object return the same table. If props is given the
+// metatable dispatches those fields, see pushBoundMetatable.
+void pushProxy(lua_State* state, void* object, const luaL_Reg* funcs, const luaL_Reg* meta, const ScriptProperty* props = NULL);
+void dropProxy(lua_State* state, void* object);
+
+#endif
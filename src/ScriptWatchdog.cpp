@@ -0,0 +1,49 @@
+#include "ScriptProfiler.h"
+#include "ScriptWatchdog.h"
+#include "Util.h"
+
+void ScriptWatchdog::beginCall(void)
+{
+    CallCount call = { 0, false };
+    m_calls.push_back(call);
+}
+
+void ScriptWatchdog::endCall(void)
+{
+    if(!m_calls.empty())
+        m_calls.pop_back();
+}
+
+void ScriptWatchdog::beginFrame(void)
+{
+    m_frame_instructions = 0;
+    m_frame_warned = false;
+}
+
+bool ScriptWatchdog::tick(int count, const std::string& script, ScriptProfiler* profiler)
+{
+    m_frame_instructions += count;
+    if(m_calls.empty())
+        return false;
+    CallCount& call = m_calls.back();
+    call.instructions += count;
+
+    bool over = false;
+    if(m_call_budget && call.instructions > m_call_budget) {
+        over = true;
+        if(!call.warned)
+            warn("Script " + script + " went over its budget of " + std::to_string(m_call_budget) + " instructions per call.");
+    }
+    if(m_frame_budget && m_frame_instructions > m_frame_budget) {
+        over = true;
+        if(!m_frame_warned)
+            warn("Scripts went over their budget of " + std::to_string(m_frame_budget) + " instructions per frame in " + script + ".");
+        m_frame_warned = true;
+    }
+
+    if(over && !call.warned) {
+        call.warned = true;
+        profiler->recordOverrun(script);
+    }
+    return over && m_abort;
+}
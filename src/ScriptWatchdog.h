@@ -0,0 +1,49 @@
+#ifndef SCRIPT_WATCHDOG_H
+#define SCRIPT_WATCHDOG_H
+#include <string>
+#include <vector>
+
+class ScriptProfiler;
+
+// Counts the instructions scripts run per call and per frame, and flags
+// scripts that go over budget.
+class ScriptWatchdog
+{
+public:
+    // Budgets are in VM instructions, and 0 turns a budget off.
+    inline void setCallBudget(unsigned long budget) { m_call_budget = budget; }
+    inline unsigned long getCallBudget(void) const { return m_call_budget; }
+    inline void setFrameBudget(unsigned long budget) { m_frame_budget = budget; }
+    inline unsigned long getFrameBudget(void) const { return m_frame_budget; }
+    // Whether a call that goes over budget is stopped with an error, rather
+    // than just logged.
+    inline void setAbort(bool abort) { m_abort = abort; }
+    inline bool getAbort(void) const { return m_abort; }
+    // Instructions between checks.
+    inline void setInterval(int interval) { m_interval = interval; }
+    inline int getInterval(void) const { return m_interval; }
+    inline bool getEnabled(void) const { return m_call_budget || m_frame_budget; }
+
+    void beginCall(void);
+    void endCall(void);
+    void beginFrame(void);
+    // Adds count instructions to the running call. Returns true if the call
+    // should be aborted.
+    bool tick(int count, const std::string& script, ScriptProfiler* profiler);
+private:
+    struct CallCount
+    {
+        unsigned long instructions;
+        bool warned;
+    };
+
+    unsigned long m_call_budget = 0;
+    unsigned long m_frame_budget = 0;
+    bool m_abort = false;
+    int m_interval = 1000;
+    unsigned long m_frame_instructions = 0;
+    bool m_frame_warned = false;
+    std::vector<CallCount> m_calls;
+};
+
+#endif
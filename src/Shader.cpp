@@ -7,13 +7,11 @@ BasicShader::BasicShader(GLuint program, std::string name)
 {
     m_name = name;
     m_program = program;
-    m_vertex_position_attrib = glGetAttribLocation(m_program, "vertex_pos");
-    m_vertex_uv_attrib = glGetAttribLocation(m_program, "vertex_uv");
-    m_vertex_normal_attrib = glGetAttribLocation(m_program, "vertex_normal");
     m_w_uniform = glGetUniformLocation(m_program, "world");
     m_vp_uniform = glGetUniformLocation(m_program, "view_projection");
     m_color_uniform = glGetUniformLocation(m_program, "color");
     m_texture_uniform = glGetUniformLocation(m_program, "texture");
+    m_instance_attrib = glGetAttribLocation(m_program, "instance_world");
     checkGLError();
 }
 
@@ -23,49 +21,57 @@ BasicShader::~BasicShader(void)
 
 void BasicShader::cleanup(void)
 {
-    glDeleteProgram(m_program);
+    g_gl_state.deleteProgram(m_program);
 }
 
 void BasicShader::prepareForRender(IScene* scene, IModel* model, glm::mat4 world_matrix, Texture* texture)
 {
-    glUseProgram(m_program);
+    g_gl_state.useProgram(m_program);
     checkGLError();
 
-    glm::mat4 vp_matrix = scene->getActiveProjectionMatrix() * scene->getActiveViewMatrix();
-    glm::mat4 world_matrix_final = scene->getMatrix() * world_matrix;
-    glUniformMatrix4fv(m_vp_uniform, 1, GL_FALSE, &vp_matrix[0][0]);
-    glUniformMatrix4fv(m_w_uniform, 1, GL_FALSE, &world_matrix_final[0][0]);
+    // Shaders that read the Frame block don't have a view_projection uniform.
+    if(m_vp_uniform != -1) {
+        glm::mat4 vp_matrix = scene->getActiveProjectionMatrix() * scene->getActiveViewMatrix();
+        glUniformMatrix4fv(m_vp_uniform, 1, GL_FALSE, &vp_matrix[0][0]);
+    }
+    glUniformMatrix4fv(m_w_uniform, 1, GL_FALSE, &world_matrix[0][0]);
     glUniform4f(m_color_uniform, 1.0f, 0.7f, 0.0f, 1.0f);
+    // Without an instance buffer bound, instance_world is the same constant
+    // for every vertex, so instanced shaders work for single draws too.
+    if(m_instance_attrib != -1)
+        for(int i = 0; i < 4; ++i)
+            glVertexAttrib4fv(m_instance_attrib + i, &world_matrix[i][0]);
     checkGLError();
 
-    glEnableVertexAttribArray(m_vertex_position_attrib);
-    glBindBuffer(GL_ARRAY_BUFFER, model->getVertices());
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->getIndices());
-    glVertexAttribPointer(m_vertex_position_attrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    checkGLError();
-
-    glEnableVertexAttribArray(m_vertex_uv_attrib);
-    glBindBuffer(GL_ARRAY_BUFFER, model->getUVs());
-    glVertexAttribPointer(m_vertex_uv_attrib, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    checkGLError();
-
-    glEnableVertexAttribArray(m_vertex_normal_attrib);
-    glBindBuffer(GL_ARRAY_BUFFER, model->getNormals());
-    glVertexAttribPointer(m_vertex_normal_attrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    checkGLError();
+    g_gl_state.bindVertexArray(model->getVertexArray());
 
-    glActiveTexture(GL_TEXTURE0);
+    g_gl_state.activeTexture(GL_TEXTURE0);
     if(!texture)
-        glBindTexture(GL_TEXTURE_2D, BLANK_TEXTURE);
+        g_gl_state.bindTexture(GL_TEXTURE_2D, BLANK_TEXTURE);
     else
-        glBindTexture(GL_TEXTURE_2D, texture->texture_handle);
+        g_gl_state.bindTexture(GL_TEXTURE_2D, texture->texture_handle);
     glUniform1i(m_texture_uniform, 0);
     checkGLError();
 }
 
+// A mat4 attribute takes four consecutive locations, one per column. They're
+// set on the model's vertex array, so postRender has to disable them again.
+void BasicShader::bindInstances(GLuint buffer, unsigned first)
+{
+    if(m_instance_attrib == -1)
+        return;
+    g_gl_state.bindBuffer(GL_ARRAY_BUFFER, buffer);
+    for(int i = 0; i < 4; ++i) {
+        g_gl_state.enableAttrib(m_instance_attrib + i);
+        glVertexAttribPointer(m_instance_attrib + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(first * sizeof(glm::mat4) + i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(m_instance_attrib + i, 1);
+    }
+    checkGLError();
+}
+
 void BasicShader::postRender(void)
 {
-    glDisableVertexAttribArray(m_vertex_position_attrib);
-    glDisableVertexAttribArray(m_vertex_normal_attrib);
-    glDisableVertexAttribArray(m_vertex_uv_attrib);
+    if(m_instance_attrib != -1)
+        for(int i = 0; i < 4; ++i)
+            g_gl_state.disableAttrib(m_instance_attrib + i);
 }
@@ -18,6 +18,13 @@ public:
     virtual void prepareForRender(IScene* scene, IModel* model, glm::mat4 world_transform, Texture* texture = 0) = 0;
     virtual void postRender(void) = 0;
     virtual std::string getName(void) const = 0;
+    virtual GLuint getProgram(void) const = 0;
+    // Shaders opt into instancing by declaring a mat4 instance_world
+    // attribute, which they should use in place of the world uniform.
+    virtual bool getInstanced(void) const = 0;
+    // Reads instance_world from buffer, one matrix per instance starting at
+    // the first'th. Call after prepareForRender.
+    virtual void bindInstances(GLuint buffer, unsigned first) = 0;
 };
 inline IShader::~IShader(void) {}
 
@@ -31,15 +38,16 @@ public:
     virtual void prepareForRender(IScene* scene, IModel* model, glm::mat4 world_matrix, Texture* texture = 0);
     virtual void postRender(void);
     virtual std::string getName(void) const { return m_name; }
+    virtual GLuint getProgram(void) const { return m_program; }
+    virtual bool getInstanced(void) const { return m_instance_attrib != -1; }
+    virtual void bindInstances(GLuint buffer, unsigned first);
 protected:
     GLuint m_program;
-    GLuint m_vertex_position_attrib;
-    GLuint m_vertex_uv_attrib;
-    GLuint m_vertex_normal_attrib;
     GLuint m_w_uniform;
-    GLuint m_vp_uniform;
+    GLint m_vp_uniform;
     GLuint m_color_uniform;
     GLuint m_texture_uniform;
+    GLint m_instance_attrib;
     std::string m_name = "";
 };
 
@@ -1,8 +1,8 @@
+#include "ScriptMath.h"
 #include "Transform.h"
 #include "Util.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <glm/gtx/matrix_decompose.hpp>
 
 Transform::Transform()
 {
@@ -11,7 +11,8 @@ Transform::Transform()
 
 Transform::Transform(const Transform& transform)
 {
-    setWorldTransform(transform.m_graphics_transform);
+    m_data = transform.m_data;
+    m_graphics_transform = transform.m_graphics_transform;
 }
 
 Transform::Transform(const btTransform& transform)
@@ -26,38 +27,58 @@ Transform::Transform(lua_State* state)
 
 void Transform::getWorldTransform(btTransform& transform) const
 {
-    transform = m_physics_transform;
+    const glm::quat& q = m_data.orientation;
+    transform.setOrigin(btVector3(m_data.position.x, m_data.position.y, m_data.position.z));
+    transform.setRotation(btQuaternion(q.x, q.y, q.z, q.w));
 }
 
 glm::mat4 Transform::getWorldTransform() const
 {
+    sync();
     return m_graphics_transform;
 }
 
+// Composes T * R * S straight into the columns, without the intermediate
+// matrices and multiplies.
+void Transform::sync(void) const
+{
+    if(!m_data.dirty)
+        return;
+    m_data.dirty = 0;
+    ++m_version;
+
+    glm::mat3 rotation = glm::mat3_cast(m_data.orientation);
+    m_graphics_transform[0] = glm::vec4(rotation[0] * m_data.scale.x, 0);
+    m_graphics_transform[1] = glm::vec4(rotation[1] * m_data.scale.y, 0);
+    m_graphics_transform[2] = glm::vec4(rotation[2] * m_data.scale.z, 0);
+    m_graphics_transform[3] = glm::vec4(m_data.position, 1);
+}
+
+// Bullet bodies are unscaled, so their transforms map straight onto position
+// and orientation, and the scale is kept.
 void Transform::setWorldTransform(const btTransform& transform)
 {
-    m_physics_transform = transform;
-    float mat[16];
-    m_physics_transform.getOpenGLMatrix(mat);
-    mat[15] = 1;
-    m_graphics_transform = glm::scale(glm::make_mat4x4(mat), m_scaling);
-    glm::vec3 skew;
-    glm::vec4 persp;
-    glm::decompose(m_graphics_transform, m_scaling, m_rotation, m_translation, skew, persp);
-    m_translation_mat = glm::translate(glm::mat4(1), m_translation);
-    m_rotation_mat = glm::mat4_cast(m_rotation);
+    const btVector3& origin = transform.getOrigin();
+    btQuaternion rotation = transform.getRotation();
+    m_data.position = glm::vec3(origin.x(), origin.y(), origin.z());
+    m_data.orientation = glm::quat(rotation.w(), rotation.x(), rotation.y(), rotation.z());
+    touch();
 }
 
+// Assumes the matrix has no skew or perspective, which holds for anything
+// built from a Transform.
 void Transform::setWorldTransform(const glm::mat4& transform)
 {
+    glm::mat3 basis(transform);
+    m_data.position = glm::vec3(transform[3]);
+    m_data.scale = glm::vec3(glm::length(basis[0]), glm::length(basis[1]), glm::length(basis[2]));
+    basis[0] /= m_data.scale.x;
+    basis[1] /= m_data.scale.y;
+    basis[2] /= m_data.scale.z;
+    m_data.orientation = glm::quat_cast(basis);
     m_graphics_transform = transform;
-    m_physics_transform.setFromOpenGLMatrix(glm::value_ptr(m_graphics_transform));
-    glm::vec3 skew;
-    glm::vec4 persp;
-    glm::decompose(m_graphics_transform, m_scaling, m_rotation, m_translation, skew, persp);
-    m_translation_mat = glm::translate(glm::mat4(1), m_translation);
-    m_rotation_mat = glm::mat4_cast(m_rotation);
-    m_scale_mat = glm::translate(glm::mat4(1), m_scaling);
+    m_data.dirty = 0;
+    ++m_version;
 }
 
 void Transform::setWorldTransform(lua_State* state)
@@ -69,14 +90,13 @@ void Transform::setWorldTransform(lua_State* state)
     {
         lua_getfield(state, -1, "x");
         if(lua_isnumber(state, -1))
-            m_translation.x = lua_tonumber(state, -1);
+            m_data.position.x = lua_tonumber(state, -1);
         lua_getfield(state, -2, "y");
         if(lua_isnumber(state, -1))
-            m_translation.y = lua_tonumber(state, -1);
+            m_data.position.y = lua_tonumber(state, -1);
         lua_getfield(state, -3, "z");
         if(lua_isnumber(state, -1))
-            m_translation.z = lua_tonumber(state, -1);
-        m_translation_mat = glm::translate(glm::mat4(1), m_translation);
+            m_data.position.z = lua_tonumber(state, -1);
         lua_pop(state, 4);
     }
     
@@ -95,8 +115,7 @@ void Transform::setWorldTransform(lua_State* state)
         lua_getfield(state, -3, "z");
         if(lua_isnumber(state, -1))
             eul.z = lua_tonumber(state, -1);
-        m_rotation = glm::quat(eul);
-        m_rotation_mat = glm::mat4_cast(m_rotation);
+        m_data.orientation = glm::quat(eul);
         lua_pop(state, 4);
     }
 
@@ -107,38 +126,31 @@ void Transform::setWorldTransform(lua_State* state)
     {
         lua_getfield(state, -1, "x");
         if(!lua_isnil(state, -1))
-            m_scaling.x = lua_tonumber(state, -1);
+            m_data.scale.x = lua_tonumber(state, -1);
         else
             lua_pop(state, 1);
         lua_getfield(state, -2, "y");
         if(!lua_isnil(state, -1))
-            m_scaling.y = lua_tonumber(state, -1);
+            m_data.scale.y = lua_tonumber(state, -1);
         else
             lua_pop(state, 1);
         lua_getfield(state, -3, "z");
         if(!lua_isnil(state, -1))
-            m_scaling.z = lua_tonumber(state, -1);
+            m_data.scale.z = lua_tonumber(state, -1);
         else
             lua_pop(state, 1);
         lua_pop(state, 4);
     }
-    m_scale_mat = glm::scale(glm::mat4(1), m_scaling);
-
-    m_graphics_transform = m_scale_mat * m_rotation_mat * m_translation_mat;
-    m_physics_transform.setFromOpenGLMatrix(glm::value_ptr(m_graphics_transform));
+    touch();
 }
 
 void Transform::translate(const glm::vec3& translation, bool relative)
 {
-    if(relative) {
-        m_graphics_transform[3] += glm::vec4(translation, 1.0f);
-        m_translation += translation;
-    } else {
-        m_graphics_transform[3] = glm::vec4(translation, 1.0f);
-        m_translation = translation;
-    }
-    m_translation_mat = glm::translate(glm::mat4(1), translation);
-    m_physics_transform.setFromOpenGLMatrix(glm::value_ptr(m_graphics_transform));
+    if(relative)
+        m_data.position += translation;
+    else
+        m_data.position = translation;
+    touch();
 }
 
 void Transform::translate(float x, float y, float z, bool relative)
@@ -146,18 +158,14 @@ void Transform::translate(float x, float y, float z, bool relative)
     translate(glm::vec3(x, y, z), relative);
 }
 
+// Relative rotations are applied in local space.
 void Transform::rotate(const glm::quat& rotation, bool relative)
 {
-    if(relative) {
-        m_rotation *= rotation;
-        m_rotation_mat *= glm::mat4_cast(rotation);
-        m_graphics_transform = glm::mat4_cast(rotation) * m_graphics_transform;
-    } else {
-        m_rotation = rotation;
-        m_rotation_mat = glm::mat4_cast(rotation);
-        m_graphics_transform = m_scale_mat * m_rotation_mat * m_translation_mat;
-    }
-    m_physics_transform.setFromOpenGLMatrix(glm::value_ptr(m_graphics_transform));
+    if(relative)
+        m_data.orientation *= rotation;
+    else
+        m_data.orientation = rotation;
+    touch();
 }
 
 void Transform::rotate(const glm::vec3& rotation, bool relative)
@@ -167,15 +175,11 @@ void Transform::rotate(const glm::vec3& rotation, bool relative)
 
 void Transform::scale(const glm::vec3& scale, bool relative)
 {
-    if(relative) {
-        m_scaling *= scale;
-        m_scale_mat = glm::scale(m_scale_mat, scale);
-        m_graphics_transform = glm::scale(glm::mat4(1), scale) * m_graphics_transform;
-    } else {
-        m_scaling = scale;
-        m_scale_mat = glm::scale(glm::mat4(1), scale);
-        m_graphics_transform = m_scale_mat * m_rotation_mat * m_translation_mat;
-    }
+    if(relative)
+        m_data.scale *= scale;
+    else
+        m_data.scale = scale;
+    touch();
 }
 
 void Transform::scale(float x, float y, float z, bool relative)
@@ -183,112 +187,84 @@ void Transform::scale(float x, float y, float z, bool relative)
     scale(glm::vec3(x, y, z), relative);
 }
 
+// Composes in TRS form. This is exact unless the left side has a non-uniform
+// scale and the right side is rotated, where a matrix would pick up skew.
 void Transform::operator*=(Transform rval)
 {
-    m_graphics_transform *= rval.m_graphics_transform;
-    m_physics_transform.setFromOpenGLMatrix(glm::value_ptr(m_graphics_transform));
-    glm::vec3 skew;
-    glm::vec4 persp;
-    glm::decompose(m_graphics_transform, m_scaling, m_rotation, m_translation, skew, persp);
-    m_translation_mat = glm::translate(glm::mat4(1), m_translation);
-    m_rotation_mat = glm::mat4_cast(m_rotation);
-    m_scale_mat = glm::translate(glm::mat4(1), m_scaling);
+    const TransformData& r = rval.m_data;
+    m_data.position += m_data.orientation * (m_data.scale * r.position);
+    m_data.orientation *= r.orientation;
+    m_data.scale *= r.scale;
+    touch();
+}
+
+// Rotation takes either a quat or euler angles.
+int transform_set_rotation(lua_State* state)
+{
+    Transform* transform = toInstance<Transform>(state, 1);
+
+    glm::vec3 v = transform->getERotation();
+    if(glm::quat* q = testQuat(state, 2))
+        transform->rotate(*q, false);
+    else if(toVec3(state, 2, v))
+        transform->rotate(v, false);
+    return 0;
 }
 
-int transform_index(lua_State* state)
+// The getters fill in the vec3 or quat passed to them if there is one, so
+// scripts can read a transform every frame without making garbage.
+int transform_get_position(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access data, but the Transform is missing its instance!");
     Transform* transform = *static_cast<Transform**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
 
-    if(!strcmp(lua_tostring(state, 2), "position")) {
-        lua_newtable(state);
-        lua_pushnumber(state, transform->m_translation.x);
-        lua_setfield(state, -2, "x");
-        lua_pushnumber(state, transform->m_translation.y);
-        lua_setfield(state, -2, "y");
-        lua_pushnumber(state, transform->m_translation.z);
-        lua_setfield(state, -2, "z");
-    } else if(!strcmp(lua_tostring(state, 2), "rotation")) {
-        glm::vec3 rot = transform->getERotation();
-        lua_newtable(state);
-        lua_pushnumber(state, rot.x);
-        lua_setfield(state, -2, "x");
-        lua_pushnumber(state, rot.y);
-        lua_setfield(state, -2, "y");
-        lua_pushnumber(state, rot.z);
-        lua_setfield(state, -2, "z");
-    } else if(!strcmp(lua_tostring(state, 2), "scale")) {
-        lua_newtable(state);
-        lua_pushnumber(state, transform->m_scaling.x);
-        lua_setfield(state, -2, "x");
-        lua_pushnumber(state, transform->m_scaling.y);
-        lua_setfield(state, -2, "y");
-        lua_pushnumber(state, transform->m_scaling.z);
-        lua_setfield(state, -2, "z");
-    } else
-        return 0;
+    returnVec3(state, 2, transform->m_data.position);
     return 1;
 }
 
-int transform_newindex(lua_State* state)
+int transform_get_rotation(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
-    if(!lua_isuserdata(state, -1))
+    if(!isLiveInstance(state, -1))
         return luaL_error(state, "Trying to access data, but the Transform is missing its instance!");
     Transform* transform = *static_cast<Transform**>(lua_touserdata(state, -1));
     lua_pop(state, 1);
 
-    if(!strcmp(lua_tostring(state, 2), "position")) {
-        glm::vec3 v;
-        lua_settop(state, 3);
-        lua_getfield(state, -1, "x");
-        if(lua_isnumber(state, -1))
-            v.x = lua_tonumber(state, -1);
-        lua_pop(state, 1);
-        lua_getfield(state, -1, "y");
-        if(lua_isnumber(state, -1))
-            v.y = lua_tonumber(state, -1);
-        lua_pop(state, 1);
-        lua_getfield(state, -1, "z");
-        if(lua_isnumber(state, -1))
-            v.z = lua_tonumber(state, -1);
-        lua_pop(state, 1);
-        transform->translate(v, false);
-    } else if(!strcmp(lua_tostring(state, 2), "rotation")) {
-        glm::vec3 v;
-        lua_settop(state, 3);
-        lua_getfield(state, -1, "x");
-        if(lua_isnumber(state, -1))
-            v.x = lua_tonumber(state, -1);
-        lua_pop(state, 1);
-        lua_getfield(state, -1, "y");
-        if(lua_isnumber(state, -1))
-            v.y = lua_tonumber(state, -1);
-        lua_pop(state, 1);
-        lua_getfield(state, -1, "z");
-        if(lua_isnumber(state, -1))
-            v.z = lua_tonumber(state, -1);
-        lua_pop(state, 1);
-        transform->rotate(v, false);
-    } else if(!strcmp(lua_tostring(state, 2), "scale")) {
-        glm::vec3 v;
-        lua_settop(state, 3);
-        lua_getfield(state, -1, "x");
-        if(lua_isnumber(state, -1))
-            v.x = lua_tonumber(state, -1);
-        lua_pop(state, 1);
-        lua_getfield(state, -1, "y");
-        if(lua_isnumber(state, -1))
-            v.y = lua_tonumber(state, -1);
-        lua_pop(state, 1);
-        lua_getfield(state, -1, "z");
-        if(lua_isnumber(state, -1))
-            v.z = lua_tonumber(state, -1);
-        lua_pop(state, 1);
-        transform->scale(v, false);
-    }
-    return 0;
+    returnVec3(state, 2, transform->getERotation());
+    return 1;
+}
+
+int transform_get_orientation(lua_State* state)
+{
+    lua_getfield(state, 1, "instance");
+    if(!isLiveInstance(state, -1))
+        return luaL_error(state, "Trying to access data, but the Transform is missing its instance!");
+    Transform* transform = *static_cast<Transform**>(lua_touserdata(state, -1));
+    lua_pop(state, 1);
+
+    returnQuat(state, 2, transform->m_data.orientation);
+    return 1;
+}
+
+int transform_get_scale(lua_State* state)
+{
+    lua_getfield(state, 1, "instance");
+    if(!isLiveInstance(state, -1))
+        return luaL_error(state, "Trying to access data, but the Transform is missing its instance!");
+    Transform* transform = *static_cast<Transform**>(lua_touserdata(state, -1));
+    lua_pop(state, 1);
+
+    returnVec3(state, 2, transform->m_data.scale);
+    return 1;
+}
+
+// Keeps the old actor:transform() method form working now that transform is
+// a property; calling the proxy just returns it.
+int transform_call(lua_State* state)
+{
+    lua_settop(state, 1);
+    return 1;
 }
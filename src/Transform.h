@@ -1,15 +1,23 @@
 #ifndef TRANSFORM_H
 #define TRANSFORM_H
+#include "LuaCompat.h"
+#include "ScriptBinding.h"
 #include <btBulletDynamicsCommon.h>
 #include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
-extern "C"
+
+// Position, orientation and scale. The layout matches df_transform in the
+// script FFI definitions, so LuaJIT scripts can write it in place, after which
+// they set dirty to have the matrix rebuilt.
+struct TransformData
 {
-#include <lua.h>
-#include <lauxlib.h>
-}
+    glm::vec3 position;
+    glm::quat orientation;
+    glm::vec3 scale = { 1, 1, 1 };
+    int dirty = 0;
+};
 
 class Transform : public btMotionState
 {
@@ -30,35 +38,64 @@ public:
     void rotate(const glm::vec3& rotation, bool relative = false);
     void scale(const glm::vec3& scale, bool relative = false);
     void scale(float x, float y, float z, bool relative = false);
-    inline glm::vec3 getPosition(void) const { return m_translation; }
-    glm::vec3 getERotation(void) const { return glm::eulerAngles(m_rotation); }
-    glm::quat getQRotation(void) const { return m_rotation; }
-    inline glm::vec3 getScaling(void) const { return m_scaling; }
+    inline glm::vec3 getPosition(void) const { return m_data.position; }
+    glm::vec3 getERotation(void) const { return glm::eulerAngles(m_data.orientation); }
+    glm::quat getQRotation(void) const { return m_data.orientation; }
+    inline glm::vec3 getScaling(void) const { return m_data.scale; }
+    inline TransformData* getData(void) { return &m_data; }
+    // Changes whenever the matrix does, so callers can cache what they build
+    // from it.
+    inline unsigned getVersion(void) const { sync(); return m_version; }
+    inline void setPosition(glm::vec3 position) { translate(position); }
+    inline void setOrientation(glm::quat orientation) { rotate(orientation); }
+    inline void setScaling(glm::vec3 scaling) { scale(scaling); }
 
-    friend int transform_index(lua_State* state);
-    friend int transform_newindex(lua_State* state);
+    friend int transform_get_position(lua_State* state);
+    friend int transform_get_rotation(lua_State* state);
+    friend int transform_get_orientation(lua_State* state);
+    friend int transform_get_scale(lua_State* state);
 
     void operator*= (Transform rval);
 private:
-    btTransform m_physics_transform;
-    glm::mat4 m_graphics_transform;
+    // Rebuilds the matrix if the data has changed since it was last read.
+    void sync(void) const;
+    inline void touch(void) { m_data.dirty = 1; }
+
+    // TRS is the only state; Bullet reads it directly and the matrix is only
+    // composed when something asks for it.
+    mutable TransformData m_data;
+    mutable glm::mat4 m_graphics_transform;
+    mutable unsigned m_version = 0;
+};
 
-    glm::mat4 m_translation_mat;
-    glm::mat4 m_rotation_mat;
-    glm::mat4 m_scale_mat;
+int transform_set_rotation(lua_State* state);
+int transform_call(lua_State* state);
+int transform_get_position(lua_State* state);
+int transform_get_rotation(lua_State* state);
+int transform_get_orientation(lua_State* state);
+int transform_get_scale(lua_State* state);
 
-    glm::vec3 m_translation;
-    glm::quat m_rotation;
-    glm::vec3 m_scaling = { 1, 1, 1 };
+const luaL_Reg transform_funcs[] =
+{
+    {"get_position", transform_get_position},
+    {"get_rotation", transform_get_rotation},
+    {"get_orientation", transform_get_orientation},
+    {"get_scale", transform_get_scale},
+    {0, 0}
 };
 
-int transform_index(lua_State* state);
-int transform_newindex(lua_State* state);
+const ScriptProperty transform_props[] =
+{
+    {"position", propertyGet<Transform, glm::vec3, &Transform::getPosition>, propertySet<Transform, glm::vec3, &Transform::getPosition, &Transform::setPosition>},
+    {"rotation", propertyGet<Transform, glm::vec3, &Transform::getERotation>, transform_set_rotation},
+    {"orientation", propertyGet<Transform, glm::quat, &Transform::getQRotation>, propertySet<Transform, glm::quat, &Transform::getQRotation, &Transform::setOrientation>},
+    {"scale", propertyGet<Transform, glm::vec3, &Transform::getScaling>, propertySet<Transform, glm::vec3, &Transform::getScaling, &Transform::setScaling>},
+    {0, 0, 0}
+};
 
 const luaL_Reg transform_meta[] =
 {
-    {"__index", transform_index},
-    {"__newindex", transform_newindex},
+    {"__call", transform_call},
     {0, 0}
 };
 
@@ -0,0 +1,166 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+
+// glm matrices are column major, so each column of the result is the left
+// side's columns weighted by one column of the right side.
+static inline void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+    const float* pa = &a[0][0];
+    const float* pb = &b[0][0];
+    float* po = &out[0][0];
+    __m128 a0 = _mm_loadu_ps(pa);
+    __m128 a1 = _mm_loadu_ps(pa + 4);
+    __m128 a2 = _mm_loadu_ps(pa + 8);
+    __m128 a3 = _mm_loadu_ps(pa + 12);
+    for(int i = 0; i < 4; ++i) {
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(pb[i * 4]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(pb[i * 4 + 1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(pb[i * 4 + 2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(pb[i * 4 + 3])));
+        _mm_storeu_ps(po + i * 4, r);
+    }
+}
+#else
+static inline void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+    out = a * b;
+}
+#endif
+
+static const unsigned REMOVED = ~0u;
+
+unsigned TransformHierarchy::add(void)
+{
+    unsigned handle;
+    if(m_free.empty()) {
+        handle = m_index.size();
+        m_index.push_back(0);
+    } else {
+        handle = m_free.back();
+        m_free.pop_back();
+    }
+
+    // New nodes are roots, so appending them keeps the order valid.
+    m_index[handle] = m_handles.size();
+    m_handles.push_back(handle);
+    m_parents.push_back(-1);
+    m_local.push_back(glm::mat4(1.0f));
+    m_world.push_back(glm::mat4(1.0f));
+    m_dirty.push_back(1);
+    m_versions.push_back(0);
+    return handle;
+}
+
+void TransformHierarchy::remove(unsigned handle)
+{
+    int index = m_index[handle];
+    if(index < 0)
+        return;
+    m_handles[index] = REMOVED;
+    m_index[handle] = -1;
+    m_free.push_back(handle);
+    m_reorder = true;
+}
+
+void TransformHierarchy::setParent(unsigned handle, int parent)
+{
+    int index = m_index[handle];
+    int parent_index = parent < 0 ? -1 : m_index[parent];
+    m_parents[index] = parent_index;
+    m_dirty[index] = 1;
+    if(parent_index > index)
+        m_reorder = true;
+}
+
+void TransformHierarchy::setLocal(unsigned handle, const glm::mat4& local)
+{
+    int index = m_index[handle];
+    m_local[index] = local;
+    m_dirty[index] = 1;
+}
+
+void TransformHierarchy::update(void)
+{
+    if(m_reorder)
+        reorder();
+
+    unsigned count = m_handles.size();
+    for(unsigned i = 0; i < count; ++i) {
+        int parent = m_parents[i];
+        if(parent >= 0)
+            m_dirty[i] |= m_dirty[parent];
+        if(!m_dirty[i])
+            continue;
+        if(parent < 0)
+            m_world[i] = m_local[i];
+        else
+            multiply(m_world[parent], m_local[i], m_world[i]);
+        ++m_versions[i];
+    }
+    std::fill(m_dirty.begin(), m_dirty.end(), 0);
+}
+
+void TransformHierarchy::reorder(void)
+{
+    m_reorder = false;
+    int count = m_handles.size();
+
+    // Children as linked lists, built backwards so siblings keep their order.
+    std::vector<int> first_child(count, -1);
+    std::vector<int> next_sibling(count, -1);
+    std::vector<int> stack;
+    for(int i = count - 1; i >= 0; --i) {
+        if(m_handles[i] == REMOVED)
+            continue;
+        int parent = m_parents[i];
+        if(parent >= 0 && m_handles[parent] != REMOVED) {
+            next_sibling[i] = first_child[parent];
+            first_child[parent] = i;
+        } else {
+            stack.push_back(i);
+        }
+    }
+
+    std::vector<int> order;
+    order.reserve(count);
+    while(!stack.empty()) {
+        int i = stack.back();
+        stack.pop_back();
+        order.push_back(i);
+        // Pushed in reverse so the first child comes out first.
+        int last = stack.size();
+        for(int child = first_child[i]; child >= 0; child = next_sibling[child])
+            stack.push_back(child);
+        std::reverse(stack.begin() + last, stack.end());
+    }
+
+    std::vector<int> position(count, -1);
+    for(unsigned i = 0; i < order.size(); ++i)
+        position[order[i]] = i;
+
+    std::vector<unsigned> handles(order.size());
+    std::vector<int> parents(order.size());
+    std::vector<glm::mat4> local(order.size());
+    std::vector<glm::mat4> world(order.size());
+    std::vector<unsigned> versions(order.size());
+    for(unsigned i = 0; i < order.size(); ++i) {
+        int old = order[i];
+        int parent = m_parents[old];
+        handles[i] = m_handles[old];
+        parents[i] = parent >= 0 ? position[parent] : -1;
+        local[i] = m_local[old];
+        world[i] = m_world[old];
+        versions[i] = m_versions[old];
+        m_index[handles[i]] = i;
+    }
+    m_handles.swap(handles);
+    m_parents.swap(parents);
+    m_local.swap(local);
+    m_world.swap(world);
+    m_versions.swap(versions);
+    m_dirty.assign(order.size(), 1);
+}
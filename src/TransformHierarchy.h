@@ -0,0 +1,46 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+#include <glm/mat4x4.hpp>
+#include <vector>
+
+// Scene node transforms, flattened into arrays sorted so that parents always
+// come before their children. update() makes one pass over them and only
+// recomputes world matrices for nodes whose local matrix, or an ancestor's,
+// changed since the last pass.
+//
+// Nodes are referred to by handles, which stay valid while the arrays are
+// reordered.
+class TransformHierarchy
+{
+public:
+    unsigned add(void);
+    // Children of a removed node become roots.
+    void remove(unsigned handle);
+    // Pass -1 to make a node a root.
+    void setParent(unsigned handle, int parent);
+    void setLocal(unsigned handle, const glm::mat4& local);
+    // The reference is only valid until the next structural change.
+    inline const glm::mat4& getWorld(unsigned handle) const { return m_world[m_index[handle]]; }
+    // Changes whenever update() recomputes the node's world matrix.
+    inline unsigned getVersion(unsigned handle) const { return m_versions[m_index[handle]]; }
+    inline unsigned getCount(void) const { return m_handles.size(); }
+    void update(void);
+private:
+    // Re-sorts the arrays depth first and drops removed nodes.
+    void reorder(void);
+
+    // Indexed by handle. Free handles are -1.
+    std::vector<int> m_index;
+    std::vector<unsigned> m_free;
+
+    // Indexed by position.
+    std::vector<unsigned> m_handles;
+    std::vector<int> m_parents;
+    std::vector<glm::mat4> m_local;
+    std::vector<glm::mat4> m_world;
+    std::vector<unsigned char> m_dirty;
+    std::vector<unsigned> m_versions;
+    bool m_reorder = false;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include "Actor.h"
 #include "Game.h"
 #include "EventSystem.h"
+#include "ScriptSystem.h"
 #include "Event.h"
 #include "Util.h"
 #include <functional>
@@ -15,10 +16,41 @@ bool TweenSystem::initialize(void)
     return true;
 }
 
+static const luaL_Reg tweenMeta[] = {
+    {"__index", tweenIndex},
+    {"__newindex", tweenNewIndex},
+    {0, 0}
+};
+
+const EventType TweenFinishedEvent::m_type(5);
+
+TweenFinishedEvent::TweenFinishedEvent(Tween* tween, unsigned long actor)
+{
+    u_tween = tween;
+    m_actor = actor;
+}
+
+const EventType& TweenFinishedEvent::getEventType(void) const
+{
+    return m_type;
+}
+
+Tween* TweenFinishedEvent::getTween(void) const
+{
+    return u_tween;
+}
+
+unsigned long TweenFinishedEvent::getActor(void) const
+{
+    return m_actor;
+}
+
 void TweenSystem::update(float dt)
 {
+    std::vector<TweenFinishedEvent> finished;
     for(auto i : tween_map) {
         for(auto j : i.second) {
+            bool playing = j->playing;
             if(j->playing) {
                 j->position += dt * (j->reverse ? -1 : 1);
             }
@@ -73,8 +105,15 @@ void TweenSystem::update(float dt)
                 }
             } else
                 j->current_value = j->transitions[j->current_transition].start_value;
+            if(playing && !j->playing)
+                finished.push_back(TweenFinishedEvent(j, i.first));
         }
     }
+
+    // Sent after the update so handlers can add or remove tweens.
+    for(auto& i : finished)
+        if(contains(i.getTween()))
+            g_game->events()->callEvent(i);
 }
 
 void TweenSystem::cleanup(void)
@@ -98,6 +137,16 @@ bool TweenSystem::contains(Tween* tween)
     return tweens.find(tween) != tweens.end();
 }
 
+void pushTween(lua_State* state, Tween* tween)
+{
+    lua_newtable(state);
+    Tween** dat = static_cast<Tween**>(lua_newuserdata(state, sizeof(Tween*)));
+    *dat = tween;
+    lua_setfield(state, -2, "instance");
+    pushMetatable(state, tweenMeta);
+    lua_setmetatable(state, -2);
+}
+
 int tweenIndex(lua_State* state)
 {
     lua_getfield(state, 1, "instance");
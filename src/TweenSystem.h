@@ -1,12 +1,9 @@
 #ifndef TWEEN_SYSTEM_H
 #define TWEEN_SYSTEM_H
 #include "Actor.h"
+#include "Event.h"
+#include "LuaCompat.h"
 #include "System.h"
-extern "C"
-{
-#include <lua.h>
-#include <lauxlib.h>
-}
 
 #include <vector>
 #include <map>
@@ -45,6 +42,21 @@ struct Tween
     bool reverse = false;
 };
 
+// Sent when a tween that doesn't repeat reaches its end.
+class TweenFinishedEvent : public IEvent
+{
+    public:
+        TweenFinishedEvent(Tween* tween, unsigned long actor);
+        virtual const EventType& getEventType (void) const;
+        Tween* getTween(void) const;
+        unsigned long getActor(void) const;
+
+        static const EventType m_type;
+    private:
+        Tween* u_tween;
+        unsigned long m_actor;
+};
+
 class TweenSystem : public ISystem
 {
 public:
@@ -64,11 +76,6 @@ protected:
 
 int tweenIndex(lua_State* state);
 int tweenNewIndex(lua_State* state);
+void pushTween(lua_State* state, Tween* tween);
 
 #endif
-
-static const luaL_Reg tweenMeta[] = {
-    {"__index", tweenIndex},
-    {"__newindex", tweenNewIndex},
-    {0, 0}
-};
@@ -17,6 +17,13 @@ void init_log() {
     }
 }
 
+void _info(const char* file, unsigned line, std::string message)
+{
+    if(!log)
+        init_log();
+    fprintf(log, "%s:%d, INFO: %s\n", file, line, message.c_str());
+}
+
 void _warn(const char* file, unsigned line, std::string message)
 {
     if(!log)
@@ -52,6 +59,17 @@ char* loadFileContents(std::string filepath)
     return filedata;
 }
 
+unsigned long long hashData(const char* data, size_t size, unsigned long long seed)
+{
+    // 64-bit FNV-1a
+    unsigned long long hash = seed;
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 std::string getPath()
 {
 	char buf[1024];
@@ -1,14 +1,18 @@
 #ifndef UTIL_H
 #define UTIL_H
+#include <cstddef>
 #include <string>
 
 void init_log(void);
+void _info (const char* file, unsigned line, std::string message);
 void _warn (const char* file, unsigned line, std::string message);
 void _error(const char* file, unsigned line, std::string message, bool to_exit = true);
+#define info(message) _info(__FILE__, __LINE__, message)
 #define warn(message) _warn(__FILE__, __LINE__, message)
 #define error(message) _error(__FILE__, __LINE__, message)
 
 char* loadFileContents(std::string filepath);
+unsigned long long hashData(const char* data, size_t size, unsigned long long seed = 14695981039346656037ULL);
 
 std::string getPath();
 
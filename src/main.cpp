@@ -1,16 +1,61 @@
+#include "AABBTree.h"
 #include "Game.h"
+#include "ScriptSystem.h"
 #include "Util.h"
 
+#include <cstdlib>
+#include <cstring>
+
 Game* g_game;
 
 int main(int argc, char* argv[])
 {
+    bool profile = false;
+    size_t memory_limit = 0;
+    unsigned long call_budget = 0;
+    unsigned long frame_budget = 0;
+    bool abort_scripts = false;
+    unsigned long benchmark = 0;
+    unsigned long bvh_benchmark = 0;
+    for(int i = 1; i < argc; ++i) {
+        if(!strcmp(argv[i], "--profile"))
+            profile = true;
+        else if(!strcmp(argv[i], "--script-memory") && i + 1 < argc)
+            memory_limit = strtoul(argv[++i], NULL, 10) * 1024;
+        else if(!strcmp(argv[i], "--script-call-budget") && i + 1 < argc)
+            call_budget = strtoul(argv[++i], NULL, 10);
+        else if(!strcmp(argv[i], "--script-frame-budget") && i + 1 < argc)
+            frame_budget = strtoul(argv[++i], NULL, 10);
+        else if(!strcmp(argv[i], "--script-abort"))
+            abort_scripts = true;
+        else if(!strcmp(argv[i], "--script-benchmark") && i + 1 < argc)
+            benchmark = strtoul(argv[++i], NULL, 10);
+        else if(!strcmp(argv[i], "--bvh-benchmark") && i + 1 < argc)
+            bvh_benchmark = strtoul(argv[++i], NULL, 10);
+    }
+
+    // Doesn't need a window, so it runs before anything is initialized.
+    if(bvh_benchmark) {
+        benchmarkAABBTree(bvh_benchmark);
+        return 0;
+    }
+
     g_game = new DFBaseGame();
+    g_game->setScriptMemoryLimit(memory_limit);
 
     if(!g_game->initialize()) {
         error("Failed to initialize application.");
         return 1;
     }
+    if(profile)
+        g_game->scripts()->setProfiling(true);
+    if(call_budget || frame_budget)
+        g_game->scripts()->setInstructionBudget(call_budget, frame_budget, abort_scripts);
+    if(benchmark) {
+        g_game->scripts()->runBenchmark("benchmark.lua", benchmark);
+        g_game->cleanup();
+        return 0;
+    }
     g_game->mainLoop();
     g_game->cleanup();
     